@@ -319,6 +319,8 @@ public:
     option::OptionBool m_convert_to_standard_crypto{INI_SECTION, "convert_to_standard_crypto", false};
     option::OptionBool m_lower_master_key{INI_SECTION, "lower_master_key", false};
     option::OptionBool m_lower_system_version{INI_SECTION, "lower_system_version", true};
+    option::OptionBool m_resume_install{INI_SECTION, "resume_install", false};
+    option::OptionBool m_verify_hash_tree{INI_SECTION, "verify_hash_tree", false};
 
     // dump options
     option::OptionBool m_dump_app_folder{"dump", "app_folder", true};
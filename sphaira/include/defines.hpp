@@ -645,6 +645,20 @@ enum class SphairaResult : Result {
     YatiNcmDbCorruptHeader,
     // unable to total infos from ncm database.
     YatiNcmDbCorruptInfos,
+    // the nca being resumed is not the same format as the one journaled.
+    YatiInvalidResumeOffset,
+    // a block within the nca section hash tree did not match.
+    YatiInvalidNcaHashTree,
+    // the hfs0 hash of the collection did not match.
+    YatiInvalidHfs0Hash,
+    // the file returned less data than its size whilst being copied.
+    FsFileTruncated,
+    // the copied file did not match the source when read back.
+    FsVerifyMismatch,
+    // a transfer completed short whilst other transfers were in flight.
+    UsbShortTransfer,
+    // a compressed usb chunk was invalid or failed to decompress.
+    UsbZstdError,
 };
 
 #define MAKE_SPHAIRA_RESULT_ENUM(x) Result_##x =  MAKERESULT(Module_Sphaira, (Result)SphairaResult::x)
@@ -760,6 +774,13 @@ enum : Result {
     MAKE_SPHAIRA_RESULT_ENUM(YatiCertNotFound),
     MAKE_SPHAIRA_RESULT_ENUM(YatiNcmDbCorruptHeader),
     MAKE_SPHAIRA_RESULT_ENUM(YatiNcmDbCorruptInfos),
+    MAKE_SPHAIRA_RESULT_ENUM(YatiInvalidResumeOffset),
+    MAKE_SPHAIRA_RESULT_ENUM(YatiInvalidNcaHashTree),
+    MAKE_SPHAIRA_RESULT_ENUM(YatiInvalidHfs0Hash),
+    MAKE_SPHAIRA_RESULT_ENUM(FsFileTruncated),
+    MAKE_SPHAIRA_RESULT_ENUM(FsVerifyMismatch),
+    MAKE_SPHAIRA_RESULT_ENUM(UsbShortTransfer),
+    MAKE_SPHAIRA_RESULT_ENUM(UsbZstdError),
 };
 
 #undef MAKE_SPHAIRA_RESULT_ENUM
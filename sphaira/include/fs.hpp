@@ -293,6 +293,8 @@ struct Fs {
     virtual bool DirExists(const FsPath& path) = 0;
     virtual bool IsNative() const = 0;
     virtual FsPath Root() const { return "/"; }
+    // name of the device that the fs is stored on, used to key per device settings.
+    virtual FsPath Device() const { return "native"; }
     virtual Result read_entire_file(const FsPath& path, std::vector<u8>& out) = 0;
     virtual Result write_entire_file(const FsPath& path, const std::vector<u8>& in) = 0;
     virtual Result copy_entire_file(const FsPath& dst, const FsPath& src) = 0;
@@ -379,6 +381,14 @@ struct FsStdio : Fs {
     FsPath Root() const override {
         return m_root;
     }
+    // the mount name, such as ums0.
+    FsPath Device() const override {
+        FsPath device{m_root};
+        if (auto e = std::strchr(device.s, ':')) {
+            *e = '\0';
+        }
+        return device;
+    }
     Result read_entire_file(const FsPath& path, std::vector<u8>& out) override {
         return fs::read_entire_file(path, out);
     }
@@ -486,12 +496,20 @@ struct FsNativeSd final : FsNative {
     FsNativeSd() {
         m_open_result = fsOpenSdCardFileSystem(&m_fs);
     }
+
+    FsPath Device() const override {
+        return "sd";
+    }
 };
 #else
 struct FsNativeSd final : FsNative {
     FsNativeSd(bool ignore_read_only = true) : FsNative{fsdevGetDeviceFileSystem("sdmc:"), false, ignore_read_only} {
         m_open_result = 0;
     }
+
+    FsPath Device() const override {
+        return "sd";
+    }
 };
 #endif
 
@@ -499,24 +517,44 @@ struct FsNativeBis final : FsNative {
     FsNativeBis(FsBisPartitionId id, const FsPath& string) {
         m_open_result = fsOpenBisFileSystem(&m_fs, id, string);
     }
+
+    FsPath Device() const override {
+        return "nand";
+    }
 };
 
 struct FsNativeImage final : FsNative {
-    FsNativeImage(FsImageDirectoryId id) {
+    FsNativeImage(FsImageDirectoryId id) : m_id{id} {
         m_open_result = fsOpenImageDirectoryFileSystem(&m_fs, id);
     }
+
+    FsPath Device() const override {
+        return m_id == FsImageDirectoryId_Sd ? "sd" : "nand";
+    }
+
+    const FsImageDirectoryId m_id;
 };
 
 struct FsNativeContentStorage final : FsNative {
-    FsNativeContentStorage(FsContentStorageId id) {
+    FsNativeContentStorage(FsContentStorageId id) : m_id{id} {
         m_open_result = fsOpenContentStorageFileSystem(&m_fs, id);
     }
+
+    FsPath Device() const override {
+        return m_id == FsContentStorageId_SdCard ? "sd" : "nand";
+    }
+
+    const FsContentStorageId m_id;
 };
 
 struct FsNativeGameCard final : FsNative {
     FsNativeGameCard(const FsGameCardHandle* handle, FsGameCardPartition partition) {
         m_open_result = fsOpenGameCardFileSystem(&m_fs, handle, partition);
     }
+
+    FsPath Device() const override {
+        return "gamecard";
+    }
 };
 
 struct FsNativeSave final : FsNative {
@@ -5,6 +5,7 @@
 #include <string>
 #include <memory>
 #include <span>
+#include <vector>
 #include <switch.h>
 
 namespace sphaira::hash {
@@ -14,6 +15,9 @@ enum class Type {
     Md5,
     Sha1,
     Sha256,
+    // faster alternatives for verification, xxh64 is non-cryptographic.
+    Xxh64,
+    Blake3,
 };
 
 struct BaseSource {
@@ -29,4 +33,16 @@ Result Hash(ui::ProgressBox* pbox, Type type, BaseSource* source, std::string& o
 Result Hash(ui::ProgressBox* pbox, Type type, fs::Fs* fs, const fs::FsPath& path, std::string& out);
 Result Hash(ui::ProgressBox* pbox, Type type, std::span<const u8> data, std::string& out);
 
+// calculates multiple hashes in a single pass of the file, out is in the same order as types.
+Result Hash(ui::ProgressBox* pbox, std::span<const Type> types, fs::Fs* fs, const fs::FsPath& path, std::vector<std::string>& out);
+
+// same as above, but the hashes are cached in /config/sphaira/hash_cache.bin, keyed
+// by the path, size and modified timestamp, so an unchanged file is only hashed once.
+// only for displaying hashes, verification must always use Hash() as a file can
+// change without its size or timestamp changing.
+Result HashCached(ui::ProgressBox* pbox, std::span<const Type> types, fs::Fs* fs, const fs::FsPath& path, std::vector<std::string>& out);
+
+// records the crc32 of a file that has just been read back, see thread::VerifyCrc32.
+void CacheCrc32(fs::Fs* fs, const fs::FsPath& path, u32 crc32);
+
 } // namespace sphaira::hash
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "fs.hpp"
+#include <switch.h>
+#include <vector>
+
+// submission / completion queue of file io, run by a small pool of worker threads.
+// this allows for multiple reads / writes to be in flight at once without the
+// caller having to manage its own threads.
+namespace fs {
+
+enum class IoType {
+    Read,
+    Write,
+};
+
+struct IoRequest {
+    File* file{};
+    IoType type{};
+    s64 off{};
+    // for reads, the buffer must be valid until the request is reaped.
+    void* buf{};
+    u64 size{};
+    // returned in the completion.
+    u64 user_data{};
+};
+
+struct IoCompletion {
+    u64 user_data{};
+    Result rc{};
+    // number of bytes read or written.
+    u64 bytes{};
+};
+
+struct IoQueue {
+    static constexpr u32 MAX_THREADS = 4;
+
+    // depth is the max number of requests that can be submitted before reaping.
+    // thread_count is clamped to MAX_THREADS.
+    IoQueue(u32 depth, u32 thread_count);
+    ~IoQueue();
+
+    Result Create();
+
+    // blocks whilst the queue is full.
+    Result Submit(const IoRequest& request);
+
+    // waits for the oldest submitted request to complete, completions are
+    // always returned in submission order.
+    // returns false if there are no requests in flight.
+    auto Reap(IoCompletion& out) -> bool;
+
+    // requests that have not yet started, and any submitted after, complete
+    // with Result_TransferCancelled.
+    void Cancel();
+
+    auto GetInFlight() -> u32;
+
+private:
+    enum class State {
+        Empty,
+        Pending,
+        Running,
+        Done,
+    };
+
+    struct Slot {
+        IoRequest request{};
+        IoCompletion completion{};
+        State state{};
+    };
+
+    static void ThreadFunc(void* arg);
+    void Worker();
+    void Run(Slot& slot);
+
+private:
+    const u32 m_depth;
+    const u32 m_max_threads;
+
+    Mutex m_mutex{};
+    // stdio files cannot be read / written from multiple threads at once.
+    Mutex m_stdio_mutex{};
+    CondVar m_can_work{};
+    CondVar m_can_submit{};
+    CondVar m_can_reap{};
+
+    std::vector<Slot> m_slots{};
+    // sequence numbers of the next request to submit, start and reap.
+    u64 m_submit_index{};
+    u64 m_start_index{};
+    u64 m_reap_index{};
+
+    Thread m_threads[MAX_THREADS]{};
+    u32 m_thread_count{};
+    bool m_cancel{};
+    bool m_quit{};
+};
+
+} // namespace fs
@@ -0,0 +1,282 @@
+#pragma once
+
+#include "defines.hpp"
+#include "log.hpp"
+#include <switch.h>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <span>
+#include <cstring>
+
+// building blocks shared by the threaded pipelines (thread::Transfer and yati).
+// buffers are swapped between the stages rather than copied.
+namespace sphaira::pipeline {
+
+// used for file based emummc and zip/unzip.
+constexpr u64 SMALL_BUFFER_SIZE = 1024*512;
+// used for everything else.
+constexpr u64 NORMAL_BUFFER_SIZE = 1024*1024*4;
+
+struct Buffer {
+    std::vector<u8> buf{};
+    s64 off{};
+};
+
+template<std::size_t Size>
+struct RingBuf {
+private:
+    Buffer buf[Size]{};
+    unsigned r_index{};
+    unsigned w_index{};
+
+    static_assert(Size && (Size & (Size - 1)) == 0, "Must be power of 2!");
+
+public:
+    void ringbuf_reserve(u64 size) {
+        for (auto& e : buf) {
+            e.buf.reserve(size);
+        }
+    }
+
+    void ringbuf_reset() {
+        this->r_index = this->w_index;
+    }
+
+    unsigned ringbuf_capacity() const {
+        return Size;
+    }
+
+    unsigned ringbuf_size() const {
+        return (this->w_index - this->r_index) % (ringbuf_capacity() * 2U);
+    }
+
+    unsigned ringbuf_free() const {
+        return ringbuf_capacity() - ringbuf_size();
+    }
+
+    void ringbuf_push(std::vector<u8>& buf_in, s64 off_in) {
+        auto& value = this->buf[this->w_index % ringbuf_capacity()];
+        value.off = off_in;
+        std::swap(value.buf, buf_in);
+
+        this->w_index = (this->w_index + 1U) % (ringbuf_capacity() * 2U);
+    }
+
+    void ringbuf_pop(std::vector<u8>& buf_out, s64& off_out) {
+        auto& value = this->buf[this->r_index % ringbuf_capacity()];
+        off_out = value.off;
+        std::swap(value.buf, buf_out);
+
+        this->r_index = (this->r_index + 1U) % (ringbuf_capacity() * 2U);
+    }
+};
+
+// fixed capacity ring of bytes for a single producer and a single consumer.
+// each side only advances its own index, so the data is copied without a lock.
+// waiting for data / space is left to the caller.
+struct ByteRing {
+    explicit ByteRing(u64 capacity) : m_buf(capacity) {}
+
+    auto Capacity() const -> u64 {
+        return m_buf.size();
+    }
+
+    auto Size() const -> u64 {
+        return m_write.load(std::memory_order_acquire) - m_read.load(std::memory_order_acquire);
+    }
+
+    auto Free() const -> u64 {
+        return Capacity() - Size();
+    }
+
+    // consumer, the readable data up to the end of the buffer.
+    auto ReadSpan() -> std::span<const u8> {
+        const auto read = m_read.load(std::memory_order_relaxed);
+        const auto size = m_write.load(std::memory_order_acquire) - read;
+        const auto off = read % Capacity();
+        return { m_buf.data() + off, std::min(size, Capacity() - off) };
+    }
+
+    void Consume(u64 size) {
+        m_read.fetch_add(size, std::memory_order_release);
+    }
+
+    // producer, the free space up to the end of the buffer.
+    auto WriteSpan() -> std::span<u8> {
+        const auto write = m_write.load(std::memory_order_relaxed);
+        const auto size = Capacity() - (write - m_read.load(std::memory_order_acquire));
+        const auto off = write % Capacity();
+        return { m_buf.data() + off, std::min(size, Capacity() - off) };
+    }
+
+    void Commit(u64 size) {
+        m_write.fetch_add(size, std::memory_order_release);
+    }
+
+    // copies up to size bytes, returns the amount copied.
+    auto Read(void* buf, u64 size) -> u64 {
+        auto dst = static_cast<u8*>(buf);
+        u64 done{};
+
+        // at most twice, before and after the wrap.
+        for (auto span = ReadSpan(); done < size && !span.empty(); span = ReadSpan()) {
+            const auto chunk_size = std::min<u64>(size - done, span.size());
+            std::memcpy(dst + done, span.data(), chunk_size);
+            Consume(chunk_size);
+            done += chunk_size;
+        }
+
+        return done;
+    }
+
+    // copies up to size bytes, returns the amount copied.
+    auto Write(const void* buf, u64 size) -> u64 {
+        auto src = static_cast<const u8*>(buf);
+        u64 done{};
+
+        for (auto span = WriteSpan(); done < size && !span.empty(); span = WriteSpan()) {
+            const auto chunk_size = std::min<u64>(size - done, span.size());
+            std::memcpy(span.data(), src + done, chunk_size);
+            Commit(chunk_size);
+            done += chunk_size;
+        }
+
+        return done;
+    }
+
+private:
+    std::vector<u8> m_buf;
+    // total bytes read / written, the offset is the index modulo the capacity.
+    std::atomic<u64> m_read{};
+    std::atomic<u64> m_write{};
+};
+
+// timing of a single pipeline stage, each stage only updates its own stats.
+// stalls are the time spent waiting on the previous (in) or next (out) stage.
+struct StageStats {
+    void Start() {
+        start_tick = armGetSystemTick();
+    }
+
+    void Stop() {
+        stop_tick = armGetSystemTick();
+    }
+
+    void Log(const char* name) const {
+        const auto wall_ns = armTicksToNs(stop_tick - start_tick);
+        const auto stall_ns = armTicksToNs(stall_in + stall_out);
+        const auto busy_ns = wall_ns > stall_ns ? wall_ns - stall_ns : 0;
+        const auto to_mib_s = [this](u64 ns) {
+            return ns ? (double(bytes) / 1024.0 / 1024.0) / (double(ns) / 1e9) : 0.0;
+        };
+
+        log_write("[PIPELINE] %s: %zd bytes wall: %zu ms busy: %zu ms stall in: %zu ms out: %zu ms speed: %.2f MiB/s (%.2f MiB/s busy)\n",
+            name, bytes, wall_ns / 1000000, busy_ns / 1000000, armTicksToNs(stall_in) / 1000000, armTicksToNs(stall_out) / 1000000,
+            to_mib_s(wall_ns), to_mib_s(busy_ns));
+    }
+
+    u64 start_tick{};
+    u64 stop_tick{};
+    u64 stall_in{};
+    u64 stall_out{};
+    s64 bytes{};
+};
+
+// bounded queue of buffers between two stages.
+// the producer blocks whilst the queue is full and the consumer whilst it's empty,
+// unless the other stage has exited.
+// check is called once woken and returns the result of the pipeline, so that
+// a failure or cancel in any stage stops every stage.
+// Size is the max depth, the depth used can be lowered with SetDepth().
+template<std::size_t Size>
+struct Queue {
+    Queue() {
+        mutexInit(std::addressof(m_mutex));
+        condvarInit(std::addressof(m_can_push));
+        condvarInit(std::addressof(m_can_pop));
+    }
+
+    void Reserve(u64 size) {
+        m_ring.ringbuf_reserve(size);
+    }
+
+    // must be set before the stages are started.
+    void SetDepth(unsigned depth) {
+        m_depth = std::clamp<unsigned>(depth, 1, m_ring.ringbuf_capacity());
+    }
+
+    template<typename F>
+    Result Push(std::vector<u8>& buf, s64 off, const std::atomic_bool& consumer_running, F&& check, StageStats* stats = nullptr) {
+        SCOPED_MUTEX(std::addressof(m_mutex));
+
+        while (m_ring.ringbuf_size() >= m_depth) {
+            if (!consumer_running) {
+                R_SUCCEED();
+            }
+
+            const auto tick = armGetSystemTick();
+            R_TRY(condvarWait(std::addressof(m_can_push), std::addressof(m_mutex)));
+            if (stats) {
+                stats->stall_out += armGetSystemTick() - tick;
+            }
+            R_TRY(check());
+        }
+
+        R_TRY(check());
+        m_ring.ringbuf_push(buf, off);
+        m_peak = std::max(m_peak, m_ring.ringbuf_size());
+        return condvarWakeOne(std::addressof(m_can_pop));
+    }
+
+    // buf_out is empty once the producer has exited and the queue is drained.
+    template<typename F>
+    Result Pop(std::vector<u8>& buf_out, s64& off_out, const std::atomic_bool& producer_running, F&& check, StageStats* stats = nullptr) {
+        SCOPED_MUTEX(std::addressof(m_mutex));
+
+        while (!m_ring.ringbuf_size()) {
+            if (!producer_running) {
+                buf_out.resize(0);
+                R_SUCCEED();
+            }
+
+            const auto tick = armGetSystemTick();
+            R_TRY(condvarWait(std::addressof(m_can_pop), std::addressof(m_mutex)));
+            if (stats) {
+                stats->stall_in += armGetSystemTick() - tick;
+            }
+            R_TRY(check());
+        }
+
+        R_TRY(check());
+        m_ring.ringbuf_pop(buf_out, off_out);
+        return condvarWakeOne(std::addressof(m_can_push));
+    }
+
+    // wakes both stages, used on exit so that neither is left waiting.
+    // the mutex is locked so that a stage cannot miss the wake between checking
+    // the running flag and waiting.
+    void WakeAll() {
+        SCOPED_MUTEX(std::addressof(m_mutex));
+        condvarWakeAll(std::addressof(m_can_push));
+        condvarWakeAll(std::addressof(m_can_pop));
+    }
+
+    auto GetPeak() const -> unsigned {
+        return m_peak;
+    }
+
+    auto GetCapacity() const -> unsigned {
+        return m_depth;
+    }
+
+private:
+    Mutex m_mutex{};
+    CondVar m_can_push{};
+    CondVar m_can_pop{};
+    RingBuf<Size> m_ring{};
+    unsigned m_depth{Size};
+    unsigned m_peak{};
+};
+
+} // namespace sphaira::pipeline
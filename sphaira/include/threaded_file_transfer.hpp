@@ -1,6 +1,7 @@
 #pragma once
 
 #include "ui/progress_box.hpp"
+#include "tune.hpp"
 #include <functional>
 #include <switch.h>
 
@@ -31,13 +32,33 @@ using StartCallback = std::function<Result(PullCallback pull)>;
 // trying to read from the pull callback before it is set.
 using StartCallback2 = std::function<Result(StartThreadCallback start, PullCallback pull)>;
 
+// used when copying multiple files, sets the src and dst path of the file at index.
+// this is called from both the read and write thread.
+using FilePathCallback = std::function<void(s64 index, fs::FsPath& src_path, fs::FsPath& dst_path)>;
+// called from the write thread once a file has been fully written.
+using FileDoneCallback = std::function<Result(const fs::FsPath& src_path, const fs::FsPath& dst_path)>;
+
 // reads data from rfunc into wfunc.
 Result Transfer(ui::ProgressBox* pbox, s64 size, ReadCallback rfunc, WriteCallback wfunc, Mode mode = Mode::MultiThreaded);
+// same as above, but with the buffer size and queue depth set, see tune::Get().
+Result Transfer(ui::ProgressBox* pbox, s64 size, ReadCallback rfunc, WriteCallback wfunc, const tune::Params& params, Mode mode = Mode::MultiThreaded);
 
 // reads data from rfunc, pull data from provided pull() callback.
+// in single threaded mode, pull() reads directly from rfunc.
 Result TransferPull(ui::ProgressBox* pbox, s64 size, ReadCallback rfunc, StartCallback sfunc, Mode mode = Mode::MultiThreaded);
 Result TransferPull(ui::ProgressBox* pbox, s64 size, ReadCallback rfunc, StartCallback2 sfunc, Mode mode = Mode::MultiThreaded);
 
+// copies count files from src_fs to dst_fs using a single read / write thread pair,
+// rather than creating the threads for each file.
+// the buffer size and queue depth are tuned for the src / dst pair.
+// small files are read into the same buffer so that they're passed to the write thread at once.
+// total_size is only used for the progress.
+// if verify is set, each file is read back and checked before done_func is called.
+Result TransferFiles(ui::ProgressBox* pbox, fs::Fs* src_fs, fs::Fs* dst_fs, s64 count, s64 total_size, FilePathCallback path_func, FileDoneCallback done_func = nullptr, bool verify = false);
+
+// reads back a copied file and checks that its size and crc32 match the source.
+Result VerifyCrc32(ui::ProgressBox* pbox, fs::Fs* fs, const fs::FsPath& path, s64 size, u32 crc32, bool update_progress);
+
 // helper for extract zips.
 // this will multi-thread unzip if size >= 512KiB, otherwise it'll single pass.
 Result TransferUnzip(ui::ProgressBox* pbox, void* zfile, fs::Fs* fs, const fs::FsPath& path, s64 size, u32 crc32 = 0, Mode mode = Mode::SingleThreadedIfSmaller);
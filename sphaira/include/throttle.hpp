@@ -0,0 +1,88 @@
+#pragma once
+
+#include <utility>
+#include <atomic>
+#include <switch.h>
+
+namespace sphaira::throttle {
+
+// paces io to the sd card when running on file based emummc, as the emummc
+// fat layer becomes unresponsive if it is flooded with requests.
+// rather than sleeping a fixed amount after each io call, the delay adapts to
+// the measured latency (aimd): it doubles when io is slower than the fastest
+// observed rate and decreases linearly whilst io is fast.
+// there is a single sd card, so the state is shared by every thread doing io.
+struct Controller {
+    Controller();
+
+    // updates the delay from the latency of a single io call of size bytes.
+    void Update(u64 latency_ns, s64 size);
+
+    auto GetDelay() const -> u64 {
+        return m_delay;
+    }
+
+private:
+    // io is only compared against io of a similar size, as the latency has a
+    // fixed cost which dominates small io.
+    // each bucket is half an octave, from 4KiB to 16MiB.
+    static constexpr u32 BUCKET_MIN_SHIFT = 12;
+    static constexpr u32 BUCKET_MAX_SHIFT = 24;
+    static constexpr u32 BUCKET_COUNT = (BUCKET_MAX_SHIFT - BUCKET_MIN_SHIFT) * 2 + 1;
+
+    static auto GetBucket(s64 size) -> u32;
+
+private:
+    Mutex m_mutex{};
+    // current delay in ns.
+    std::atomic<u64> m_delay{};
+    // latency in ns of the fastest recent io for each bucket.
+    u64 m_baseline[BUCKET_COUNT]{};
+};
+
+// the controller shared by every throttle.
+auto GetController() -> Controller&;
+
+// handle to the controller, which does nothing if disabled.
+struct Emummc {
+    // enabled if running on file based emummc.
+    Emummc();
+    explicit Emummc(bool enabled, Controller& controller = GetController());
+
+    // times func, updates the delay and then sleeps for the delay.
+    template<typename F>
+    auto Run(s64 size, F&& func) {
+        if (!m_controller) {
+            return func();
+        }
+
+        const auto start = armGetSystemTick();
+        auto rc = func();
+        m_controller->Update(armTicksToNs(armGetSystemTick() - start), size);
+
+        if (const auto delay = m_controller->GetDelay()) {
+            svcSleepThread(delay);
+        }
+
+        return rc;
+    }
+
+    void Update(u64 latency_ns, s64 size) {
+        if (m_controller) {
+            m_controller->Update(latency_ns, size);
+        }
+    }
+
+    auto IsEnabled() const -> bool {
+        return m_controller;
+    }
+
+    auto GetDelay() const -> u64 {
+        return m_controller ? m_controller->GetDelay() : 0;
+    }
+
+private:
+    Controller* m_controller{};
+};
+
+} // namespace sphaira::throttle
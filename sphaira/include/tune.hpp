@@ -0,0 +1,31 @@
+#pragma once
+
+#include "fs.hpp"
+#include "ui/progress_box.hpp"
+#include <string>
+#include <switch.h>
+
+// per device pair buffer size and queue depth for the threaded transfers.
+// the values are found by benchmarking a copy between the two devices and are
+// saved so that later copies between the same devices use them.
+namespace sphaira::tune {
+
+// max number of buffers queued between the read and write thread.
+constexpr u32 MAX_DEPTH = 8;
+
+struct Params {
+    u64 buffer_size;
+    u32 depth;
+};
+
+// used if the device pair hasn't been benchmarked.
+auto GetDefault() -> Params;
+
+// returns the saved params for copying from src to dst, or the default.
+auto Get(const fs::Fs* src, const fs::Fs* dst) -> Params;
+
+// copies a temp file from src_dir to dst_dir with each buffer size / depth, the fastest is saved.
+// out is set to a table of the speed of each, rows are the buffer size and columns the depth.
+Result Benchmark(ui::ProgressBox* pbox, fs::Fs* src_fs, const fs::FsPath& src_dir, fs::Fs* dst_fs, const fs::FsPath& dst_dir, std::string& out);
+
+} // namespace sphaira::tune
@@ -193,6 +193,7 @@ private:
     void InstallForwarder();
 
     void InstallFiles();
+    void VerifyFiles();
     void UnzipFiles(fs::FsPath folder);
     void ZipFiles(fs::FsPath zip_path);
     void UploadFiles();
@@ -265,7 +266,8 @@ private:
         return (fs::FsNative*)m_fs.get();
     }
 
-    void DisplayHash(hash::Type type);
+    void DisplayHash(std::span<const hash::Type> types);
+    void DisplayBenchmark();
 
     void DisplayOptions();
     void DisplayAdvancedOptions();
@@ -410,6 +412,7 @@ private:
     option::OptionBool m_folders_first{INI_SECTION, "folders_first", true};
     option::OptionBool m_hidden_last{INI_SECTION, "hidden_last", false};
     option::OptionBool m_ignore_read_only{INI_SECTION, "ignore_read_only", false};
+    option::OptionBool m_verify_copy{INI_SECTION, "verify_copy", false};
 
     bool m_loaded_assoc_entries{};
     bool m_is_update_folder{};
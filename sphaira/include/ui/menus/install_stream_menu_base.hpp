@@ -2,6 +2,7 @@
 
 #include "ui/menus/menu_base.hpp"
 #include "yati/source/stream.hpp"
+#include "pipeline.hpp"
 
 namespace sphaira::ui::menu::stream {
 
@@ -33,7 +34,7 @@ struct Stream final : yati::source::Stream {
 private:
     fs::FsPath m_path{};
     std::stop_token m_token{};
-    std::vector<u8> m_buffer{};
+    pipeline::ByteRing m_buffer;
     CondVar m_can_read{};
     CondVar m_can_write{};
 
@@ -3,6 +3,8 @@
 #include <vector>
 #include <string>
 #include <memory>
+#include <span>
+#include <algorithm>
 #include <switch.h>
 
 namespace sphaira::usb {
@@ -24,11 +26,17 @@ struct Base {
     }
 
     // transfers all data.
+    // large transfers are split so that several are in flight at once.
     Result TransferAll(bool read, void *data, u32 size, u64 timeout);
     Result TransferAll(bool read, void *data, u32 size) {
         return TransferAll(read, data, size, m_transfer_timeout);
     }
 
+    // sets how many transfers are posted at once, 1 being no queueing.
+    void SetMaxInFlight(u32 count) {
+        m_max_in_flight = std::clamp<u32>(count, 1, TRANSFER_MAX_IN_FLIGHT);
+    }
+
     // returns the cancel event.
     auto GetCancelEvent() {
         return &m_uevent;
@@ -49,13 +57,34 @@ protected:
         UsbSessionEndpoint_Out = 1,
     };
 
+    // max number of transfers posted to an endpoint at once.
+    static constexpr u32 TRANSFER_MAX_IN_FLIGHT = 4;
+
+    struct TransferReport {
+        u32 id;
+        Result rc;
+        u32 transferred_size;
+    };
+
     virtual Event *GetCompletionEvent(UsbSessionEndpoint ep) = 0;
     virtual Result WaitTransferCompletion(UsbSessionEndpoint ep, u64 timeout) = 0;
     virtual Result TransferAsync(UsbSessionEndpoint ep, void *buffer, u32 remaining, u32 size, u32 *out_xfer_id) = 0;
     virtual Result GetTransferResult(UsbSessionEndpoint ep, u32 xfer_id, u32 *out_requested_size, u32 *out_transferred_size) = 0;
+    // returns the transfers that have completed, used when several transfers are in flight.
+    virtual Result GetTransferReports(UsbSessionEndpoint ep, std::span<TransferReport> out, u32 *out_count) = 0;
+    // cancels the posted transfers and waits until they're no longer pending,
+    // so that the transfer buffer can be reused.
+    virtual void CancelTransfers(UsbSessionEndpoint ep, std::span<const u32> xfer_ids) = 0;
+
+    // waits for the transfers to be reported, used once they have been cancelled.
+    void DrainTransfers(UsbSessionEndpoint ep, std::span<const u32> xfer_ids);
+
+private:
+    Result TransferAllQueued(bool read, u8 *data, u32 size, u64 timeout);
 
 private:
     u64 m_transfer_timeout{};
+    u32 m_max_in_flight{TRANSFER_MAX_IN_FLIGHT};
     UEvent m_uevent{};
     std::unique_ptr<u8*> m_aligned{};
 };
@@ -16,7 +16,11 @@ enum USBCmdType : u8 {
 
 enum USBCmdId : u32 {
     EXIT = 0,
-    FILE_RANGE = 1
+    FILE_RANGE = 1,
+    // sphaira extension, only sent if the host set USBFlag_ZSTD.
+    // same request as FILE_RANGE, however the range is sent as chunks,
+    // each a ZstdChunkHeader followed by the chunk data.
+    FILE_RANGE_ZSTD = 2,
 };
 
 // extension flags for sphaira.
@@ -26,6 +30,8 @@ enum USBFlag : u8 {
     // allows the upload to be multi threaded., do not modify!
     // the order of the file list must be kept as-is.
     USBFlag_STREAM = 1 << 0,
+    // host accepts FILE_RANGE_ZSTD, the client may still use FILE_RANGE.
+    USBFlag_ZSTD = 1 << 1,
 };
 
 struct TUSHeader {
@@ -51,7 +57,18 @@ struct FileRangeCmdHeader {
     u64 padding;
 };
 
+// the chunks of a FILE_RANGE_ZSTD range decompress to the size of the range.
+// the header and data are sent as separate transfers.
+struct ZstdChunkHeader {
+    // size of the data that follows.
+    // the data is a zstd frame if smaller than decompressed_size, otherwise it's stored as-is.
+    u32 size;
+    u32 decompressed_size;
+    u8 padding[0x8];
+};
+
 static_assert(sizeof(TUSHeader) == 0x10, "TUSHeader must be 0x10!");
 static_assert(sizeof(USBCmdHeader) == 0x20, "USBCmdHeader must be 0x20!");
+static_assert(sizeof(ZstdChunkHeader) == 0x10, "ZstdChunkHeader must be 0x10!");
 
 } // namespace sphaira::usb::tinfoil
@@ -5,7 +5,9 @@
 #include <string>
 #include <memory>
 #include <span>
+#include <vector>
 #include <switch.h>
+#include <zstd.h>
 
 namespace sphaira::usb::upload {
 
@@ -27,11 +29,14 @@ struct Usb {
     Result PollCommands();
 
 private:
-    Result FileRangeCmd(u64 data_size);
+    Result FileRangeCmd(u64 data_size, bool compress);
 
 private:
     std::unique_ptr<usb::UsbHs> m_usb;
     std::vector<u8> m_buf;
+    std::vector<u8> m_zstd_buf;
+    // compressed ranges are only offered if this was created.
+    ZSTD_CCtx* m_cctx{};
 };
 
 } // namespace sphaira::usb::upload
@@ -27,6 +27,8 @@ private:
     Result WaitTransferCompletion(UsbSessionEndpoint ep, u64 timeout) override;
     Result TransferAsync(UsbSessionEndpoint ep, void *buffer, u32 remaining, u32 size, u32 *out_urb_id) override;
     Result GetTransferResult(UsbSessionEndpoint ep, u32 urb_id, u32 *out_requested_size, u32 *out_transferred_size) override;
+    Result GetTransferReports(UsbSessionEndpoint ep, std::span<TransferReport> out, u32 *out_count) override;
+    void CancelTransfers(UsbSessionEndpoint ep, std::span<const u32> xfer_ids) override;
 
 private:
     UsbDsInterface* m_interface{};
@@ -22,6 +22,9 @@ struct CollectionEntry {
     s64 offset{};
     // collection size within file, may be compressed size.
     s64 size{};
+    // optional sha256 over the first header_hash_size bytes of the collection (hfs0 only).
+    u32 header_hash_size{};
+    u8 header_hash[0x20]{};
 };
 
 using Collections = std::vector<CollectionEntry>;
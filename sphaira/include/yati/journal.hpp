@@ -0,0 +1,93 @@
+#pragma once
+
+#include <switch.h>
+#include <span>
+#include <vector>
+
+// checkpoints the progress of nca's being installed, so that a failed install
+// can continue from the last checkpoint rather than starting the nca again.
+// only nca's (not ncz) are checkpointed, as the zstd state cannot be restored.
+// the file io is left to the caller, this only handles the format and the
+// resume decisions so that they can be tested on the host.
+namespace sphaira::yati::journal {
+
+constexpr u32 MAGIC = 0x4C4E524A; // JRNL
+constexpr u32 VERSION = 1;
+// how much data is written between each checkpoint.
+constexpr s64 INTERVAL = 1024*1024*256;
+
+struct Header {
+    u32 magic;
+    u32 version;
+    u32 count;
+    u32 padding;
+};
+
+struct Entry {
+    // the content id from the name of the nca.
+    NcmContentId content_id;
+    NcmPlaceHolderId placeholder_id;
+    s64 size;
+    // bytes written to the placeholder, up to the checkpoint.
+    s64 committed;
+    // running sha256 of the nca, up to the checkpoint.
+    Sha256Context sha256;
+    u8 storage_id;
+    u8 padding[7];
+};
+
+auto Encode(std::span<const Entry> entries) -> std::vector<u8>;
+// returns false if the journal is invalid, entries that cannot be resumed from are dropped.
+auto Decode(std::span<const u8> data, std::vector<Entry>& out) -> bool;
+
+enum class Action {
+    None,
+    // the header has been processed, restore the hash state of the checkpoint.
+    Resume,
+    // the data up to written should be checkpointed.
+    Checkpoint,
+};
+
+// the resume decisions of a single nca install, shared by the read, decompress
+// and write threads.
+// the first buffer (the nca header) is always installed, as it may be modified,
+// the data after it is skipped up to the resume offset.
+struct Tracker {
+    Tracker() = default;
+    Tracker(s64 resume_offset, s64 interval = INTERVAL) : m_resume_offset{resume_offset}, m_interval{interval} {}
+
+    // read and write threads, the offset of the buffer after the one at off.
+    auto NextOffset(s64 off, s64 size) const -> s64 {
+        if (m_resume_offset && !off) {
+            return m_resume_offset;
+        }
+        return off + size;
+    }
+
+    // decompress thread, called once the buffer at off has been hashed, written
+    // being the total amount hashed.
+    auto Update(s64 off, s64 written) -> Action {
+        if (m_resume_offset && !off) {
+            m_checkpoint = m_resume_offset;
+            return Action::Resume;
+        }
+
+        if (written - m_checkpoint >= m_interval) {
+            m_checkpoint = written;
+            return Action::Checkpoint;
+        }
+
+        return Action::None;
+    }
+
+    auto GetResumeOffset() const -> s64 {
+        return m_resume_offset;
+    }
+
+private:
+    s64 m_resume_offset{};
+    s64 m_interval{INTERVAL};
+    s64 m_checkpoint{};
+};
+
+} // namespace sphaira::yati::journal
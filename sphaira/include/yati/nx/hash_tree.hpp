@@ -0,0 +1,69 @@
+#pragma once
+
+#include "nca.hpp"
+#include <switch.h>
+#include <vector>
+
+namespace sphaira::nca {
+
+// verifies the HierarchicalSha256 / IVFC hash tree of each nca section
+// whilst the nca is being streamed, data must be passed in order.
+// sections that cannot be verified (bktr, sparse, compressed) are skipped.
+struct HashTreeVerifier {
+    // header must be decrypted, key is the aes-ctr key used by the sections.
+    Result Init(const Header& header, const keys::KeyEntry& key, s64 max_memory);
+
+    // data is the raw (encrypted) nca data, unless plaintext is set.
+    Result Update(s64 off, const void* data, s64 size, bool plaintext);
+
+    // logs the amount of data hashed and the time taken for each section.
+    void LogStats() const;
+
+    auto IsEmpty() const -> bool {
+        return m_sections.empty();
+    }
+
+private:
+    struct Level {
+        // offset and size relative to the start of the section.
+        s64 offset{};
+        s64 size{};
+        s64 block_size{};
+        // set for ivfc, the last block is hashed as a full block.
+        bool pad{};
+        // the hash table used to verify the next level.
+        bool keep{};
+        std::vector<u8> data{};
+
+        Sha256Context ctx{};
+        s64 block_pos{};
+        s64 block_index{};
+        s64 processed{};
+    };
+
+    struct Section {
+        u8 index{};
+        u8 hash_type{};
+        u8 encryption_type{};
+        u64 ctr{};
+        // offset and size within the nca.
+        s64 offset{};
+        s64 size{};
+        std::vector<u8> master_hash{};
+        std::vector<Level> levels{};
+
+        // stats.
+        s64 hashed{};
+        u64 ticks{};
+    };
+
+    Result UpdateSection(Section& section, s64 off, const u8* data, s64 size);
+    Result UpdateLevel(Section& section, u32 level_index, const u8* data, s64 size);
+
+private:
+    keys::KeyEntry m_key{};
+    std::vector<Section> m_sections{};
+    std::vector<u8> m_temp{};
+};
+
+} // namespace sphaira::nca
@@ -1,6 +1,10 @@
 #pragma once
 
 #include <switch.h>
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <span>
 
 namespace sphaira::ncz {
 
@@ -51,4 +55,56 @@ struct Section {
     }
 };
 
+// index over a list of entries sorted by offset, such as sections or blocks.
+// lookups are O(log n), with sequential lookups being O(1) as the last
+// found entry is cached.
+template<typename T>
+struct Index {
+    Index() = default;
+    explicit Index(std::span<const T> entries) : m_entries{entries} {}
+
+    // returns the entry containing off, or nullptr if none do.
+    auto Find(u64 off) -> const T* {
+        // check the cached entry and the one after it, as offsets are
+        // usually only ever increasing.
+        for (auto i = m_cursor; i < m_entries.size() && i <= m_cursor + 1; i++) {
+            if (m_entries[i].InRange(off)) {
+                m_cursor = i;
+                return std::addressof(m_entries[i]);
+            }
+        }
+
+        const auto it = std::ranges::upper_bound(m_entries, off, {}, &T::offset);
+        if (it == m_entries.begin() || !std::prev(it)->InRange(off)) {
+            return nullptr;
+        }
+
+        m_cursor = std::distance(m_entries.begin(), it) - 1;
+        return std::addressof(m_entries[m_cursor]);
+    }
+
+    // returns all entries that intersect [off, off + size).
+    auto FindRange(u64 off, u64 size) const -> std::span<const T> {
+        auto first = std::ranges::upper_bound(m_entries, off, {}, &T::offset);
+        if (first != m_entries.begin() && std::prev(first)->offset + std::prev(first)->size > off) {
+            first--;
+        }
+
+        const auto last = std::ranges::lower_bound(m_entries, off + size, {}, &T::offset);
+        if (first >= last) {
+            return {};
+        }
+
+        return {first, last};
+    }
+
+    auto IsLast(const T* entry) const -> bool {
+        return !m_entries.empty() && entry == std::addressof(m_entries.back());
+    }
+
+private:
+    std::span<const T> m_entries{};
+    std::size_t m_cursor{};
+};
+
 } // namespace sphaira::ncz
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "defines.hpp"
+#include "log.hpp"
+#include <switch.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace sphaira::yati {
+
+// hands out jobs (nca's) to the install threads and combines their progress.
+// this allows for the write stalls of one nca to overlap with the
+// read / decompress of another nca.
+// T must have a size, which is the initial size used for the progress.
+template<typename T>
+struct Scheduler {
+    using JobFunc = std::function<Result(T&)>;
+    // called with the combined progress of every job.
+    using ProgressFunc = std::function<void(s64 offset, s64 size)>;
+
+    Scheduler(std::span<T> jobs, JobFunc job_func, ProgressFunc progress_func)
+    : m_jobs{jobs}, m_job_func{job_func}, m_progress_func{progress_func} {
+        mutexInit(std::addressof(m_mutex));
+
+        m_progress.resize(m_jobs.size());
+        for (size_t i = 0; i < m_jobs.size(); i++) {
+            m_progress[i].size = m_jobs[i].size;
+        }
+    }
+
+    // runs the jobs on up to max_threads, the calling thread being one of them.
+    // returns the first error once every thread has exited.
+    Result Run(u32 max_threads, int prio, int cpuid) {
+        const auto thread_count = std::max<u32>(std::min<u32>(max_threads, m_jobs.size()), 1) - 1;
+        std::vector<Thread> threads(thread_count);
+        u32 started{};
+
+        ON_SCOPE_EXIT(
+            for (u32 i = 0; i < started; i++) {
+                threadWaitForExit(std::addressof(threads[i]));
+                threadClose(std::addressof(threads[i]));
+            }
+        );
+
+        for (auto& thread : threads) {
+            Result rc;
+            if (R_FAILED(rc = threadCreate(std::addressof(thread), ThreadFunc, this, nullptr, 1024*128, prio, cpuid))) {
+                SetResult(rc);
+                break;
+            }
+
+            if (R_FAILED(rc = threadStart(std::addressof(thread)))) {
+                threadClose(std::addressof(thread));
+                SetResult(rc);
+                break;
+            }
+
+            started++;
+        }
+
+        log_write("[SCHEDULER] running %zu jobs on %u threads\n", m_jobs.size(), started + 1);
+        ThreadFunc(this);
+
+        for (u32 i = 0; i < started; i++) {
+            threadWaitForExit(std::addressof(threads[i]));
+        }
+
+        return GetResult();
+    }
+
+    void SetResult(Result rc) {
+        SCOPED_MUTEX(std::addressof(m_mutex));
+
+        // only keep the first error.
+        if (R_SUCCEEDED(m_result.load())) {
+            m_result = rc;
+        }
+    }
+
+    auto GetResult() const -> Result {
+        return m_result;
+    }
+
+    void UpdateProgress(const T& job, s64 offset, s64 size) {
+        s64 total_offset{};
+        s64 total_size{};
+
+        mutexLock(std::addressof(m_mutex));
+        auto& entry = m_progress[std::addressof(job) - m_jobs.data()];
+        entry.offset = offset;
+        entry.size = size;
+
+        for (const auto& e : m_progress) {
+            total_offset += e.offset;
+            total_size += e.size;
+        }
+        mutexUnlock(std::addressof(m_mutex));
+
+        m_progress_func(total_offset, total_size);
+    }
+
+private:
+    struct Progress {
+        s64 offset{};
+        s64 size{};
+    };
+
+    // returns the next job, or nullptr if there are none left or a job failed.
+    auto Pop() -> T* {
+        SCOPED_MUTEX(std::addressof(m_mutex));
+
+        if (R_FAILED(GetResult()) || m_index >= m_jobs.size()) {
+            return nullptr;
+        }
+
+        return std::addressof(m_jobs[m_index++]);
+    }
+
+    static void ThreadFunc(void* d) {
+        auto s = static_cast<Scheduler*>(d);
+        s->SetResult([s]() -> Result {
+            while (auto job = s->Pop()) {
+                R_TRY(s->m_job_func(*job));
+            }
+            R_SUCCEED();
+        }());
+    }
+
+private:
+    const std::span<T> m_jobs;
+    const JobFunc m_job_func;
+    const ProgressFunc m_progress_func;
+
+    Mutex m_mutex{};
+    std::vector<Progress> m_progress{};
+    size_t m_index{};
+    std::atomic<Result> m_result{};
+};
+
+} // namespace sphaira::yati
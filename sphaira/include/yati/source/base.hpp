@@ -14,10 +14,20 @@ struct Base {
         return false;
     }
 
+    // returns true if Read() can be called from multiple threads at once.
+    virtual bool IsThreadSafe() const {
+        return false;
+    }
+
     virtual void SignalCancel() {
 
     }
 
+    // data before end is known to be within the file, allowing the source to read ahead.
+    virtual void SetReadAheadLimit(s64 end) {
+
+    }
+
     Result GetOpenResult() const {
         return m_open_result;
     }
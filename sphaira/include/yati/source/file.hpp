@@ -11,6 +11,11 @@ struct File final : Base {
     File(fs::Fs* fs, const fs::FsPath& path);
     Result Read(void* buf, s64 off, s64 size, u64* bytes_read) override;
 
+    // stdio files share a single seek offset, native files do not.
+    bool IsThreadSafe() const override {
+        return m_fs->IsNative();
+    }
+
 private:
     fs::Fs* m_fs{};
     fs::File m_file{};
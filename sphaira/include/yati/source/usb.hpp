@@ -5,8 +5,10 @@
 #include "usb/usbds.hpp"
 
 #include <string>
+#include <vector>
 #include <memory>
 #include <switch.h>
+#include <zstd.h>
 
 namespace sphaira::yati::source {
 
@@ -29,14 +31,27 @@ struct Usb final : Base {
         m_usb->Cancel();
     }
 
+    void SetReadAheadLimit(s64 end) override;
+
 private:
     Result SendCmdHeader(u32 cmdId, size_t dataSize, u64 timeout);
-    Result SendFileRangeCmd(u64 offset, u64 size, u64 timeout);
+    Result SendFileRangeCmd(u32 cmdId, u64 offset, u64 size, u64 timeout);
+    Result ReadRange(void* buf, s64 off, s64 size);
+    Result ReadRangeZstd(void* buf, s64 off, s64 size);
 
 private:
     std::unique_ptr<usb::UsbDs> m_usb;
     std::string m_transfer_file_name{};
     u8 m_flags{};
+
+    // data read past the end of the last request.
+    std::vector<u8> m_window{};
+    s64 m_window_off{};
+    s64 m_read_ahead_limit{};
+
+    // used if the host accepts compressed ranges.
+    ZSTD_DCtx* m_dctx{};
+    std::vector<u8> m_zstd_buf{};
 };
 
 } // namespace sphaira::yati::source
@@ -63,6 +63,16 @@ struct Config {
     // if mkey is higher than fw version, the game still won't launch
     // as the fw won't have the key to decrypt keak.
     bool lower_system_version{};
+
+    // keeps the placeholders of a failed install and checkpoints their progress,
+    // so that retrying the install continues from where it stopped.
+    bool resume_install{};
+
+    // verifies the HierarchicalSha256 / IVFC hash tree of each nca section.
+    bool verify_hash_tree{};
+
+    // verifies the nca's without installing them.
+    bool verify_only{};
 };
 
 // overridable options, set to avoid
@@ -76,6 +86,8 @@ struct ConfigOverride {
     std::optional<bool> convert_to_standard_crypto{};
     std::optional<bool> lower_master_key{};
     std::optional<bool> lower_system_version{};
+    std::optional<bool> verify_hash_tree{};
+    std::optional<bool> verify_only{};
 };
 
 Result InstallFromFile(ui::ProgressBox* pbox, fs::Fs* fs, const fs::FsPath& path, const ConfigOverride& override = {});
@@ -83,4 +95,7 @@ Result InstallFromSource(ui::ProgressBox* pbox, source::Base* source, const fs::
 Result InstallFromContainer(ui::ProgressBox* pbox, container::Base* container, const ConfigOverride& override = {});
 Result InstallFromCollections(ui::ProgressBox* pbox, source::Base* source, const container::Collections& collections, const ConfigOverride& override = {});
 
+// deletes the placeholders kept for resuming a failed install, and the journal.
+Result ClearInstallJournal();
+
 } // namespace sphaira::yati
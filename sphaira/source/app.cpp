@@ -21,6 +21,7 @@
 #include "ftpsrv_helper.hpp"
 #include "haze_helper.hpp"
 #include "web.hpp"
+#include "yati/yati.hpp"
 #include "swkbd.hpp"
 
 #include <nanovg_dk.h>
@@ -1354,6 +1355,8 @@ App::App(const char* argv0) {
             else if (app->m_convert_to_standard_crypto.LoadFrom(Key, Value)) {}
             else if (app->m_lower_master_key.LoadFrom(Key, Value)) {}
             else if (app->m_lower_system_version.LoadFrom(Key, Value)) {}
+            else if (app->m_resume_install.LoadFrom(Key, Value)) {}
+            else if (app->m_verify_hash_tree.LoadFrom(Key, Value)) {}
         } else if (!std::strcmp(Section, "accessibility")) {
             if (app->m_text_scroll_speed.LoadFrom(Key, Value)) {}
         }
@@ -1888,6 +1891,22 @@ void App::DisplayInstallOptions(bool left_side) {
         "Sets the system_firmware field in the cnmt extended header to 0. "\
         "Note: if the master key is higher than fw version, the game still won't launch as the fw won't have the key to decrypt keak (see above).\n\n"\
         "It is recommended to keep this disabled."_i18n);
+
+    options->Add<ui::SidebarEntryBool>("Resume install"_i18n, App::GetApp()->m_resume_install,
+        "If an install fails part way through, the installed data is kept and the install continues from where it stopped when retried.\n\n"\
+        "Only the most recent install can be resumed. NCZ and streamed installs (MTP, FTP) cannot be resumed."_i18n);
+
+    options->Add<ui::SidebarEntryCallback>("Clear install journal"_i18n, [](){
+        if (R_FAILED(yati::ClearInstallJournal())) {
+            App::Notify("Failed to clear install journal"_i18n);
+        } else {
+            App::Notify("Cleared install journal"_i18n);
+        }
+    }, "Deletes the data kept from a failed install, the install can no longer be resumed."_i18n);
+
+    options->Add<ui::SidebarEntryBool>("Verify hash tree"_i18n, App::GetApp()->m_verify_hash_tree,
+        "Verifies the hash of every block within each NCA section whilst installing, corrupt data is detected as soon as it is read.\n\n"\
+        "This is slower than the default NCA sha256 check."_i18n);
 }
 
 void App::DisplayDumpOptions(bool left_side) {
@@ -7,6 +7,7 @@
 #include "i18n.hpp"
 #include "location.hpp"
 #include "threaded_file_transfer.hpp"
+#include "throttle.hpp"
 
 #include "ui/sidebar.hpp"
 #include "ui/error_box.hpp"
@@ -103,8 +104,6 @@ private:
 #endif
 
 Result DumpToFile(ui::ProgressBox* pbox, fs::Fs* fs, const fs::FsPath& root, BaseSource* source, std::span<const fs::FsPath> paths) {
-    const auto is_file_based_emummc = App::IsFileBaseEmummc();
-
     for (const auto& path : paths) {
         const auto base_path = fs::AppendPath(root, path);
         const auto file_size = source->GetSize(path);
@@ -122,17 +121,16 @@ Result DumpToFile(ui::ProgressBox* pbox, fs::Fs* fs, const fs::FsPath& root, Bas
         {
             fs::File file;
             R_TRY(fs->OpenFile(temp_path, FsOpenMode_Write, &file));
+            throttle::Emummc throttle{};
 
             R_TRY(thread::Transfer(pbox, file_size,
                 [&](void* data, s64 off, s64 size, u64* bytes_read) -> Result {
                     return source->Read(path, data, off, size, bytes_read);
                 },
                 [&](const void* data, s64 off, s64 size) -> Result {
-                    const auto rc = file.Write(off, data, size, FsWriteOption_None);
-                    if (is_file_based_emummc) {
-                        svcSleepThread(2e+6); // 2ms
-                    }
-                    return rc;
+                    return throttle.Run(size, [&]{
+                        return file.Write(off, data, size, FsWriteOption_None);
+                    });
                 }
             ));
         }
@@ -309,7 +307,7 @@ Result DumpToNetwork(ui::ProgressBox* pbox, const location::Entry& loc, BaseSour
 
                 R_UNLESS(result.success, Result_DumpFailedNetworkUpload);
                 R_SUCCEED();
-            }
+            }, thread::Mode::SingleThreadedIfSmaller
         ));
     }
 
@@ -1,20 +1,328 @@
 #include "hasher.hpp"
 #include "app.hpp"
 #include "threaded_file_transfer.hpp"
+#include "throttle.hpp"
+#include "io_queue.hpp"
 #include <mbedtls/md5.h>
 #include <utility>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include <bit>
 
 namespace sphaira::hash {
 namespace {
 
+// number of reads kept in flight when hashing a native file.
+constexpr u32 HASH_IO_DEPTH = 4;
+constexpr u32 HASH_IO_THREADS = 2;
+constexpr u64 HASH_IO_SIZE = 1024*1024;
+
+// blake3 chunks are hashed on the calling thread and this many worker threads.
+constexpr u32 BLAKE3_THREADS = 2;
+// updates with fewer chunks than this are hashed on the calling thread.
+constexpr u64 BLAKE3_PARALLEL_MIN_CHUNKS = 64;
+
 consteval auto CalculateHashStrLen(s64 buf_size) {
     return buf_size * 2 + 1;
 }
 
+namespace blake3 {
+
+constexpr u32 BLOCK_LEN = 64;
+constexpr u32 CHUNK_LEN = 1024;
+constexpr u32 OUT_LEN = 32;
+constexpr u32 CHUNK_START = 1 << 0;
+constexpr u32 CHUNK_END = 1 << 1;
+constexpr u32 PARENT = 1 << 2;
+constexpr u32 ROOT = 1 << 3;
+
+constexpr u32 IV[8]{
+    0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19,
+};
+
+constexpr u8 MSG_SCHEDULE[7][16]{
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8},
+    {3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1},
+    {10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6},
+    {12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4},
+    {9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7},
+    {11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13},
+};
+
+struct Cv {
+    u32 words[8];
+};
+
+void G(u32* s, u32 a, u32 b, u32 c, u32 d, u32 x, u32 y) {
+    s[a] = s[a] + s[b] + x;
+    s[d] = std::rotr(s[d] ^ s[a], 16);
+    s[c] = s[c] + s[d];
+    s[b] = std::rotr(s[b] ^ s[c], 12);
+    s[a] = s[a] + s[b] + y;
+    s[d] = std::rotr(s[d] ^ s[a], 8);
+    s[c] = s[c] + s[d];
+    s[b] = std::rotr(s[b] ^ s[c], 7);
+}
+
+// block must be BLOCK_LEN bytes, zero padded.
+void Compress(const Cv& cv, const u8* block, u64 counter, u32 block_len, u32 flags, u32 out[16]) {
+    u32 m[16];
+    std::memcpy(m, block, sizeof(m));
+
+    u32 s[16]{
+        cv.words[0], cv.words[1], cv.words[2], cv.words[3],
+        cv.words[4], cv.words[5], cv.words[6], cv.words[7],
+        IV[0], IV[1], IV[2], IV[3],
+        u32(counter), u32(counter >> 32), block_len, flags,
+    };
+
+    for (const auto& schedule : MSG_SCHEDULE) {
+        G(s, 0, 4, 8, 12, m[schedule[0]], m[schedule[1]]);
+        G(s, 1, 5, 9, 13, m[schedule[2]], m[schedule[3]]);
+        G(s, 2, 6, 10, 14, m[schedule[4]], m[schedule[5]]);
+        G(s, 3, 7, 11, 15, m[schedule[6]], m[schedule[7]]);
+        G(s, 0, 5, 10, 15, m[schedule[8]], m[schedule[9]]);
+        G(s, 1, 6, 11, 12, m[schedule[10]], m[schedule[11]]);
+        G(s, 2, 7, 8, 13, m[schedule[12]], m[schedule[13]]);
+        G(s, 3, 4, 9, 14, m[schedule[14]], m[schedule[15]]);
+    }
+
+    for (u32 i = 0; i < 8; i++) {
+        out[i] = s[i] ^ s[i + 8];
+        out[i + 8] = s[i + 8] ^ cv.words[i];
+    }
+}
+
+auto CompressCv(const Cv& cv, const u8* block, u64 counter, u32 block_len, u32 flags) -> Cv {
+    u32 out[16];
+    Compress(cv, block, counter, block_len, flags, out);
+
+    Cv result;
+    std::memcpy(result.words, out, sizeof(result.words));
+    return result;
+}
+
+// the final block of a chunk or parent, which is compressed once it's known
+// whether it's the root or not.
+struct Output {
+    Cv cv;
+    u8 block[BLOCK_LEN];
+    u64 counter;
+    u32 block_len;
+    u32 flags;
+
+    auto ChainingValue() const -> Cv {
+        return CompressCv(cv, block, counter, block_len, flags);
+    }
+
+    void RootBytes(u8 out[OUT_LEN]) const {
+        u32 words[16];
+        Compress(cv, block, 0, block_len, flags | ROOT, words);
+        std::memcpy(out, words, OUT_LEN);
+    }
+};
+
+auto ParentOutput(const Cv& left, const Cv& right) -> Output {
+    Output out{};
+    out.cv = Cv{{IV[0], IV[1], IV[2], IV[3], IV[4], IV[5], IV[6], IV[7]}};
+    std::memcpy(out.block, left.words, sizeof(left.words));
+    std::memcpy(out.block + sizeof(left.words), right.words, sizeof(right.words));
+    out.block_len = BLOCK_LEN;
+    out.flags = PARENT;
+    return out;
+}
+
+struct ChunkState {
+    explicit ChunkState(u64 counter = 0) : chunk_counter{counter} {
+        std::memcpy(cv.words, IV, sizeof(cv.words));
+    }
+
+    auto Len() const -> u32 {
+        return blocks_compressed * BLOCK_LEN + block_len;
+    }
+
+    void Update(const u8* data, u32 size) {
+        while (size) {
+            // the last block is only compressed once more data arrives, as it may be the end.
+            if (block_len == BLOCK_LEN) {
+                cv = CompressCv(cv, block, chunk_counter, BLOCK_LEN, StartFlag());
+                blocks_compressed++;
+                block_len = 0;
+                std::memset(block, 0, sizeof(block));
+            }
+
+            const auto take = std::min(BLOCK_LEN - block_len, size);
+            std::memcpy(block + block_len, data, take);
+            block_len += take;
+            data += take;
+            size -= take;
+        }
+    }
+
+    auto GetOutput() const -> Output {
+        Output out{};
+        out.cv = cv;
+        std::memcpy(out.block, block, sizeof(block));
+        out.counter = chunk_counter;
+        out.block_len = block_len;
+        out.flags = StartFlag() | CHUNK_END;
+        return out;
+    }
+
+private:
+    auto StartFlag() const -> u32 {
+        return blocks_compressed ? 0 : CHUNK_START;
+    }
+
+private:
+    Cv cv{};
+    u64 chunk_counter{};
+    u8 block[BLOCK_LEN]{};
+    u32 block_len{};
+    u32 blocks_compressed{};
+};
+
+// chaining value of a full chunk.
+auto ChunkCv(const u8* data, u64 counter) -> Cv {
+    ChunkState chunk{counter};
+    chunk.Update(data, CHUNK_LEN);
+    return chunk.GetOutput().ChainingValue();
+}
+
+// merges the completed subtrees, total_chunks includes the new chunk.
+void PushChunkCv(std::vector<Cv>& stack, Cv cv, u64 total_chunks) {
+    while (!(total_chunks & 1)) {
+        cv = ParentOutput(stack.back(), cv).ChainingValue();
+        stack.pop_back();
+        total_chunks >>= 1;
+    }
+    stack.emplace_back(cv);
+}
+
+} // namespace blake3
+
+namespace xxh64 {
+
+constexpr u64 PRIME1 = 0x9E3779B185EBCA87ULL;
+constexpr u64 PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr u64 PRIME3 = 0x165667B19E3779F9ULL;
+constexpr u64 PRIME4 = 0x85EBCA77C2B2AE63ULL;
+constexpr u64 PRIME5 = 0x27D4EB2F165667C5ULL;
+
+auto Read64(const u8* p) -> u64 {
+    u64 v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+auto Read32(const u8* p) -> u32 {
+    u32 v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+auto Round(u64 acc, u64 input) -> u64 {
+    acc += input * PRIME2;
+    acc = std::rotl(acc, 31);
+    return acc * PRIME1;
+}
+
+auto MergeRound(u64 acc, u64 val) -> u64 {
+    acc ^= Round(0, val);
+    return acc * PRIME1 + PRIME4;
+}
+
+struct State {
+    void Update(const u8* data, u64 size) {
+        total_len += size;
+
+        if (mem_size + size < sizeof(mem)) {
+            std::memcpy(mem + mem_size, data, size);
+            mem_size += size;
+            return;
+        }
+
+        if (mem_size) {
+            const auto take = sizeof(mem) - mem_size;
+            std::memcpy(mem + mem_size, data, take);
+            Stripe(mem);
+            data += take;
+            size -= take;
+            mem_size = 0;
+        }
+
+        for (; size >= sizeof(mem); data += sizeof(mem), size -= sizeof(mem)) {
+            Stripe(data);
+        }
+
+        std::memcpy(mem, data, size);
+        mem_size = size;
+    }
+
+    auto Digest() const -> u64 {
+        u64 h;
+        if (total_len >= sizeof(mem)) {
+            h = std::rotl(v[0], 1) + std::rotl(v[1], 7) + std::rotl(v[2], 12) + std::rotl(v[3], 18);
+            for (auto e : v) {
+                h = MergeRound(h, e);
+            }
+        } else {
+            h = PRIME5;
+        }
+
+        h += total_len;
+
+        const u8* p = mem;
+        auto size = mem_size;
+        for (; size >= 8; p += 8, size -= 8) {
+            h ^= Round(0, Read64(p));
+            h = std::rotl(h, 27) * PRIME1 + PRIME4;
+        }
+
+        if (size >= 4) {
+            h ^= u64(Read32(p)) * PRIME1;
+            h = std::rotl(h, 23) * PRIME2 + PRIME3;
+            p += 4;
+            size -= 4;
+        }
+
+        for (; size; p++, size--) {
+            h ^= (*p) * PRIME5;
+            h = std::rotl(h, 11) * PRIME1;
+        }
+
+        h ^= h >> 33;
+        h *= PRIME2;
+        h ^= h >> 29;
+        h *= PRIME3;
+        h ^= h >> 32;
+        return h;
+    }
+
+private:
+    void Stripe(const u8* p) {
+        for (u32 i = 0; i < 4; i++) {
+            v[i] = Round(v[i], Read64(p + i * 8));
+        }
+    }
+
+private:
+    // seed of 0.
+    u64 v[4]{PRIME1 + PRIME2, PRIME2, 0, 0 - PRIME1};
+    u8 mem[32]{};
+    u64 mem_size{};
+    u64 total_len{};
+};
+
+} // namespace xxh64
+
 struct FileSource final : BaseSource {
     FileSource(fs::Fs* fs, const fs::FsPath& path) : m_fs{fs} {
         m_open_result = m_fs->OpenFile(path, FsOpenMode_Read, std::addressof(m_file));
-        m_is_file_based_emummc = App::IsFileBaseEmummc();
+        m_throttle = throttle::Emummc{m_fs->IsNative() && App::IsFileBaseEmummc()};
     }
 
     Result Size(s64* out) override {
@@ -22,18 +330,16 @@ struct FileSource final : BaseSource {
     }
 
     Result Read(void* buf, s64 off, s64 size, u64* bytes_read) override {
-        const auto rc = m_file.Read(off, buf, size, 0, bytes_read);
-        if (m_fs->IsNative() && m_is_file_based_emummc) {
-            svcSleepThread(2e+6); // 2ms
-        }
-        return rc;
+        return m_throttle.Run(size, [&]{
+            return m_file.Read(off, buf, size, 0, bytes_read);
+        });
     }
 
 private:
     fs::Fs* m_fs{};
     fs::File m_file{};
     Result m_open_result{};
-    bool m_is_file_based_emummc{};
+    throttle::Emummc m_throttle{false};
 };
 
 struct MemSource final : BaseSource {
@@ -61,6 +367,8 @@ struct HashSource {
     virtual void Get(std::string& out) = 0;
 };
 
+// crc32, sha1 and sha256 use the libnx implementations, which are built with
+// the armv8 crc32 and sha instructions. md5 has no hardware support.
 struct HashCrc32 final : HashSource {
     void Update(const void* buf, s64 size) override {
         m_seed = crc32CalculateWithSeed(m_seed, buf, size);
@@ -156,7 +464,22 @@ private:
     Sha256Context m_ctx{};
 };
 
-Result Hash(ui::ProgressBox* pbox, std::unique_ptr<HashSource> hash, BaseSource* source, std::string& out) {
+struct HashXxh64 final : HashSource {
+    void Update(const void* buf, s64 size) override {
+        m_state.Update(static_cast<const u8*>(buf), size);
+    }
+
+    void Get(std::string& out) override {
+        char str[CalculateHashStrLen(sizeof(u64))];
+        std::snprintf(str, sizeof(str), "%016lx", m_state.Digest());
+        out = str;
+    }
+
+private:
+    xxh64::State m_state{};
+};
+
+Result Hash(ui::ProgressBox* pbox, HashSource* hash, BaseSource* source) {
     s64 file_size;
     R_TRY(source->Size(&file_size));
 
@@ -170,10 +493,566 @@ Result Hash(ui::ProgressBox* pbox, std::unique_ptr<HashSource> hash, BaseSource*
         }
     ));
 
-    hash->Get(out);
     R_SUCCEED();
 }
 
+// reads are submitted to the io queue whilst the previous reads are being hashed.
+Result HashAsync(ui::ProgressBox* pbox, HashSource* hash, fs::Fs* fs, const fs::FsPath& path) {
+    fs::File f;
+    R_TRY(fs->OpenFile(path, FsOpenMode_Read, &f));
+
+    s64 file_size;
+    R_TRY(f.GetSize(&file_size));
+
+    // buffers are used in submission order, which is the same order they are reaped.
+    // the extra buffer is the one being hashed, so a read is never submitted into it.
+    constexpr u32 BUF_COUNT = HASH_IO_DEPTH + 1;
+    std::vector<u8> bufs[BUF_COUNT];
+    fs::IoQueue queue{HASH_IO_DEPTH, HASH_IO_THREADS};
+    R_TRY(queue.Create());
+
+    s64 submit_off{};
+    u32 buf_index{};
+    const auto submit = [&]() -> Result {
+        while (submit_off < file_size && queue.GetInFlight() < HASH_IO_DEPTH) {
+            auto& buf = bufs[buf_index];
+            const auto size = std::min<s64>(HASH_IO_SIZE, file_size - submit_off);
+            buf.resize(size);
+
+            R_TRY(queue.Submit({ .file = &f, .type = fs::IoType::Read, .off = submit_off, .buf = buf.data(), .size = u64(size), .user_data = buf_index }));
+            submit_off += size;
+            buf_index = (buf_index + 1) % BUF_COUNT;
+        }
+
+        R_SUCCEED();
+    };
+
+    s64 hash_off{};
+    fs::IoCompletion completion;
+    R_TRY(submit());
+
+    while (queue.Reap(completion)) {
+        R_TRY(pbox->ShouldExitResult());
+        R_TRY(completion.rc);
+
+        const auto& buf = bufs[completion.user_data];
+        R_UNLESS(completion.bytes == buf.size(), Result_FsFileTruncated);
+
+        // submit the next read before hashing so that the queue is kept full.
+        R_TRY(submit());
+        hash->Update(buf.data(), buf.size());
+
+        hash_off += buf.size();
+        pbox->UpdateTransfer(hash_off, file_size);
+    }
+
+    R_SUCCEED();
+}
+
+Result Hash(ui::ProgressBox* pbox, HashSource* hash, fs::Fs* fs, const fs::FsPath& path) {
+    // file based emummc is throttled, so only a single read is done at a time.
+    if (fs->IsNative() && !App::IsFileBaseEmummc()) {
+        return HashAsync(pbox, hash, fs, path);
+    }
+
+    auto source = std::make_unique<FileSource>(fs, path);
+    return Hash(pbox, hash, source.get());
+}
+
+// runs a job on the calling thread and on each worker thread at once.
+// the workers run on cores other than the core of the thread that created the pool.
+struct WorkerPool {
+    // index is the thread running the job, count is the number of threads.
+    using Job = std::function<void(u32 index, u32 count)>;
+
+    WorkerPool(int cpu_id, u32 thread_count) : m_cpu_id{cpu_id}, m_max_threads{std::min<u32>(thread_count, std::size(m_threads))} {
+        mutexInit(std::addressof(m_mutex));
+        condvarInit(std::addressof(m_can_work));
+        condvarInit(std::addressof(m_work_done));
+    }
+
+    ~WorkerPool() {
+        mutexLock(std::addressof(m_mutex));
+        m_quit = true;
+        condvarWakeAll(std::addressof(m_can_work));
+        mutexUnlock(std::addressof(m_mutex));
+
+        for (u32 i = 0; i < m_thread_count; i++) {
+            threadWaitForExit(std::addressof(m_threads[i]));
+            threadClose(std::addressof(m_threads[i]));
+        }
+    }
+
+    // if a thread fails to be created, the job is split between fewer threads.
+    void Create() {
+        for (u32 i = 0; i < m_max_threads; i++) {
+            auto& args = m_thread_args[i];
+            args.self = this;
+            args.index = i + 1;
+
+            const auto core = (m_cpu_id + 1 + i) % 3;
+            if (R_FAILED(threadCreate(std::addressof(m_threads[i]), ThreadFunc, std::addressof(args), nullptr, 1024*32, PRIO_PREEMPTIVE, core))) {
+                break;
+            }
+
+            if (R_FAILED(threadStart(std::addressof(m_threads[i])))) {
+                threadClose(std::addressof(m_threads[i]));
+                break;
+            }
+
+            m_thread_count++;
+        }
+    }
+
+    // returns once every thread has finished the job.
+    void Run(const Job& job) {
+        mutexLock(std::addressof(m_mutex));
+        m_job = std::addressof(job);
+        m_pending = m_thread_count;
+        m_generation++;
+        condvarWakeAll(std::addressof(m_can_work));
+        mutexUnlock(std::addressof(m_mutex));
+
+        job(0, GetCount());
+
+        SCOPED_MUTEX(std::addressof(m_mutex));
+        while (m_pending) {
+            condvarWait(std::addressof(m_work_done), std::addressof(m_mutex));
+        }
+    }
+
+    auto GetCount() const -> u32 {
+        return m_thread_count + 1;
+    }
+
+private:
+    struct ThreadArgs {
+        WorkerPool* self{};
+        u32 index{};
+    };
+
+    static void ThreadFunc(void* arg) {
+        auto args = static_cast<ThreadArgs*>(arg);
+        args->self->Worker(args->index);
+    }
+
+    void Worker(u32 index) {
+        u64 generation{};
+
+        mutexLock(std::addressof(m_mutex));
+        ON_SCOPE_EXIT(mutexUnlock(std::addressof(m_mutex)));
+
+        for (;;) {
+            while (!m_quit && generation == m_generation) {
+                condvarWait(std::addressof(m_can_work), std::addressof(m_mutex));
+            }
+
+            if (m_quit) {
+                break;
+            }
+
+            generation = m_generation;
+            const auto job = m_job;
+
+            mutexUnlock(std::addressof(m_mutex));
+            (*job)(index, GetCount());
+            mutexLock(std::addressof(m_mutex));
+
+            if (!--m_pending) {
+                condvarWakeOne(std::addressof(m_work_done));
+            }
+        }
+    }
+
+private:
+    const int m_cpu_id;
+    const u32 m_max_threads;
+
+    Mutex m_mutex{};
+    CondVar m_can_work{};
+    CondVar m_work_done{};
+
+    Thread m_threads[3]{};
+    ThreadArgs m_thread_args[3]{};
+    u32 m_thread_count{};
+
+    const Job* m_job{};
+    u32 m_pending{};
+    u64 m_generation{};
+    bool m_quit{};
+};
+
+// chunks are hashed in parallel, the tree is then merged on the calling thread.
+struct HashBlake3 final : HashSource {
+    HashBlake3() : m_pool{int(svcGetCurrentProcessorNumber()), BLAKE3_THREADS} {
+        m_pool.Create();
+    }
+
+    void Update(const void* buf, s64 size) override {
+        using namespace blake3;
+        auto data = static_cast<const u8*>(buf);
+
+        while (size) {
+            // a full chunk is only finalised once more data arrives, as the last chunk may be the root.
+            if (m_chunk.Len() == CHUNK_LEN) {
+                PushChunkCv(m_stack, m_chunk.GetOutput().ChainingValue(), m_chunk_counter + 1);
+                m_chunk = ChunkState{++m_chunk_counter};
+            }
+
+            // hash the whole chunks in parallel, keeping the last chunk in the chunk state.
+            if (!m_chunk.Len() && size > CHUNK_LEN) {
+                const u64 count = (size - 1) / CHUNK_LEN;
+                m_cvs.resize(count);
+
+                const auto hash_chunks = [&](u32 index, u32 thread_count) {
+                    const auto start = count * index / thread_count;
+                    const auto end = count * (index + 1) / thread_count;
+                    for (auto i = start; i < end; i++) {
+                        m_cvs[i] = ChunkCv(data + i * CHUNK_LEN, m_chunk_counter + i);
+                    }
+                };
+
+                if (count >= BLAKE3_PARALLEL_MIN_CHUNKS) {
+                    m_pool.Run(hash_chunks);
+                } else {
+                    hash_chunks(0, 1);
+                }
+
+                for (u64 i = 0; i < count; i++) {
+                    PushChunkCv(m_stack, m_cvs[i], m_chunk_counter + i + 1);
+                }
+
+                m_chunk_counter += count;
+                m_chunk = ChunkState{m_chunk_counter};
+                data += count * CHUNK_LEN;
+                size -= count * CHUNK_LEN;
+                continue;
+            }
+
+            const auto take = std::min<s64>(CHUNK_LEN - m_chunk.Len(), size);
+            m_chunk.Update(data, take);
+            data += take;
+            size -= take;
+        }
+    }
+
+    void Get(std::string& out) override {
+        using namespace blake3;
+
+        auto output = m_chunk.GetOutput();
+        for (auto it = m_stack.rbegin(); it != m_stack.rend(); it++) {
+            output = ParentOutput(*it, output.ChainingValue());
+        }
+
+        u8 hash[OUT_LEN];
+        output.RootBytes(hash);
+
+        char str[CalculateHashStrLen(sizeof(hash))];
+        for (u32 i = 0; i < sizeof(hash); i++) {
+            std::sprintf(str + i * 2, "%02x", hash[i]);
+        }
+
+        out = str;
+    }
+
+private:
+    WorkerPool m_pool;
+    blake3::ChunkState m_chunk{};
+    u64 m_chunk_counter{};
+    std::vector<blake3::Cv> m_stack{};
+    std::vector<blake3::Cv> m_cvs{};
+};
+
+auto CreateHashSource(Type type) -> std::unique_ptr<HashSource> {
+    switch (type) {
+        case Type::Crc32: return std::make_unique<HashCrc32>();
+        case Type::Md5: return std::make_unique<HashMd5>();
+        case Type::Sha1: return std::make_unique<HashSha1>();
+        case Type::Sha256: return std::make_unique<HashSha256>();
+        case Type::Xxh64: return std::make_unique<HashXxh64>();
+        case Type::Blake3: return std::make_unique<HashBlake3>();
+    }
+    std::unreachable();
+}
+
+// updates several hashes with the same data in a single pass.
+// the first hash is updated on the calling thread, the rest each have their
+// own thread so that the hashes run in parallel on different cores.
+struct HashMulti final : HashSource {
+    HashMulti(std::span<const Type> types, int cpu_id) : m_pool{cpu_id, u32(types.size() - 1)} {
+        for (auto type : types) {
+            m_hashes.emplace_back(CreateHashSource(type));
+        }
+    }
+
+    void Create() {
+        m_pool.Create();
+    }
+
+    void Update(const void* buf, s64 size) override {
+        // the buffer must not be changed until every thread has finished with it.
+        m_pool.Run([&](u32 index, u32 count) {
+            for (u32 i = index; i < m_hashes.size(); i += count) {
+                m_hashes[i]->Update(buf, size);
+            }
+        });
+    }
+
+    // new line separated list of each hash.
+    void Get(std::string& out) override {
+        std::vector<std::string> hashes;
+        GetAll(hashes);
+
+        out.clear();
+        for (const auto& e : hashes) {
+            out += e + "\n";
+        }
+    }
+
+    void GetAll(std::vector<std::string>& out) {
+        out.resize(m_hashes.size());
+        for (u32 i = 0; i < m_hashes.size(); i++) {
+            m_hashes[i]->Get(out[i]);
+        }
+    }
+
+private:
+    WorkerPool m_pool;
+    std::vector<std::unique_ptr<HashSource>> m_hashes{};
+};
+
+// persistent cache of hashes, keyed by the device, path, size and modified timestamp of the file.
+// the file is a fixed size table, the path is hashed to find the entry, so a lookup
+// only reads a few entries rather than the whole cache.
+constexpr fs::FsPath CACHE_PATH{"/config/sphaira/hash_cache.bin"};
+constexpr u32 CACHE_MAGIC = 0x48534843; // CHSH
+constexpr u32 CACHE_VERSION = 3;
+// older entries are replaced once the probed entries are full.
+constexpr u32 CACHE_ENTRY_COUNT = 1024*4;
+// number of entries checked from the hashed index.
+constexpr u32 CACHE_PROBE_COUNT = 8;
+constexpr u32 CACHE_DIGEST_MAX = SHA256_HASH_SIZE;
+
+struct CacheHeader {
+    u32 magic;
+    u32 version;
+    u32 count;
+    u32 padding;
+};
+
+struct CacheEntry {
+    // hash of the device and path, 0 if the entry is empty.
+    u64 key;
+    s64 size;
+    u64 modified;
+    // bitmask of the types that are set.
+    u32 types;
+    u32 padding;
+    u8 digests[6][CACHE_DIGEST_MAX];
+};
+
+// digests are indexed by the type.
+static_assert(u32(Type::Blake3) < std::size(CacheEntry{}.digests));
+
+Mutex g_cache_mutex{};
+
+// the same path may exist on several devices, so the device is part of the key.
+auto GetCacheKey(const fs::Fs* fs, const fs::FsPath& path) -> u64 {
+    const auto device = fs->Device();
+
+    Sha256Context ctx;
+    sha256ContextCreate(&ctx);
+    sha256ContextUpdate(&ctx, device.s, std::strlen(device.s) + 1);
+    sha256ContextUpdate(&ctx, path.s, std::strlen(path.s));
+
+    u8 hash[SHA256_HASH_SIZE];
+    sha256ContextGetHash(&ctx, hash);
+
+    u64 key;
+    std::memcpy(&key, hash, sizeof(key));
+    return key ? key : 1;
+}
+
+auto GetCacheEntryOffset(u32 index) -> s64 {
+    return sizeof(CacheHeader) + s64(index) * sizeof(CacheEntry);
+}
+
+// opens the cache, creating it if it doesn't exist or is invalid.
+Result OpenCache(fs::FsNativeSd& fs, fs::File& f) {
+    if (R_SUCCEEDED(fs.OpenFile(CACHE_PATH, FsOpenMode_Read|FsOpenMode_Write, &f))) {
+        CacheHeader header{};
+        u64 bytes_read{};
+        if (R_SUCCEEDED(f.Read(0, &header, sizeof(header), 0, &bytes_read)) && bytes_read == sizeof(header) &&
+            header.magic == CACHE_MAGIC && header.version == CACHE_VERSION && header.count == CACHE_ENTRY_COUNT) {
+            R_SUCCEED();
+        }
+
+        f.Close();
+        log_write("[HASH] recreating invalid cache\n");
+    }
+
+    const CacheHeader header{CACHE_MAGIC, CACHE_VERSION, CACHE_ENTRY_COUNT};
+    std::vector<u8> data(GetCacheEntryOffset(CACHE_ENTRY_COUNT));
+    std::memcpy(data.data(), &header, sizeof(header));
+
+    fs.CreateDirectoryRecursivelyWithPath(CACHE_PATH);
+    R_TRY(fs.write_entire_file(CACHE_PATH, data));
+    return fs.OpenFile(CACHE_PATH, FsOpenMode_Read|FsOpenMode_Write, &f);
+}
+
+// reads the entries that the key can be stored in.
+Result ReadCacheEntries(fs::File& f, u64 key, u32& index_out, std::span<CacheEntry, CACHE_PROBE_COUNT> out) {
+    index_out = key % (CACHE_ENTRY_COUNT - CACHE_PROBE_COUNT + 1);
+
+    u64 bytes_read;
+    R_TRY(f.Read(GetCacheEntryOffset(index_out), out.data(), out.size_bytes(), 0, &bytes_read));
+    R_UNLESS(bytes_read == out.size_bytes(), Result_FsFileTruncated);
+    R_SUCCEED();
+}
+
+auto ToHexString(const u8* data, u32 size) -> std::string {
+    std::string out;
+    char str[3];
+    for (u32 i = 0; i < size; i++) {
+        std::snprintf(str, sizeof(str), "%02x", data[i]);
+        out += str;
+    }
+    return out;
+}
+
+auto FromHexString(const std::string& str, u8* out, u32 size) -> bool {
+    if (str.size() != size * 2) {
+        return false;
+    }
+
+    for (u32 i = 0; i < size; i++) {
+        char byte[3]{str[i * 2], str[i * 2 + 1]};
+        char* end;
+        out[i] = std::strtoul(byte, &end, 16);
+        if (end != byte + 2) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+auto GetDigestSize(Type type) -> u32 {
+    switch (type) {
+        case Type::Crc32: return sizeof(u32);
+        case Type::Md5: return 16;
+        case Type::Sha1: return SHA1_HASH_SIZE;
+        case Type::Sha256: return SHA256_HASH_SIZE;
+        case Type::Xxh64: return sizeof(u64);
+        case Type::Blake3: return blake3::OUT_LEN;
+    }
+    std::unreachable();
+}
+
+auto GetFileStamp(fs::Fs* fs, const fs::FsPath& path, s64& size, u64& modified) -> bool {
+    FsTimeStampRaw ts;
+    if (R_FAILED(fs->FileGetSizeAndTimestamp(path, &ts, &size)) || !ts.is_valid || !ts.modified) {
+        return false;
+    }
+
+    modified = ts.modified;
+    return true;
+}
+
+// returns true if every type was found in the cache and the file hasn't changed.
+auto CacheGet(fs::Fs* fs, const fs::FsPath& path, std::span<const Type> types, std::vector<std::string>& out) -> bool {
+    s64 size;
+    u64 modified;
+    if (!GetFileStamp(fs, path, size, modified)) {
+        return false;
+    }
+
+    SCOPED_MUTEX(&g_cache_mutex);
+    fs::FsNativeSd sd_fs;
+    fs::File f;
+    if (R_FAILED(sd_fs.OpenFile(CACHE_PATH, FsOpenMode_Read, &f))) {
+        return false;
+    }
+
+    const auto key = GetCacheKey(fs, path);
+    u32 index;
+    CacheEntry entries[CACHE_PROBE_COUNT];
+    if (R_FAILED(ReadCacheEntries(f, key, index, entries))) {
+        return false;
+    }
+
+    for (const auto& e : entries) {
+        if (e.key != key || e.size != size || e.modified != modified) {
+            continue;
+        }
+
+        out.clear();
+        for (auto type : types) {
+            if (!(e.types & (1U << u32(type)))) {
+                return false;
+            }
+
+            out.emplace_back(ToHexString(e.digests[u32(type)], GetDigestSize(type)));
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+void CacheSet(fs::Fs* fs, const fs::FsPath& path, std::span<const Type> types, std::span<const std::string> hashes) {
+    s64 size;
+    u64 modified;
+    if (!GetFileStamp(fs, path, size, modified) || (fs->IsNative() && path == CACHE_PATH)) {
+        return;
+    }
+
+    SCOPED_MUTEX(&g_cache_mutex);
+    fs::FsNativeSd sd_fs;
+    fs::File f;
+    if (R_FAILED(OpenCache(sd_fs, f))) {
+        return;
+    }
+
+    const auto key = GetCacheKey(fs, path);
+    u32 index;
+    CacheEntry entries[CACHE_PROBE_COUNT];
+    if (R_FAILED(ReadCacheEntries(f, key, index, entries))) {
+        return;
+    }
+
+    // use the existing entry for this path, else an empty entry, else replace one.
+    auto it = std::ranges::find_if(entries, [key](auto& e){ return e.key == key; });
+    if (it == std::end(entries)) {
+        it = std::ranges::find_if(entries, [](auto& e){ return !e.key; });
+    }
+    if (it == std::end(entries)) {
+        it = std::begin(entries) + (key >> 32) % CACHE_PROBE_COUNT;
+    }
+
+    auto& entry = *it;
+    // the file has changed, so the old hashes are no longer valid.
+    if (entry.key != key || entry.size != size || entry.modified != modified) {
+        entry = {};
+        entry.key = key;
+        entry.size = size;
+        entry.modified = modified;
+    }
+
+    for (u32 i = 0; i < types.size(); i++) {
+        const auto type = types[i];
+        if (FromHexString(hashes[i], entry.digests[u32(type)], GetDigestSize(type))) {
+            entry.types |= 1U << u32(type);
+        }
+    }
+
+    const auto rc = f.Write(GetCacheEntryOffset(index + (it - std::begin(entries))), &entry, sizeof(entry), FsWriteOption_None);
+    if (R_FAILED(rc)) {
+        log_write("[HASH] failed to write cache: 0x%X\n", rc);
+    }
+}
+
 } // namespace
 
 auto GetTypeStr(Type type) -> const char* {
@@ -182,23 +1061,24 @@ auto GetTypeStr(Type type) -> const char* {
         case Type::Md5: return "MD5";
         case Type::Sha1: return "SHA1";
         case Type::Sha256: return "SHA256";
+        case Type::Xxh64: return "XXH64";
+        case Type::Blake3: return "BLAKE3";
     }
     return "";
 }
 
 Result Hash(ui::ProgressBox* pbox, Type type, BaseSource* source, std::string& out) {
-    switch (type) {
-        case Type::Crc32: return Hash(pbox, std::make_unique<HashCrc32>(), source, out);
-        case Type::Md5: return Hash(pbox, std::make_unique<HashMd5>(), source, out);
-        case Type::Sha1: return Hash(pbox, std::make_unique<HashSha1>(), source, out);
-        case Type::Sha256: return Hash(pbox, std::make_unique<HashSha256>(), source, out);
-    }
-    std::unreachable();
+    auto hash = CreateHashSource(type);
+    R_TRY(Hash(pbox, hash.get(), source));
+    hash->Get(out);
+    R_SUCCEED();
 }
 
 Result Hash(ui::ProgressBox* pbox, Type type, fs::Fs* fs, const fs::FsPath& path, std::string& out) {
-    auto source = std::make_unique<FileSource>(fs, path);
-    return Hash(pbox, type, source.get(), out);
+    std::vector<std::string> hashes;
+    R_TRY(Hash(pbox, std::span{&type, 1}, fs, path, hashes));
+    out = hashes[0];
+    R_SUCCEED();
 }
 
 Result Hash(ui::ProgressBox* pbox, Type type, std::span<const u8> data, std::string& out) {
@@ -206,4 +1086,37 @@ Result Hash(ui::ProgressBox* pbox, Type type, std::span<const u8> data, std::str
     return Hash(pbox, type, source.get(), out);
 }
 
+Result Hash(ui::ProgressBox* pbox, std::span<const Type> types, fs::Fs* fs, const fs::FsPath& path, std::vector<std::string>& out) {
+    R_UNLESS(!types.empty(), Result_FsEmpty);
+
+    HashMulti hash{types, pbox->GetCpuId()};
+    hash.Create();
+
+    R_TRY(Hash(pbox, &hash, fs, path));
+    hash.GetAll(out);
+    R_SUCCEED();
+}
+
+Result HashCached(ui::ProgressBox* pbox, std::span<const Type> types, fs::Fs* fs, const fs::FsPath& path, std::vector<std::string>& out) {
+    R_UNLESS(!types.empty(), Result_FsEmpty);
+
+    if (CacheGet(fs, path, types, out)) {
+        log_write("[HASH] using cached hash for: %s\n", path.s);
+        R_SUCCEED();
+    }
+
+    R_TRY(Hash(pbox, types, fs, path, out));
+    CacheSet(fs, path, types, out);
+    R_SUCCEED();
+}
+
+void CacheCrc32(fs::Fs* fs, const fs::FsPath& path, u32 crc32) {
+    char str[CalculateHashStrLen(sizeof(crc32))];
+    std::snprintf(str, sizeof(str), "%08x", crc32);
+
+    const Type type = Type::Crc32;
+    const std::string hash = str;
+    CacheSet(fs, path, std::span{&type, 1}, std::span{&hash, 1});
+}
+
 } // namespace sphaira::has
@@ -0,0 +1,157 @@
+#include "io_queue.hpp"
+#include "defines.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+
+namespace fs {
+
+IoQueue::IoQueue(u32 depth, u32 thread_count)
+: m_depth{std::max(depth, 1U)}
+, m_max_threads{std::clamp(thread_count, 1U, MAX_THREADS)} {
+    mutexInit(std::addressof(m_mutex));
+    mutexInit(std::addressof(m_stdio_mutex));
+    condvarInit(std::addressof(m_can_work));
+    condvarInit(std::addressof(m_can_submit));
+    condvarInit(std::addressof(m_can_reap));
+    m_slots.resize(m_depth);
+}
+
+IoQueue::~IoQueue() {
+    mutexLock(std::addressof(m_mutex));
+    m_cancel = true;
+    m_quit = true;
+    condvarWakeAll(std::addressof(m_can_work));
+    mutexUnlock(std::addressof(m_mutex));
+
+    for (u32 i = 0; i < m_thread_count; i++) {
+        threadWaitForExit(std::addressof(m_threads[i]));
+        threadClose(std::addressof(m_threads[i]));
+    }
+}
+
+Result IoQueue::Create() {
+    // the workers spend most of their time waiting on io, so they share
+    // the cores with the rest of the app.
+    for (u32 i = 0; i < m_max_threads; i++) {
+        R_TRY(threadCreate(std::addressof(m_threads[i]), ThreadFunc, this, nullptr, 1024*32, PRIO_PREEMPTIVE, i % 3));
+
+        if (const auto rc = threadStart(std::addressof(m_threads[i])); R_FAILED(rc)) {
+            threadClose(std::addressof(m_threads[i]));
+            R_THROW(rc);
+        }
+
+        m_thread_count++;
+    }
+
+    R_SUCCEED();
+}
+
+Result IoQueue::Submit(const IoRequest& request) {
+    SCOPED_MUTEX(std::addressof(m_mutex));
+
+    while (m_submit_index - m_reap_index >= m_depth) {
+        R_TRY(condvarWait(std::addressof(m_can_submit), std::addressof(m_mutex)));
+    }
+
+    auto& slot = m_slots[m_submit_index % m_depth];
+    slot.request = request;
+    slot.completion = {};
+    slot.state = State::Pending;
+    m_submit_index++;
+
+    return condvarWakeOne(std::addressof(m_can_work));
+}
+
+auto IoQueue::Reap(IoCompletion& out) -> bool {
+    SCOPED_MUTEX(std::addressof(m_mutex));
+
+    if (m_reap_index == m_submit_index) {
+        return false;
+    }
+
+    auto& slot = m_slots[m_reap_index % m_depth];
+    while (slot.state != State::Done) {
+        condvarWait(std::addressof(m_can_reap), std::addressof(m_mutex));
+    }
+
+    out = slot.completion;
+    slot.state = State::Empty;
+    m_reap_index++;
+
+    condvarWakeOne(std::addressof(m_can_submit));
+    return true;
+}
+
+void IoQueue::Cancel() {
+    SCOPED_MUTEX(std::addressof(m_mutex));
+    m_cancel = true;
+    condvarWakeAll(std::addressof(m_can_work));
+}
+
+auto IoQueue::GetInFlight() -> u32 {
+    SCOPED_MUTEX(std::addressof(m_mutex));
+    return m_submit_index - m_reap_index;
+}
+
+void IoQueue::ThreadFunc(void* arg) {
+    static_cast<IoQueue*>(arg)->Worker();
+}
+
+void IoQueue::Worker() {
+    mutexLock(std::addressof(m_mutex));
+    ON_SCOPE_EXIT(mutexUnlock(std::addressof(m_mutex)));
+
+    for (;;) {
+        while (!m_quit && m_start_index == m_submit_index) {
+            condvarWait(std::addressof(m_can_work), std::addressof(m_mutex));
+        }
+
+        if (m_start_index == m_submit_index) {
+            break;
+        }
+
+        auto& slot = m_slots[m_start_index % m_depth];
+        m_start_index++;
+
+        if (m_cancel) {
+            slot.completion = { .user_data = slot.request.user_data, .rc = Result_TransferCancelled };
+        } else {
+            slot.state = State::Running;
+            mutexUnlock(std::addressof(m_mutex));
+            Run(slot);
+            mutexLock(std::addressof(m_mutex));
+        }
+
+        slot.state = State::Done;
+        condvarWakeAll(std::addressof(m_can_reap));
+    }
+}
+
+void IoQueue::Run(Slot& slot) {
+    const auto& request = slot.request;
+    auto& completion = slot.completion;
+    completion.user_data = request.user_data;
+
+    // native files are thread safe, stdio files share a single position.
+    const auto is_stdio = !request.file->m_fs->IsNative();
+    if (is_stdio) {
+        mutexLock(std::addressof(m_stdio_mutex));
+    }
+    ON_SCOPE_EXIT(if (is_stdio) { mutexUnlock(std::addressof(m_stdio_mutex)); });
+
+    if (request.type == IoType::Read) {
+        completion.rc = request.file->Read(request.off, request.buf, request.size, 0, std::addressof(completion.bytes));
+    } else {
+        completion.rc = request.file->Write(request.off, request.buf, request.size, 0);
+        if (R_SUCCEEDED(completion.rc)) {
+            completion.bytes = request.size;
+        }
+    }
+
+    if (R_FAILED(completion.rc)) {
+        log_write("[IO] %s failed: 0x%X off: %zd size: %zu\n", request.type == IoType::Read ? "read" : "write", completion.rc, request.off, request.size);
+    }
+}
+
+} // namespace fs
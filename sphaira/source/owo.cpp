@@ -21,6 +21,7 @@
 #include "ui/progress_box.hpp"
 #include "i18n.hpp"
 #include "log.hpp"
+#include "buf_helper.hpp"
 
 namespace sphaira {
 namespace {
@@ -42,38 +43,6 @@ constexpr const u8 HBL_NPDM_DATA[]{
     #embed <exefs/main.npdm>
 };
 
-// stdio-like wrapper for std::vector
-struct BufHelper {
-    BufHelper() = default;
-    BufHelper(std::span<const u8> data) {
-        write(data);
-    }
-
-    void write(const void* data, u64 size) {
-        if (offset + size >= buf.size()) {
-            buf.resize(offset + size);
-        }
-        std::memcpy(buf.data() + offset, data, size);
-        offset += size;
-    }
-
-    void write(std::span<const u8> data) {
-        write(data.data(), data.size());
-    }
-
-    void seek(u64 where_to) {
-        offset = where_to;
-    }
-
-    [[nodiscard]]
-    auto tell() const {
-        return offset;
-    }
-
-    std::vector<u8> buf;
-    u64 offset{};
-};
-
 struct NcaEntry {
     NcaEntry(const BufHelper& buf, NcmContentType _type) : data{buf.buf}, type{_type} {
         sha256CalculateHash(hash, data.data(), data.size());
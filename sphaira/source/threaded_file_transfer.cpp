@@ -3,6 +3,9 @@
 #include "defines.hpp"
 #include "app.hpp"
 #include "minizip_helper.hpp"
+#include "pipeline.hpp"
+#include "throttle.hpp"
+#include "hasher.hpp"
 
 #include <vector>
 #include <algorithm>
@@ -14,65 +17,11 @@
 namespace sphaira::thread {
 namespace {
 
-// used for file based emummc and zip/unzip.
-constexpr u64 SMALL_BUFFER_SIZE = 1024 * 512;
-// used for everything else.
-constexpr u64 NORMAL_BUFFER_SIZE = 1024*1024*4;
-
-struct ThreadBuffer {
-    ThreadBuffer() {
-        buf.reserve(NORMAL_BUFFER_SIZE);
-    }
-
-    std::vector<u8> buf;
-    s64 off;
-};
-
-template<std::size_t Size>
-struct RingBuf {
-private:
-    ThreadBuffer buf[Size]{};
-    unsigned r_index{};
-    unsigned w_index{};
-
-    static_assert((sizeof(RingBuf::buf) & (sizeof(RingBuf::buf) - 1)) == 0, "Must be power of 2!");
-
-public:
-    void ringbuf_reset() {
-        this->r_index = this->w_index;
-    }
-
-    unsigned ringbuf_capacity() const {
-        return sizeof(this->buf) / sizeof(this->buf[0]);
-    }
-
-    unsigned ringbuf_size() const {
-        return (this->w_index - this->r_index) % (ringbuf_capacity() * 2U);
-    }
-
-    unsigned ringbuf_free() const {
-        return ringbuf_capacity() - ringbuf_size();
-    }
-
-    void ringbuf_push(std::vector<u8>& buf_in, s64 off_in) {
-        auto& value = this->buf[this->w_index % ringbuf_capacity()];
-        value.off = off_in;
-        std::swap(value.buf, buf_in);
-
-        this->w_index = (this->w_index + 1U) % (ringbuf_capacity() * 2U);
-    }
-
-    void ringbuf_pop(std::vector<u8>& buf_out, s64& off_out) {
-        auto& value = this->buf[this->r_index % ringbuf_capacity()];
-        off_out = value.off;
-        std::swap(value.buf, buf_out);
-
-        this->r_index = (this->r_index + 1U) % (ringbuf_capacity() * 2U);
-    }
-};
+using pipeline::SMALL_BUFFER_SIZE;
+using pipeline::NORMAL_BUFFER_SIZE;
 
 struct ThreadData {
-    ThreadData(ui::ProgressBox* _pbox, s64 size, ReadCallback _rfunc, WriteCallback _wfunc, u64 buffer_size);
+    ThreadData(ui::ProgressBox* _pbox, s64 size, ReadCallback _rfunc, WriteCallback _wfunc, u64 buffer_size, u32 depth);
 
     auto GetResults() volatile -> Result;
     void WakeAllThreads();
@@ -111,11 +60,17 @@ struct ThreadData {
 
     void SetPullResult(Result result) {
         pull_result = result;
+        pull_running = false;
         if (R_FAILED(result)) {
             ueventSignal(GetDoneEvent());
         }
     }
 
+    void LogStats() const {
+        read_stats.Log("read");
+        write_stats.Log("write");
+    }
+
     Result Pull(void* data, s64 size, u64* bytes_read);
     Result readFuncInternal();
     Result writeFuncInternal();
@@ -135,18 +90,15 @@ private:
     const WriteCallback wfunc;
 
     // these need to be created
-    Mutex mutex{};
-    Mutex pull_mutex{};
-
-    CondVar can_read{};
-    CondVar can_write{};
-    CondVar can_pull{};
-    CondVar can_pull_write{};
-
     UEvent m_uevent_done{};
     UEvent m_uevent_progres{};
 
-    RingBuf<2> write_buffers{};
+    pipeline::Queue<tune::MAX_DEPTH> write_queue{};
+    pipeline::StageStats read_stats{};
+    pipeline::StageStats write_stats{};
+    // hands the written buffers to the pulling thread.
+    pipeline::Queue<1> pull_queue{};
+    // only accessed by the pulling thread.
     std::vector<u8> pull_buffer{};
     s64 pull_buffer_offset{};
 
@@ -163,22 +115,16 @@ private:
 
     std::atomic_bool read_running{true};
     std::atomic_bool write_running{true};
+    std::atomic_bool pull_running{true};
 };
 
-ThreadData::ThreadData(ui::ProgressBox* _pbox, s64 size, ReadCallback _rfunc, WriteCallback _wfunc, u64 buffer_size)
+ThreadData::ThreadData(ui::ProgressBox* _pbox, s64 size, ReadCallback _rfunc, WriteCallback _wfunc, u64 buffer_size, u32 depth)
 : pbox{_pbox}
 , rfunc{_rfunc}
 , wfunc{_wfunc}
 , read_buffer_size{buffer_size}
 , write_size{size} {
-    mutexInit(std::addressof(mutex));
-    mutexInit(std::addressof(pull_mutex));
-
-    condvarInit(std::addressof(can_read));
-    condvarInit(std::addressof(can_write));
-    condvarInit(std::addressof(can_pull));
-    condvarInit(std::addressof(can_pull_write));
-
+    write_queue.SetDepth(depth);
     ueventCreate(&m_uevent_done, false);
     ueventCreate(&m_uevent_progres, true);
 }
@@ -192,89 +138,43 @@ auto ThreadData::GetResults() volatile -> Result {
 }
 
 void ThreadData::WakeAllThreads() {
-    condvarWakeAll(std::addressof(can_read));
-    condvarWakeAll(std::addressof(can_write));
-    condvarWakeAll(std::addressof(can_pull));
-    condvarWakeAll(std::addressof(can_pull_write));
-
-    mutexUnlock(std::addressof(mutex));
-    mutexUnlock(std::addressof(pull_mutex));
+    write_queue.WakeAll();
+    pull_queue.WakeAll();
 }
 
 Result ThreadData::SetWriteBuf(std::vector<u8>& buf, s64 size) {
     buf.resize(size);
-
-    mutexLock(std::addressof(mutex));
-    if (!write_buffers.ringbuf_free()) {
-        if (!write_running) {
-            R_SUCCEED();
-        }
-        R_TRY(condvarWait(std::addressof(can_read), std::addressof(mutex)));
-    }
-
-    ON_SCOPE_EXIT(mutexUnlock(std::addressof(mutex)));
-    R_TRY(GetResults());
-    write_buffers.ringbuf_push(buf, 0);
-    return condvarWakeOne(std::addressof(can_write));
+    return write_queue.Push(buf, 0, write_running, [this]{ return GetResults(); }, std::addressof(read_stats));
 }
 
 Result ThreadData::GetWriteBuf(std::vector<u8>& buf_out, s64& off_out) {
-    mutexLock(std::addressof(mutex));
-    if (!write_buffers.ringbuf_size()) {
-        if (!read_running) {
-            buf_out.resize(0);
-            R_SUCCEED();
-        }
-        R_TRY(condvarWait(std::addressof(can_write), std::addressof(mutex)));
-    }
-
-    ON_SCOPE_EXIT(mutexUnlock(std::addressof(mutex)));
-    R_TRY(GetResults());
-    write_buffers.ringbuf_pop(buf_out, off_out);
-    return condvarWakeOne(std::addressof(can_read));
+    return write_queue.Pop(buf_out, off_out, read_running, [this]{ return GetResults(); }, std::addressof(write_stats));
 }
 
 Result ThreadData::SetPullBuf(std::vector<u8>& buf, s64 size) {
     buf.resize(size);
-
-    mutexLock(std::addressof(pull_mutex));
-    if (!pull_buffer.empty()) {
-        R_TRY(condvarWait(std::addressof(can_pull_write), std::addressof(pull_mutex)));
-    }
-
-    ON_SCOPE_EXIT(mutexUnlock(std::addressof(pull_mutex)));
-    R_TRY(GetResults());
-
-    pull_buffer.swap(buf);
-    return condvarWakeOne(std::addressof(can_pull));
+    return pull_queue.Push(buf, 0, pull_running, [this]{ return GetResults(); });
 }
 
+// bytes_read is 0 once the write thread has exited and every buffer has been pulled.
 Result ThreadData::GetPullBuf(void* data, s64 size, u64* bytes_read) {
-    mutexLock(std::addressof(pull_mutex));
-    if (pull_buffer.empty()) {
-        R_TRY(condvarWait(std::addressof(can_pull), std::addressof(pull_mutex)));
+    if (pull_buffer_offset == s64(pull_buffer.size())) {
+        s64 dummy_off;
+        pull_buffer_offset = 0;
+        R_TRY(pull_queue.Pop(pull_buffer, dummy_off, write_running, [this]{ return GetResults(); }));
     }
 
-    ON_SCOPE_EXIT(mutexUnlock(std::addressof(pull_mutex)));
-    R_TRY(GetResults());
-
     *bytes_read = size = std::min<s64>(size, pull_buffer.size() - pull_buffer_offset);
     std::memcpy(data, pull_buffer.data() + pull_buffer_offset, size);
     pull_buffer_offset += size;
-
-    if (pull_buffer_offset == pull_buffer.size()) {
-        pull_buffer_offset = 0;
-        pull_buffer.clear();
-        return condvarWakeOne(std::addressof(can_pull_write));
-    } else {
-        R_SUCCEED();
-    }
+    R_SUCCEED();
 }
 
 Result ThreadData::Read(void* buf, s64 size, u64* bytes_read) {
     size = std::min<s64>(size, write_size - read_offset);
     const auto rc = rfunc(buf, read_offset, size, bytes_read);
     read_offset += *bytes_read;
+    read_stats.bytes += *bytes_read;
     return rc;
 }
 
@@ -285,6 +185,8 @@ Result ThreadData::Pull(void* data, s64 size, u64* bytes_read) {
 // read thread reads all data from the source
 Result ThreadData::readFuncInternal() {
     ON_SCOPE_EXIT( read_running = false; );
+    read_stats.Start();
+    ON_SCOPE_EXIT( read_stats.Stop(); );
 
     // the main buffer which data is read into.
     std::vector<u8> buf;
@@ -312,6 +214,8 @@ Result ThreadData::readFuncInternal() {
 // write thread writes data to wfunc.
 Result ThreadData::writeFuncInternal() {
     ON_SCOPE_EXIT( write_running = false; );
+    write_stats.Start();
+    ON_SCOPE_EXIT( write_stats.Stop(); );
 
     std::vector<u8> buf;
     buf.reserve(this->read_buffer_size);
@@ -332,6 +236,7 @@ Result ThreadData::writeFuncInternal() {
         }
 
         this->write_offset += size;
+        this->write_stats.bytes += size;
         ueventSignal(GetProgressEvent());
     }
 
@@ -348,14 +253,283 @@ void readFunc(void* d) {
 void writeFunc(void* d) {
     auto t = static_cast<ThreadData*>(d);
     t->SetWriteResult(t->writeFuncInternal());
+    // the pulling thread may be waiting for the next buffer.
+    t->WakeAllThreads();
     log_write("write thread returned now\n");
 }
 
+// the smallest chunk of a file that is added to a partially filled buffer,
+// otherwise the buffer is sent and the file starts in a new buffer.
+constexpr s64 FILES_MIN_CHUNK_SIZE = 1024*64;
+
+// written before each chunk of file data in the buffer when copying multiple files.
+struct FileChunkHeader {
+    // index of the file.
+    s64 index;
+    // total size of the file.
+    s64 file_size;
+    // offset and size of the data following the header.
+    s64 off;
+    s64 size;
+};
+
+struct FilesThreadData {
+    FilesThreadData(ui::ProgressBox* _pbox, fs::Fs* _src_fs, fs::Fs* _dst_fs, s64 _count, FilePathCallback _path_func, FileDoneCallback _done_func, u64 buffer_size, u32 depth, bool _verify);
+
+    auto GetResults() volatile -> Result {
+        R_TRY(pbox->ShouldExitResult());
+        R_TRY(read_result.load());
+        R_TRY(write_result.load());
+        R_SUCCEED();
+    }
+
+    void WakeAllThreads() {
+        write_queue.WakeAll();
+    }
+
+    auto IsAnyRunning() volatile const -> bool {
+        return read_running || write_running;
+    }
+
+    auto GetWriteOffset() volatile const -> s64 {
+        return write_offset;
+    }
+
+    auto GetDoneCount() volatile const -> s64 {
+        return done_count;
+    }
+
+    auto GetDoneEvent() {
+        return &m_uevent_done;
+    }
+
+    auto GetProgressEvent() {
+        return &m_uevent_progres;
+    }
+
+    void SetReadResult(Result result) {
+        read_result = result;
+        if (R_FAILED(result)) {
+            ueventSignal(GetDoneEvent());
+        }
+    }
+
+    void SetWriteResult(Result result) {
+        write_result = result;
+        ueventSignal(GetDoneEvent());
+    }
+
+    void LogStats() const {
+        read_stats.Log("files read");
+        write_stats.Log("files write");
+    }
+
+    Result readFuncInternal();
+    Result writeFuncInternal();
+
+private:
+    Result SendBuf(std::vector<u8>& buf);
+
+private:
+    ui::ProgressBox* const pbox;
+    fs::Fs* const src_fs;
+    fs::Fs* const dst_fs;
+    const s64 count;
+    const FilePathCallback path_func;
+    const FileDoneCallback done_func;
+    const u64 buffer_size;
+    const bool verify;
+
+    // reads and writes both feed the shared throttle controller, as they hit the same sd card.
+    throttle::Emummc read_throttle;
+    throttle::Emummc write_throttle;
+
+    UEvent m_uevent_done{};
+    UEvent m_uevent_progres{};
+
+    pipeline::Queue<tune::MAX_DEPTH> write_queue{};
+    pipeline::StageStats read_stats{};
+    pipeline::StageStats write_stats{};
+
+    // these are shared between threads
+    std::atomic<s64> write_offset{};
+    std::atomic<s64> done_count{};
+
+    std::atomic<Result> read_result{};
+    std::atomic<Result> write_result{};
+
+    std::atomic_bool read_running{true};
+    std::atomic_bool write_running{true};
+};
+
+FilesThreadData::FilesThreadData(ui::ProgressBox* _pbox, fs::Fs* _src_fs, fs::Fs* _dst_fs, s64 _count, FilePathCallback _path_func, FileDoneCallback _done_func, u64 _buffer_size, u32 _depth, bool _verify)
+: pbox{_pbox}
+, src_fs{_src_fs}
+, dst_fs{_dst_fs}
+, count{_count}
+, path_func{_path_func}
+, done_func{_done_func}
+, buffer_size{_buffer_size}
+, verify{_verify}
+, read_throttle{_src_fs->IsNative() && _dst_fs->IsNative() && App::IsFileBaseEmummc()}
+, write_throttle{read_throttle.IsEnabled()} {
+    write_queue.SetDepth(_depth);
+    ueventCreate(&m_uevent_done, false);
+    ueventCreate(&m_uevent_progres, true);
+}
+
+Result FilesThreadData::SendBuf(std::vector<u8>& buf) {
+    R_TRY(write_queue.Push(buf, 0, write_running, [this]{ return GetResults(); }, std::addressof(read_stats)));
+
+    // the buffer is swapped with the one in the queue, which may be empty.
+    buf.clear();
+    buf.reserve(buffer_size);
+    R_SUCCEED();
+}
+
+// read thread reads every file into the buffer, each chunk prefixed with a header.
+Result FilesThreadData::readFuncInternal() {
+    ON_SCOPE_EXIT( read_running = false; );
+    read_stats.Start();
+    ON_SCOPE_EXIT( read_stats.Stop(); );
+
+    std::vector<u8> buf;
+    buf.reserve(buffer_size);
+
+    for (s64 i = 0; i < count && R_SUCCEEDED(GetResults()); i++) {
+        fs::FsPath src_path, dst_path;
+        path_func(i, src_path, dst_path);
+
+        fs::File f;
+        R_TRY(src_fs->OpenFile(src_path, FsOpenMode_Read, &f));
+
+        s64 file_size;
+        R_TRY(f.GetSize(&file_size));
+
+        // empty files still send a header so that the file is created.
+        s64 off{};
+        do {
+            const auto min_size = sizeof(FileChunkHeader) + std::min(file_size - off, FILES_MIN_CHUNK_SIZE);
+            if (!buf.empty() && buf.size() + min_size > buffer_size) {
+                R_TRY(SendBuf(buf));
+            }
+
+            const auto pos = buf.size();
+            const auto read_size = std::min<s64>(file_size - off, buffer_size - pos - sizeof(FileChunkHeader));
+            buf.resize(pos + sizeof(FileChunkHeader) + read_size);
+
+            u64 bytes_read{};
+            if (read_size) {
+                R_TRY(read_throttle.Run(read_size, [&]{
+                    return f.Read(off, buf.data() + pos + sizeof(FileChunkHeader), read_size, 0, &bytes_read);
+                }));
+
+                R_UNLESS(bytes_read, Result_FsFileTruncated);
+            }
+
+            const FileChunkHeader header{i, file_size, off, s64(bytes_read)};
+            std::memcpy(buf.data() + pos, &header, sizeof(header));
+            buf.resize(pos + sizeof(FileChunkHeader) + bytes_read);
+
+            read_stats.bytes += bytes_read;
+            off += bytes_read;
+        } while (off < file_size);
+    }
+
+    if (!buf.empty()) {
+        R_TRY(SendBuf(buf));
+    }
+
+    log_write("finished files read thread success!\n");
+    R_SUCCEED();
+}
+
+// write thread creates and writes each file from the chunks in the buffer.
+Result FilesThreadData::writeFuncInternal() {
+    ON_SCOPE_EXIT( write_running = false; );
+    write_stats.Start();
+    ON_SCOPE_EXIT( write_stats.Stop(); );
+
+    std::vector<u8> buf;
+    buf.reserve(buffer_size);
+
+    fs::File f;
+    fs::FsPath src_path, dst_path;
+    s64 index{-1};
+    u32 crc32{};
+
+    while (R_SUCCEEDED(GetResults())) {
+        s64 dummy_off;
+        R_TRY(write_queue.Pop(buf, dummy_off, read_running, [this]{ return GetResults(); }, std::addressof(write_stats)));
+        if (buf.empty()) {
+            break;
+        }
+
+        for (u64 pos = 0; pos < buf.size();) {
+            FileChunkHeader header;
+            std::memcpy(&header, buf.data() + pos, sizeof(header));
+            pos += sizeof(header);
+
+            if (header.index != index) {
+                index = header.index;
+                path_func(index, src_path, dst_path);
+
+                // see ProgressBox::CopyFile().
+                dst_fs->CreateFile(dst_path, header.file_size, 0);
+                R_TRY(dst_fs->OpenFile(dst_path, FsOpenMode_Write, &f));
+                R_TRY(f.SetSize(header.file_size));
+                crc32 = 0;
+            }
+
+            if (header.size) {
+                R_TRY(write_throttle.Run(header.size, [&]{
+                    return f.Write(header.off, buf.data() + pos, header.size, 0);
+                }));
+
+                if (verify) {
+                    crc32 = crc32CalculateWithSeed(crc32, buf.data() + pos, header.size);
+                }
+            }
+
+            pos += header.size;
+            write_offset += header.size;
+            write_stats.bytes += header.size;
+
+            if (header.off + header.size == header.file_size) {
+                f.Close();
+                if (verify) {
+                    R_TRY(VerifyCrc32(pbox, dst_fs, dst_path, header.file_size, crc32, false));
+                }
+
+                if (done_func) {
+                    R_TRY(done_func(src_path, dst_path));
+                }
+                done_count++;
+            }
+        }
+
+        ueventSignal(GetProgressEvent());
+    }
+
+    log_write("finished files write thread success!\n");
+    R_SUCCEED();
+}
+
+void filesReadFunc(void* d) {
+    auto t = static_cast<FilesThreadData*>(d);
+    t->SetReadResult(t->readFuncInternal());
+}
+
+void filesWriteFunc(void* d) {
+    auto t = static_cast<FilesThreadData*>(d);
+    t->SetWriteResult(t->writeFuncInternal());
+}
+
 auto GetAlternateCore(int id) {
     return id == 1 ? 2 : 1;
 }
 
-Result TransferInternal(ui::ProgressBox* pbox, s64 size, ReadCallback rfunc, WriteCallback wfunc, StartCallback2 sfunc, Mode mode, u64 buffer_size = NORMAL_BUFFER_SIZE) {
+Result TransferInternal(ui::ProgressBox* pbox, s64 size, ReadCallback rfunc, WriteCallback wfunc, StartCallback2 sfunc, Mode mode, u64 buffer_size = NORMAL_BUFFER_SIZE, u32 depth = 2) {
     const auto is_file_based_emummc = App::IsFileBaseEmummc();
 
     if (is_file_based_emummc) {
@@ -370,13 +544,24 @@ Result TransferInternal(ui::ProgressBox* pbox, s64 size, ReadCallback rfunc, Wri
         }
     }
 
-    // single threaded pull buffer is not supported.
-    log_write("checking invalid transfer mode: %u %u\n", mode == Mode::MultiThreaded, !sfunc);
-    R_UNLESS(mode == Mode::MultiThreaded || !sfunc, 0x1);
-    log_write("valid transfer mode\n");
+    if (mode == Mode::SingleThreaded && sfunc) {
+        // pull reads directly from rfunc on the calling thread, there's no threads to start.
+        s64 offset{};
+        return sfunc([]() -> Result { R_SUCCEED(); }, [&](void* data, s64 pull_size, u64* bytes_read) -> Result {
+            R_TRY(pbox->ShouldExitResult());
+
+            *bytes_read = 0;
+            const auto rsize = std::min<s64>(pull_size, size - offset);
+            if (rsize <= 0) {
+                R_SUCCEED();
+            }
 
-    // todo: support single threaded pull buffer.
-    if (mode == Mode::SingleThreaded) {
+            R_TRY(rfunc(data, offset, rsize, bytes_read));
+            offset += *bytes_read;
+            R_SUCCEED();
+        });
+    }
+    else if (mode == Mode::SingleThreaded) {
         std::vector<u8> buf(buffer_size);
 
         s64 offset{};
@@ -402,7 +587,7 @@ Result TransferInternal(ui::ProgressBox* pbox, s64 size, ReadCallback rfunc, Wri
         const auto WRITE_THREAD_CORE = sfunc ? pbox->GetCpuId() : GetAlternateCore(pbox->GetCpuId());
         const auto READ_THREAD_CORE = GetAlternateCore(WRITE_THREAD_CORE);
 
-        ThreadData t_data{pbox, size, rfunc, wfunc, buffer_size};
+        ThreadData t_data{pbox, size, rfunc, wfunc, buffer_size, depth};
 
         Thread t_read{};
         R_TRY(threadCreate(&t_read, readFunc, std::addressof(t_data), nullptr, 1024*256, 0x3B, READ_THREAD_CORE));
@@ -465,6 +650,7 @@ Result TransferInternal(ui::ProgressBox* pbox, s64 size, ReadCallback rfunc, Wri
             break;
         }
         log_write("threads closed\n");
+        t_data.LogStats();
 
         // if any of the threads failed, wake up all threads so they can exit.
         if (R_FAILED(t_data.GetResults())) {
@@ -484,6 +670,10 @@ Result Transfer(ui::ProgressBox* pbox, s64 size, ReadCallback rfunc, WriteCallba
     return TransferInternal(pbox, size, rfunc, wfunc, nullptr, mode);
 }
 
+Result Transfer(ui::ProgressBox* pbox, s64 size, ReadCallback rfunc, WriteCallback wfunc, const tune::Params& params, Mode mode) {
+    return TransferInternal(pbox, size, rfunc, wfunc, nullptr, mode, params.buffer_size, params.depth);
+}
+
 Result TransferPull(ui::ProgressBox* pbox, s64 size, ReadCallback rfunc, StartCallback sfunc, Mode mode) {
     return TransferInternal(pbox, size, rfunc, nullptr, [sfunc](StartThreadCallback start, PullCallback pull) -> Result {
         R_TRY(start());
@@ -495,6 +685,106 @@ Result TransferPull(ui::ProgressBox* pbox, s64 size, ReadCallback rfunc, StartCa
     return TransferInternal(pbox, size, rfunc, nullptr, sfunc, mode);
 }
 
+Result TransferFiles(ui::ProgressBox* pbox, fs::Fs* src_fs, fs::Fs* dst_fs, s64 count, s64 total_size, FilePathCallback path_func, FileDoneCallback done_func, bool verify) {
+    const auto params = tune::Get(src_fs, dst_fs);
+    const auto buffer_size = App::IsFileBaseEmummc() ? SMALL_BUFFER_SIZE : params.buffer_size;
+    const auto WRITE_THREAD_CORE = GetAlternateCore(pbox->GetCpuId());
+    const auto READ_THREAD_CORE = GetAlternateCore(WRITE_THREAD_CORE);
+
+    FilesThreadData t_data{pbox, src_fs, dst_fs, count, path_func, done_func, buffer_size, params.depth, verify};
+
+    Thread t_read{};
+    R_TRY(threadCreate(&t_read, filesReadFunc, std::addressof(t_data), nullptr, 1024*64, 0x3B, READ_THREAD_CORE));
+    ON_SCOPE_EXIT(threadClose(&t_read));
+
+    Thread t_write{};
+    R_TRY(threadCreate(&t_write, filesWriteFunc, std::addressof(t_data), nullptr, 1024*64, 0x3B, WRITE_THREAD_CORE));
+    ON_SCOPE_EXIT(threadClose(&t_write));
+
+    R_TRY(threadStart(std::addressof(t_read)));
+    ON_SCOPE_EXIT(threadWaitForExit(std::addressof(t_read)));
+    R_TRY(threadStart(std::addressof(t_write)));
+    ON_SCOPE_EXIT(threadWaitForExit(std::addressof(t_write)));
+
+    const auto waiter_progress = waiterForUEvent(t_data.GetProgressEvent());
+    const auto waiter_cancel = waiterForUEvent(pbox->GetCancelEvent());
+    const auto waiter_done = waiterForUEvent(t_data.GetDoneEvent());
+
+    for (;;) {
+        s32 idx;
+        if (R_FAILED(waitMulti(&idx, UINT64_MAX, waiter_progress, waiter_cancel, waiter_done))) {
+            break;
+        }
+
+        if (!idx) {
+            pbox->UpdateTransfer(t_data.GetWriteOffset(), total_size);
+        } else {
+            break;
+        }
+    }
+
+    // wait for all threads to close.
+    while (t_data.IsAnyRunning()) {
+        t_data.WakeAllThreads();
+        pbox->Yield();
+
+        if (R_FAILED(waitSingleHandle(t_read.handle, 1000))) {
+            continue;
+        } else if (R_FAILED(waitSingleHandle(t_write.handle, 1000))) {
+            continue;
+        }
+        break;
+    }
+
+    log_write("[THREAD] copied files: %zd / %zd\n", t_data.GetDoneCount(), count);
+    t_data.LogStats();
+    return t_data.GetResults();
+}
+
+Result VerifyCrc32(ui::ProgressBox* pbox, fs::Fs* fs, const fs::FsPath& path, s64 size, u32 crc32, bool update_progress) {
+    fs::File f;
+    R_TRY(fs->OpenFile(path, FsOpenMode_Read, &f));
+
+    s64 file_size;
+    R_TRY(f.GetSize(&file_size));
+    if (file_size != size) {
+        log_write("[VERIFY] size mismatch: %s %zd vs %zd\n", path.s, file_size, size);
+        R_THROW(Result_FsVerifyMismatch);
+    }
+
+    // the read back is throttled the same as the copy, see throttle::Emummc.
+    throttle::Emummc throttle{fs->IsNative() && App::IsFileBaseEmummc()};
+    std::vector<u8> buf(std::min<s64>(size, throttle.IsEnabled() ? SMALL_BUFFER_SIZE : NORMAL_BUFFER_SIZE));
+    u32 crc32_out{};
+
+    for (s64 off = 0; off < size;) {
+        R_TRY(pbox->ShouldExitResult());
+
+        u64 bytes_read{};
+        const auto read_size = std::min<s64>(buf.size(), size - off);
+        R_TRY(throttle.Run(read_size, [&]{
+            return f.Read(off, buf.data(), read_size, FsReadOption_None, &bytes_read);
+        }));
+        R_UNLESS(bytes_read, Result_FsFileTruncated);
+
+        crc32_out = crc32CalculateWithSeed(crc32_out, buf.data(), bytes_read);
+        off += bytes_read;
+
+        if (update_progress) {
+            pbox->UpdateTransfer(off, size);
+        }
+    }
+
+    if (crc32_out != crc32) {
+        log_write("[VERIFY] crc32 mismatch: %s 0x%08X vs 0x%08X\n", path.s, crc32_out, crc32);
+        R_THROW(Result_FsVerifyMismatch);
+    }
+
+    // the file has been read back, so the crc32 can be shown without hashing it again.
+    hash::CacheCrc32(fs, path, crc32_out);
+    R_SUCCEED();
+}
+
 Result TransferUnzip(ui::ProgressBox* pbox, void* zfile, fs::Fs* fs, const fs::FsPath& path, s64 size, u32 crc32, Mode mode) {
     Result rc;
     if (R_FAILED(rc = fs->CreateDirectoryRecursivelyWithPath(path)) && rc != FsError_PathAlreadyExists) {
@@ -517,6 +807,7 @@ Result TransferUnzip(ui::ProgressBox* pbox, void* zfile, fs::Fs* fs, const fs::F
 
     // NOTES: do not use temp file with rename / delete after as it massively slows
     // down small file transfers (RA 21s -> 50s).
+    // the crc32 is calculated on the write thread as the read thread is busy inflating.
     u32 crc32_out{};
     R_TRY(thread::TransferInternal(pbox, size,
         [&](void* data, s64 off, s64 size, u64* bytes_read) -> Result {
@@ -526,14 +817,14 @@ Result TransferUnzip(ui::ProgressBox* pbox, void* zfile, fs::Fs* fs, const fs::F
                 R_THROW(Result_UnzReadCurrentFile);
             }
 
-            if (crc32) {
-                crc32_out = crc32CalculateWithSeed(crc32_out, data, result);
-            }
-
             *bytes_read = result;
             R_SUCCEED();
         },
         [&](const void* data, s64 off, s64 size) -> Result {
+            if (crc32) {
+                crc32_out = crc32CalculateWithSeed(crc32_out, data, size);
+            }
+
             return f.Write(off, data, size, FsWriteOption_None);
         },
         nullptr, mode, SMALL_BUFFER_SIZE
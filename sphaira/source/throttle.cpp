@@ -0,0 +1,78 @@
+#include "throttle.hpp"
+#include "app.hpp"
+#include "defines.hpp"
+
+#include <algorithm>
+#include <bit>
+
+namespace sphaira::throttle {
+namespace {
+
+// start with the delay that was previously always used.
+constexpr u64 DELAY_START = 2e+6; // 2ms
+constexpr u64 DELAY_MAX = 16e+6; // 16ms
+// used when the delay is 0 and io becomes slow.
+constexpr u64 DELAY_MIN_INCREASE = 500e+3; // 0.5ms
+constexpr u64 DELAY_DECREASE = 250e+3; // 0.25ms
+// io slower than baseline * this is treated as contention.
+constexpr u64 CONTENTION_FACTOR = 2;
+// how quickly the baseline drifts up towards slower io, 1/N per call.
+constexpr u64 BASELINE_DRIFT = 64;
+
+} // namespace
+
+Controller::Controller() {
+    mutexInit(std::addressof(m_mutex));
+    m_delay = DELAY_START;
+}
+
+auto Controller::GetBucket(s64 size) -> u32 {
+    const auto shift = std::bit_width(u64(size)) - 1;
+    // the bit below the top bit splits each octave in half.
+    const auto half = shift ? (u64(size) >> (shift - 1)) & 1 : 0;
+    const auto bucket = s64(shift * 2 + half) - s64(BUCKET_MIN_SHIFT * 2);
+    return std::clamp<s64>(bucket, 0, BUCKET_COUNT - 1);
+}
+
+void Controller::Update(u64 latency_ns, s64 size) {
+    if (size <= 0) {
+        return;
+    }
+
+    SCOPED_MUTEX(std::addressof(m_mutex));
+    auto& baseline = m_baseline[GetBucket(size)];
+
+    if (!baseline || latency_ns < baseline) {
+        baseline = latency_ns;
+    } else {
+        // allow the baseline to rise slowly so that a single fast outlier
+        // does not cause every following call to be treated as contention.
+        baseline += (latency_ns - baseline) / BASELINE_DRIFT;
+    }
+
+    const u64 delay = m_delay;
+    if (latency_ns > baseline * CONTENTION_FACTOR) {
+        m_delay = std::clamp(delay * 2, DELAY_MIN_INCREASE, DELAY_MAX);
+    } else if (delay > DELAY_DECREASE) {
+        m_delay = delay - DELAY_DECREASE;
+    } else {
+        m_delay = 0;
+    }
+}
+
+auto GetController() -> Controller& {
+    static Controller controller{};
+    return controller;
+}
+
+Emummc::Emummc() : Emummc{App::IsFileBaseEmummc()} {
+
+}
+
+Emummc::Emummc(bool enabled, Controller& controller) {
+    if (enabled) {
+        m_controller = std::addressof(controller);
+    }
+}
+
+} // namespace sphaira::throttle
@@ -0,0 +1,172 @@
+#include "tune.hpp"
+#include "threaded_file_transfer.hpp"
+#include "pipeline.hpp"
+#include "defines.hpp"
+#include "log.hpp"
+#include "i18n.hpp"
+
+#include <minIni.h>
+#include <array>
+#include <vector>
+#include <cstdio>
+#include <algorithm>
+
+namespace sphaira::tune {
+namespace {
+
+constexpr auto TUNE_PATH = "/config/sphaira/tune.ini";
+
+// size of the file that is copied for each buffer size / depth.
+constexpr s64 BENCHMARK_FILE_SIZE = 1024*1024*32;
+// limits the memory used by the queued buffers.
+constexpr u64 MAX_QUEUED_SIZE = 1024*1024*16;
+
+constexpr std::array<u64, 5> BUFFER_SIZES{
+    1024*256,
+    1024*512,
+    1024*1024*1,
+    1024*1024*2,
+    1024*1024*4,
+};
+
+constexpr std::array<u32, 3> DEPTHS{2, 4, MAX_DEPTH};
+
+auto GetSection(const fs::Fs* src, const fs::Fs* dst) -> std::string {
+    return std::string{src->Device()} + "_" + std::string{dst->Device()};
+}
+
+auto IsValid(const Params& params) -> bool {
+    return std::ranges::find(BUFFER_SIZES, params.buffer_size) != BUFFER_SIZES.end() && std::ranges::find(DEPTHS, params.depth) != DEPTHS.end();
+}
+
+// copies src to dst, the speed is in MiB/s and includes the time taken to commit.
+Result Copy(ui::ProgressBox* pbox, fs::Fs* src_fs, const fs::FsPath& src_path, fs::Fs* dst_fs, const fs::FsPath& dst_path, const Params& params, double& speed) {
+    fs::File src_file;
+    R_TRY(src_fs->OpenFile(src_path, FsOpenMode_Read, &src_file));
+
+    dst_fs->CreateFile(dst_path, BENCHMARK_FILE_SIZE, 0);
+    ON_SCOPE_EXIT(dst_fs->DeleteFile(dst_path));
+
+    const auto start = armGetSystemTick();
+    {
+        fs::File dst_file;
+        R_TRY(dst_fs->OpenFile(dst_path, FsOpenMode_Write, &dst_file));
+        R_TRY(dst_file.SetSize(BENCHMARK_FILE_SIZE));
+
+        R_TRY(thread::Transfer(pbox, BENCHMARK_FILE_SIZE,
+            [&](void* data, s64 off, s64 size, u64* bytes_read) -> Result {
+                return src_file.Read(off, data, size, 0, bytes_read);
+            },
+            [&](const void* data, s64 off, s64 size) -> Result {
+                return dst_file.Write(off, data, size, 0);
+            }, params
+        ));
+    }
+
+    const auto ns = armTicksToNs(armGetSystemTick() - start);
+    speed = ns ? (double(BENCHMARK_FILE_SIZE) / 1024.0 / 1024.0) / (double(ns) / 1e9) : 0.0;
+    R_SUCCEED();
+}
+
+} // namespace
+
+auto GetDefault() -> Params {
+    return { pipeline::NORMAL_BUFFER_SIZE, 2 };
+}
+
+auto Get(const fs::Fs* src, const fs::Fs* dst) -> Params {
+    const auto section = GetSection(src, dst);
+    const Params params{
+        .buffer_size = u64(ini_getl(section.c_str(), "buffer_size", 0, TUNE_PATH)),
+        .depth = u32(ini_getl(section.c_str(), "depth", 0, TUNE_PATH)),
+    };
+
+    if (!IsValid(params)) {
+        return GetDefault();
+    }
+
+    return params;
+}
+
+Result Benchmark(ui::ProgressBox* pbox, fs::Fs* src_fs, const fs::FsPath& src_dir, fs::Fs* dst_fs, const fs::FsPath& dst_dir, std::string& out) {
+    const auto src_path = fs::AppendPath(src_dir, "sphaira_tune_src.bin");
+    const auto dst_path = fs::AppendPath(dst_dir, "sphaira_tune_dst.bin");
+
+    // create the file that is copied.
+    src_fs->CreateFile(src_path, BENCHMARK_FILE_SIZE, 0);
+    ON_SCOPE_EXIT(src_fs->DeleteFile(src_path));
+    {
+        pbox->NewTransfer(src_path);
+
+        fs::File f;
+        R_TRY(src_fs->OpenFile(src_path, FsOpenMode_Write, &f));
+        R_TRY(f.SetSize(BENCHMARK_FILE_SIZE));
+
+        std::vector<u8> buf(pipeline::NORMAL_BUFFER_SIZE);
+        for (u64 i = 0; i < buf.size(); i++) {
+            buf[i] = i * 31 + 7;
+        }
+
+        for (s64 off = 0; off < BENCHMARK_FILE_SIZE; off += buf.size()) {
+            R_TRY(pbox->ShouldExitResult());
+            R_TRY(f.Write(off, buf.data(), buf.size(), 0));
+            pbox->UpdateTransfer(off + buf.size(), BENCHMARK_FILE_SIZE);
+        }
+    }
+
+    double speeds[BUFFER_SIZES.size()][DEPTHS.size()]{};
+    Params best{GetDefault()};
+    double best_speed{};
+
+    for (u32 i = 0; i < BUFFER_SIZES.size(); i++) {
+        for (u32 j = 0; j < DEPTHS.size(); j++) {
+            const Params params{BUFFER_SIZES[i], DEPTHS[j]};
+            if (params.buffer_size * params.depth > MAX_QUEUED_SIZE) {
+                continue;
+            }
+
+            char name[64];
+            std::snprintf(name, sizeof(name), "%zu KiB x %u", params.buffer_size / 1024, params.depth);
+            pbox->NewTransfer("Benchmarking "_i18n + name);
+
+            R_TRY(Copy(pbox, src_fs, src_path, dst_fs, dst_path, params, speeds[i][j]));
+            log_write("[TUNE] %s -> %s %s: %.2f MiB/s\n", src_fs->Device().s, dst_fs->Device().s, name, speeds[i][j]);
+
+            if (speeds[i][j] > best_speed) {
+                best_speed = speeds[i][j];
+                best = params;
+            }
+        }
+    }
+
+    const auto section = GetSection(src_fs, dst_fs);
+    ini_putl(section.c_str(), "buffer_size", best.buffer_size, TUNE_PATH);
+    ini_putl(section.c_str(), "depth", best.depth, TUNE_PATH);
+
+    // MiB/s of each buffer size (rows) and depth (columns), 0 if skipped.
+    char line[128];
+    out = section + "\n";
+    std::snprintf(line, sizeof(line), "%-10s", "KiB");
+    out += line;
+    for (const auto depth : DEPTHS) {
+        std::snprintf(line, sizeof(line), "%10u", depth);
+        out += line;
+    }
+
+    for (u32 i = 0; i < BUFFER_SIZES.size(); i++) {
+        std::snprintf(line, sizeof(line), "\n%-10zu", BUFFER_SIZES[i] / 1024);
+        out += line;
+        for (u32 j = 0; j < DEPTHS.size(); j++) {
+            std::snprintf(line, sizeof(line), "%10.1f", speeds[i][j]);
+            out += line;
+        }
+    }
+
+    std::snprintf(line, sizeof(line), "\nBest: %zu KiB x %u %.1f MiB/s", best.buffer_size / 1024, best.depth, best_speed);
+    out += line;
+    log_write("[TUNE] %s\n", out.c_str());
+
+    R_SUCCEED();
+}
+
+} // namespace sphaira::tune
@@ -145,6 +145,13 @@ auto GetCodeMessage(Result rc) -> const char* {
         case Result_YatiCertNotFound: return "SphairaError_YatiCertNotFound";
         case Result_YatiNcmDbCorruptHeader: return "SphairaError_YatiNcmDbCorruptHeader";
         case Result_YatiNcmDbCorruptInfos: return "SphairaError_YatiNcmDbCorruptInfos";
+        case Result_YatiInvalidResumeOffset: return "SphairaError_YatiInvalidResumeOffset";
+        case Result_YatiInvalidNcaHashTree: return "SphairaError_YatiInvalidNcaHashTree";
+        case Result_YatiInvalidHfs0Hash: return "SphairaError_YatiInvalidHfs0Hash";
+        case Result_FsFileTruncated: return "SphairaError_FsFileTruncated";
+        case Result_FsVerifyMismatch: return "SphairaError_FsVerifyMismatch";
+        case Result_UsbShortTransfer: return "SphairaError_UsbShortTransfer";
+        case Result_UsbZstdError: return "SphairaError_UsbZstdError";
     }
 
     return "";
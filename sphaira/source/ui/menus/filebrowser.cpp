@@ -21,6 +21,9 @@
 #include "hasher.hpp"
 #include "location.hpp"
 #include "threaded_file_transfer.hpp"
+#include "throttle.hpp"
+#include "pipeline.hpp"
+#include "tune.hpp"
 #include "minizip_helper.hpp"
 
 #include "yati/yati.hpp"
@@ -38,6 +41,9 @@
 #include <span>
 #include <utility>
 #include <ranges>
+#include <atomic>
+#include <array>
+#include <functional>
 // #include <stack>
 #include <expected>
 
@@ -293,6 +299,184 @@ auto GetRomIcon(fs::Fs* fs, ProgressBox* pbox, std::string filename, const RomDa
     return nro_get_icon(nro.path, nro.icon_size, nro.icon_offset);
 }
 
+
+// files smaller than this are copied by the paste scheduler, larger files
+// are copied one at a time using the threaded transfer.
+constexpr s64 PASTE_SMALL_FILE_SIZE = 1024*1024*4;
+// max number of files copied at once.
+constexpr u32 PASTE_MAX_THREADS = 3;
+// no point starting the threads for only a few files.
+constexpr u64 PASTE_MIN_FILES = 4;
+
+struct PasteEntry {
+    // the full paths are built when copied, as there may be tens of thousands of files.
+    const fs::FsPath* src_dir;
+    const fs::FsPath* dst_dir;
+    const char* name;
+    s64 size;
+};
+
+// copying small files is dominated by the open / create / close latency,
+// so several files are copied at once, each on its own thread.
+// each thread takes the next file from the list until it's empty, the
+// first error stops every thread.
+// if verify is set, each file is read back before on_copied is called.
+struct PasteScheduler {
+    using Callback = std::function<Result(const fs::FsPath& src_path, const fs::FsPath& dst_path)>;
+
+    PasteScheduler(ProgressBox* pbox, fs::Fs* src_fs, fs::Fs* dst_fs, std::span<const PasteEntry> entries, const Callback& on_copied, bool verify)
+    : m_pbox{pbox}, m_src_fs{src_fs}, m_dst_fs{dst_fs}, m_entries{entries}, m_on_copied{on_copied}, m_verify{verify} {
+        mutexInit(std::addressof(m_mutex));
+
+        for (const auto& e : m_entries) {
+            m_total_bytes += e.size;
+        }
+    }
+
+    // copies every entry, returns once all threads have exited.
+    Result Run() {
+        Thread threads[PASTE_MAX_THREADS]{};
+        u32 thread_count{};
+        ON_SCOPE_EXIT(
+            for (u32 i = 0; i < thread_count; i++) {
+                threadWaitForExit(std::addressof(threads[i]));
+                threadClose(std::addressof(threads[i]));
+            }
+        );
+
+        const auto max_threads = std::min<u64>(PASTE_MAX_THREADS, m_entries.size());
+        for (u32 i = 0; i < max_threads; i++) {
+            if (R_FAILED(threadCreate(std::addressof(threads[i]), ThreadFunc, this, nullptr, 1024*64, PRIO_PREEMPTIVE, i))) {
+                break;
+            }
+
+            if (R_FAILED(threadStart(std::addressof(threads[i])))) {
+                threadClose(std::addressof(threads[i]));
+                break;
+            }
+
+            thread_count++;
+        }
+
+        // fallback to copying on this thread if no threads could be created.
+        if (!thread_count) {
+            SetResult(Worker());
+        }
+
+        for (u32 i = 0; i < thread_count;) {
+            if (R_SUCCEEDED(waitSingleHandle(threads[i].handle, 1e+8))) {
+                i++;
+            }
+
+            m_pbox->UpdateTransfer(m_done_bytes, m_total_bytes);
+        }
+
+        log_write("[PASTE] copied: %zu / %zu files threads: %u\n", m_done_count.load(), m_entries.size(), thread_count);
+        R_TRY(m_pbox->ShouldExitResult());
+        return m_result;
+    }
+
+private:
+    static void ThreadFunc(void* arg) {
+        auto self = static_cast<PasteScheduler*>(arg);
+        self->SetResult(self->Worker());
+    }
+
+    Result Worker() {
+        std::vector<u8> buf(pipeline::SMALL_BUFFER_SIZE);
+
+        while (auto entry = Pop()) {
+            const auto src_path = FsView::GetNewPath(*entry->src_dir, entry->name);
+            const auto dst_path = FsView::GetNewPath(*entry->dst_dir, entry->name);
+
+            R_TRY(Copy(src_path, dst_path, buf));
+            R_TRY(m_on_copied(src_path, dst_path));
+
+            m_done_count++;
+            m_done_bytes += entry->size;
+        }
+
+        R_SUCCEED();
+    }
+
+    Result Copy(const fs::FsPath& src_path, const fs::FsPath& dst_path, std::vector<u8>& buf) {
+        fs::File src_file;
+        R_TRY(m_src_fs->OpenFile(src_path, FsOpenMode_Read, &src_file));
+
+        s64 src_size;
+        R_TRY(src_file.GetSize(&src_size));
+
+        // see ProgressBox::CopyFile().
+        m_dst_fs->CreateFile(dst_path, src_size, 0);
+
+        fs::File dst_file;
+        R_TRY(m_dst_fs->OpenFile(dst_path, FsOpenMode_Write, &dst_file));
+        R_TRY(dst_file.SetSize(src_size));
+
+        u32 crc32{};
+        for (s64 off = 0; off < src_size;) {
+            R_TRY(m_pbox->ShouldExitResult());
+
+            u64 bytes_read;
+            const auto read_size = std::min<s64>(buf.size(), src_size - off);
+            R_TRY(src_file.Read(off, buf.data(), read_size, 0, &bytes_read));
+            if (!bytes_read) {
+                break;
+            }
+
+            R_TRY(dst_file.Write(off, buf.data(), bytes_read, 0));
+            off += bytes_read;
+
+            if (m_verify) {
+                crc32 = crc32CalculateWithSeed(crc32, buf.data(), bytes_read);
+            }
+        }
+
+        if (m_verify) {
+            dst_file.Close();
+            R_TRY(thread::VerifyCrc32(m_pbox, m_dst_fs, dst_path, src_size, crc32, false));
+        }
+
+        R_SUCCEED();
+    }
+
+    // returns nullptr once all entries have been taken or on error / cancel.
+    auto Pop() -> const PasteEntry* {
+        SCOPED_MUTEX(std::addressof(m_mutex));
+
+        if (R_FAILED(m_result) || m_pbox->ShouldExit() || m_next >= m_entries.size()) {
+            return nullptr;
+        }
+
+        return std::addressof(m_entries[m_next++]);
+    }
+
+    void SetResult(Result rc) {
+        SCOPED_MUTEX(std::addressof(m_mutex));
+
+        // only the first error is kept.
+        if (R_SUCCEEDED(m_result)) {
+            m_result = rc;
+        }
+    }
+
+private:
+    ProgressBox* const m_pbox;
+    fs::Fs* const m_src_fs;
+    fs::Fs* const m_dst_fs;
+    const std::span<const PasteEntry> m_entries;
+    const Callback m_on_copied;
+    const bool m_verify;
+
+    Mutex m_mutex{};
+    u64 m_next{};
+    Result m_result{};
+
+    s64 m_total_bytes{};
+    std::atomic<s64> m_done_bytes{};
+    std::atomic<u64> m_done_count{};
+};
+
 } // namespace
 
 void SignalChange() {
@@ -733,6 +917,30 @@ void FsView::InstallFiles() {
     });
 }
 
+void FsView::VerifyFiles() {
+    const auto targets = GetSelectedEntries();
+
+    App::Push<OptionBox>("Verify Selected files?"_i18n, "No"_i18n, "Yes"_i18n, 0, [this, targets](auto op_index){
+        if (op_index && *op_index) {
+            App::PopToMenu();
+
+            App::Push<ui::ProgressBox>(0, "Verifying "_i18n, "", [this, targets](auto pbox) -> Result {
+                yati::ConfigOverride config{};
+                config.verify_only = true;
+
+                for (auto& e : targets) {
+                    R_TRY(yati::InstallFromFile(pbox, m_fs.get(), GetNewPath(e), config));
+                    App::Notify("Verified "_i18n + e.GetName());
+                }
+
+                R_SUCCEED();
+            }, [this](Result rc){
+                App::PushErrorBox(rc, "File verify failed!"_i18n);
+            });
+        }
+    });
+}
+
 void FsView::UnzipFiles(fs::FsPath dir_path) {
     const auto targets = GetSelectedEntries();
 
@@ -899,8 +1107,6 @@ void FsView::UploadFiles() {
             const auto loc = network_locations[*op_index];
             App::Push<ProgressBox>(0, "Uploading"_i18n, "", [this, loc](auto pbox) -> Result {
                 auto targets = GetSelectedEntries();
-                const auto is_file_based_emummc = App::IsFileBaseEmummc();
-
                 const auto file_add = [&](s64 file_size, const fs::FsPath& file_path, const char* name) -> Result {
                     // the file name needs to be relative to the current directory.
                     const auto relative_file_name = file_path.s + std::strlen(m_path);
@@ -909,14 +1115,13 @@ void FsView::UploadFiles() {
 
                     fs::File f;
                     R_TRY(m_fs->OpenFile(file_path, FsOpenMode_Read, &f));
+                    throttle::Emummc throttle{m_fs->IsNative() && App::IsFileBaseEmummc()};
 
                     return thread::TransferPull(pbox, file_size,
                         [&](void* data, s64 off, s64 size, u64* bytes_read) -> Result {
-                            const auto rc = f.Read(off, data, size, FsReadOption_None, bytes_read);
-                            if (m_fs->IsNative() && is_file_based_emummc) {
-                                svcSleepThread(2e+6); // 2ms
-                            }
-                            return rc;
+                            return throttle.Run(size, [&]{
+                                return f.Read(off, data, size, FsReadOption_None, bytes_read);
+                            });
                         },
                         [&](thread::PullCallback pull) -> Result {
                             s64 offset{};
@@ -946,7 +1151,7 @@ void FsView::UploadFiles() {
 
                             R_UNLESS(result.success, Result_FileBrowserFailedUpload);
                             R_SUCCEED();
-                        }
+                        }, thread::Mode::SingleThreadedIfSmaller
                     );
                 };
 
@@ -1225,6 +1430,8 @@ void FsView::OnPasteCallback() {
             auto& selected = m_menu->m_selected;
             auto src_fs = selected.m_view->GetFs();
             const auto is_same_fs = selected.SameFs(this);
+            // the source of a cut is only deleted once the copy has been verified.
+            const auto verify = m_menu->m_verify_copy.Get();
 
             if (selected.SameFs(this) && selected.m_type == SelectedType::Cut) {
                 for (const auto& p : selected.m_files) {
@@ -1271,56 +1478,100 @@ void FsView::OnPasteCallback() {
                     const auto full_path = GetNewPath(selected.m_path, p.name);
                     if (p.IsDir()) {
                         pbox->NewTransfer("Scanning "_i18n + full_path);
-                        R_TRY(get_collections(src_fs, full_path, p.name, collections));
+                        R_TRY(get_collections(src_fs, full_path, p.name, collections, true));
                     }
                 }
 
-                for (const auto& p : selected.m_files) {
+                // the full list of files is built before anything is copied,
+                // all the dirs are created first so that the files can be copied in any order.
+                // reserved so that the pointers in the entries remain valid.
+                std::vector<fs::FsPath> dst_dirs;
+                dst_dirs.reserve(collections.size());
+                std::vector<PasteEntry> large_files;
+                std::vector<PasteEntry> small_files;
+
+                const auto add_file = [&](const fs::FsPath* src_dir, const fs::FsPath* dst_dir, const FsDirectoryEntry& p) {
+                    const PasteEntry entry{src_dir, dst_dir, p.name, p.file_size};
+                    if (p.file_size < PASTE_SMALL_FILE_SIZE) {
+                        small_files.emplace_back(entry);
+                    } else {
+                        large_files.emplace_back(entry);
+                    }
+                };
+
+                const auto create_dir = [&](const char* name, const fs::FsPath& dst_path) -> Result {
                     pbox->Yield();
                     R_TRY(pbox->ShouldExitResult());
 
-                    const auto src_path = GetNewPath(selected.m_path, p.name);
-                    const auto dst_path = GetNewPath(p);
+                    pbox->SetTitle(name);
+                    pbox->NewTransfer("Creating "_i18n + dst_path);
+                    m_fs->CreateDirectory(dst_path);
+                    R_SUCCEED();
+                };
 
+                for (const auto& p : selected.m_files) {
                     if (p.IsDir()) {
-                        pbox->SetTitle(p.name);
-                        pbox->NewTransfer("Creating "_i18n + dst_path);
-                        m_fs->CreateDirectory(dst_path);
+                        R_TRY(create_dir(p.name, GetNewPath(p)));
                     } else {
-                        pbox->SetTitle(p.name);
-                        pbox->NewTransfer("Copying "_i18n + src_path);
-                        R_TRY(pbox->CopyFile(src_fs, m_fs.get(), src_path, dst_path, is_same_fs));
-                        R_TRY(on_paste_file(src_path, dst_path));
+                        add_file(&selected.m_path, &m_path, p);
                     }
                 }
 
-                // copy everything in collections
                 for (const auto& c : collections) {
-                    const auto base_dst_path = GetNewPath(m_path, c.parent_name);
+                    const auto& base_dst_path = dst_dirs.emplace_back(GetNewPath(m_path, c.parent_name));
 
                     for (const auto& p : c.dirs) {
-                        pbox->Yield();
-                        R_TRY(pbox->ShouldExitResult());
-
-                        // const auto src_path = GetNewPath(c.path, p.name);
-                        const auto dst_path = GetNewPath(base_dst_path, p.name);
-
-                        pbox->SetTitle(p.name);
-                        pbox->NewTransfer("Creating "_i18n + dst_path);
-                        m_fs->CreateDirectory(dst_path);
+                        R_TRY(create_dir(p.name, GetNewPath(base_dst_path, p.name)));
                     }
 
                     for (const auto& p : c.files) {
-                        pbox->Yield();
-                        R_TRY(pbox->ShouldExitResult());
+                        add_file(&c.path, &base_dst_path, p);
+                    }
+                }
+
+                // not worth starting the threads for only a few files.
+                if (small_files.size() < PASTE_MIN_FILES) {
+                    large_files.insert(large_files.end(), small_files.begin(), small_files.end());
+                    small_files.clear();
+                }
+
+                log_write("[PASTE] large files: %zu small files: %zu\n", large_files.size(), small_files.size());
 
-                        const auto src_path = GetNewPath(c.path, p.name);
-                        const auto dst_path = GetNewPath(base_dst_path, p.name);
+                for (const auto& e : large_files) {
+                    pbox->Yield();
+                    R_TRY(pbox->ShouldExitResult());
 
-                        pbox->SetTitle(p.name);
-                        pbox->NewTransfer("Copying "_i18n + src_path);
-                        R_TRY(pbox->CopyFile(src_fs, m_fs.get(), src_path, dst_path, is_same_fs));
-                        R_TRY(on_paste_file(src_path, dst_path));
+                    const auto src_path = GetNewPath(*e.src_dir, e.name);
+                    const auto dst_path = GetNewPath(*e.dst_dir, e.name);
+
+                    pbox->SetTitle(e.name);
+                    pbox->NewTransfer("Copying "_i18n + src_path);
+                    R_TRY(pbox->CopyFile(src_fs, m_fs.get(), src_path, dst_path, is_same_fs, verify));
+                    R_TRY(on_paste_file(src_path, dst_path));
+                }
+
+                if (!small_files.empty()) {
+                    pbox->SetTitle(selected.m_path);
+                    pbox->NewTransfer("Copying "_i18n + std::to_string(small_files.size()) + " " + "Files"_i18n);
+
+                    // file based emummc is throttled and other fs may not be thread safe,
+                    // so the files are instead batched through a single read / write thread pair.
+                    if (src_fs->IsNative() && m_fs->IsNative() && !App::IsFileBaseEmummc()) {
+                        PasteScheduler scheduler{pbox, src_fs, m_fs.get(), small_files, on_paste_file, verify};
+                        R_TRY(scheduler.Run());
+                    } else {
+                        s64 total_size{};
+                        for (const auto& e : small_files) {
+                            total_size += e.size;
+                        }
+
+                        R_TRY(thread::TransferFiles(pbox, src_fs, m_fs.get(), small_files.size(), total_size,
+                            [&](s64 index, fs::FsPath& src_path, fs::FsPath& dst_path) {
+                                const auto& e = small_files[index];
+                                src_path = GetNewPath(*e.src_dir, e.name);
+                                dst_path = GetNewPath(*e.dst_dir, e.name);
+                            }, on_paste_file, verify
+                        ));
                     }
                 }
 
@@ -1538,29 +1789,63 @@ void FsView::SetFs(const fs::FsPath& new_path, const FsEntry& new_entry) {
     }
 }
 
-void FsView::DisplayHash(hash::Type type) {
+void FsView::DisplayHash(std::span<const hash::Type> types) {
     // hack because we cannot share output between threaded calls...
-    static std::string hash_out;
+    static std::vector<std::string> hash_out;
     hash_out.clear();
 
-    App::Push<ProgressBox>(0, "Hashing"_i18n, GetEntry().name, [this, type](auto pbox) -> Result {
+    // all the hashes are calculated in a single pass of the file.
+    const std::vector<hash::Type> hash_types{types.begin(), types.end()};
+
+    App::Push<ProgressBox>(0, "Hashing"_i18n, GetEntry().name, [this, hash_types](auto pbox) -> Result {
         const auto full_path = GetNewPathCurrent();
         pbox->NewTransfer(full_path);
-        R_TRY(hash::Hash(pbox, type, m_fs.get(), full_path, hash_out));
+        R_TRY(hash::HashCached(pbox, hash_types, m_fs.get(), full_path, hash_out));
 
         R_SUCCEED();
-    }, [this, type](Result rc){
+    }, [this, hash_types](Result rc){
         App::PushErrorBox(rc, "Failed to hash file..."_i18n);
 
         if (R_SUCCEEDED(rc)) {
-            char buf[0x100];
-            // std::snprintf(buf, sizeof(buf), "%s\n%s\n%s", hash::GetTypeStr(type), hash_out.c_str(), GetEntry().GetName());
-            std::snprintf(buf, sizeof(buf), "%s\n%s", hash::GetTypeStr(type), hash_out.c_str());
+            std::string buf;
+            if (hash_types.size() == 1) {
+                buf = std::string{hash::GetTypeStr(hash_types[0])} + "\n" + hash_out[0];
+            } else {
+                for (u32 i = 0; i < hash_types.size(); i++) {
+                    if (i) {
+                        buf += "\n";
+                    }
+                    buf += std::string{hash::GetTypeStr(hash_types[i])} + ": " + hash_out[i];
+                }
+            }
+
             App::Push<OptionBox>(buf, "OK"_i18n);
         }
     });
 }
 
+void FsView::DisplayBenchmark() {
+    // in split screen, the copy is from this view to the other view.
+    auto dst = this;
+    if (m_menu->IsSplitScreen()) {
+        dst = this == m_menu->view_left.get() ? m_menu->view_right.get() : m_menu->view_left.get();
+    }
+
+    // hack because we cannot share output between threaded calls...
+    static std::string tune_out;
+    tune_out.clear();
+
+    App::Push<ProgressBox>(0, "Benchmarking"_i18n, m_path, [this, dst](auto pbox) -> Result {
+        return tune::Benchmark(pbox, m_fs.get(), m_path, dst->m_fs.get(), dst->m_path, tune_out);
+    }, [](Result rc){
+        App::PushErrorBox(rc, "Failed to benchmark..."_i18n);
+
+        if (R_SUCCEEDED(rc)) {
+            App::Push<OptionBox>(tune_out, "OK"_i18n);
+        }
+    });
+}
+
 void FsView::DisplayOptions() {
     auto options = std::make_unique<Sidebar>("File Options"_i18n, Sidebar::Side::RIGHT);
     ON_SCOPE_EXIT(App::Push(std::move(options)));
@@ -1690,6 +1975,10 @@ void FsView::DisplayOptions() {
                 InstallFiles();
             });
             entry->Depends(App::GetInstallEnable, i18n::get(App::INSTALL_DEPENDS_STR));
+
+            options->Add<SidebarEntryCallback>("Verify"_i18n, [this](){
+                VerifyFiles();
+            });
         }
     }
 
@@ -1854,16 +2143,25 @@ void FsView::DisplayAdvancedOptions() {
             ON_SCOPE_EXIT(App::Push(std::move(options)));
 
             options->Add<SidebarEntryCallback>("CRC32"_i18n, [this](){
-                DisplayHash(hash::Type::Crc32);
+                DisplayHash(std::array{hash::Type::Crc32});
             });
             options->Add<SidebarEntryCallback>("MD5"_i18n, [this](){
-                DisplayHash(hash::Type::Md5);
+                DisplayHash(std::array{hash::Type::Md5});
             });
             options->Add<SidebarEntryCallback>("SHA1"_i18n, [this](){
-                DisplayHash(hash::Type::Sha1);
+                DisplayHash(std::array{hash::Type::Sha1});
             });
             options->Add<SidebarEntryCallback>("SHA256"_i18n, [this](){
-                DisplayHash(hash::Type::Sha256);
+                DisplayHash(std::array{hash::Type::Sha256});
+            });
+            options->Add<SidebarEntryCallback>("XXH64"_i18n, [this](){
+                DisplayHash(std::array{hash::Type::Xxh64});
+            });
+            options->Add<SidebarEntryCallback>("BLAKE3"_i18n, [this](){
+                DisplayHash(std::array{hash::Type::Blake3});
+            });
+            options->Add<SidebarEntryCallback>("All"_i18n, [this](){
+                DisplayHash(std::array{hash::Type::Crc32, hash::Type::Md5, hash::Type::Sha1, hash::Type::Sha256, hash::Type::Xxh64, hash::Type::Blake3});
             });
         });
     }
@@ -1872,6 +2170,17 @@ void FsView::DisplayAdvancedOptions() {
         m_menu->m_ignore_read_only.Set(v_out);
         m_fs->SetIgnoreReadOnly(v_out);
     });
+
+    options->Add<SidebarEntryBool>("Verify copies"_i18n, m_menu->m_verify_copy.Get(), [this](bool& v_out){
+        m_menu->m_verify_copy.Set(v_out);
+    });
+
+    // file based emummc always uses small buffers, see throttle::Emummc.
+    if (!App::IsFileBaseEmummc()) {
+        options->Add<SidebarEntryCallback>("Benchmark transfers"_i18n, [this](){
+            DisplayBenchmark();
+        });
+    }
 }
 
 Menu::Menu(u32 flags) : MenuBase{"FileBrowser"_i18n, flags} {
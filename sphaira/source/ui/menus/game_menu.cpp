@@ -6,6 +6,7 @@
 #include "i18n.hpp"
 #include "image.hpp"
 #include "swkbd.hpp"
+#include "throttle.hpp"
 
 #include "ui/menus/game_menu.hpp"
 #include "ui/menus/save_menu.hpp"
@@ -113,7 +114,7 @@ private:
 
 struct NspSource final : dump::BaseSource {
     NspSource(const std::vector<NspEntry>& entries) : m_entries{entries} {
-        m_is_file_based_emummc = App::IsFileBaseEmummc();
+
     }
 
     Result Read(const std::string& path, void* buf, s64 off, s64 size, u64* bytes_read) override {
@@ -122,11 +123,9 @@ struct NspSource final : dump::BaseSource {
         });
         R_UNLESS(it != m_entries.end(), Result_GameBadReadForDump);
 
-        const auto rc = it->Read(buf, off, size, bytes_read);
-        if (m_is_file_based_emummc) {
-            svcSleepThread(2e+6); // 2ms
-        }
-        return rc;
+        return m_throttle.Run(size, [&]{
+            return it->Read(buf, off, size, bytes_read);
+        });
     }
 
     auto GetName(const std::string& path) const -> std::string {
@@ -167,7 +166,7 @@ struct NspSource final : dump::BaseSource {
 
 private:
     std::vector<NspEntry> m_entries{};
-    bool m_is_file_based_emummc{};
+    throttle::Emummc m_throttle{};
 };
 
 Result Notify(Result rc, const std::string& error_message) {
@@ -7,7 +7,6 @@
 #include "log.hpp"
 #include "ui/nvg_util.hpp"
 #include "i18n.hpp"
-#include <cstring>
 
 namespace sphaira::ui::menu::stream {
 namespace {
@@ -19,7 +18,6 @@ enum class InstallState {
 };
 
 constexpr u64 MAX_BUFFER_SIZE = 1024ULL*1024ULL*8ULL;
-constexpr u64 MAX_BUFFER_RESERVE_SIZE = 1024ULL*1024ULL*32ULL;
 std::atomic<InstallState> INSTALL_STATE{InstallState::None};
 
 // don't use condivar here as windows mtp is very broken.
@@ -34,11 +32,10 @@ std::atomic<InstallState> INSTALL_STATE{InstallState::None};
 
 } // namespace
 
-Stream::Stream(const fs::FsPath& path, std::stop_token token) {
+Stream::Stream(const fs::FsPath& path, std::stop_token token) : m_buffer{MAX_BUFFER_SIZE} {
     m_path = path;
     m_token = token;
     m_active = true;
-    m_buffer.reserve(MAX_BUFFER_RESERVE_SIZE);
 
     mutexInit(&m_mutex);
     condvarInit(&m_can_read);
@@ -52,19 +49,21 @@ Result Stream::ReadChunk(void* buf, s64 size, u64* bytes_read) {
     );
 
     while (!m_token.stop_requested()) {
-        SCOPED_MUTEX(&m_mutex);
-        if (m_active && m_buffer.empty()) {
-            R_TRY(condvarWait(std::addressof(m_can_read), std::addressof(m_mutex)));
-        }
+        {
+            SCOPED_MUTEX(&m_mutex);
+            if (m_active && !m_buffer.Size()) {
+                R_TRY(condvarWait(std::addressof(m_can_read), std::addressof(m_mutex)));
+            }
 
-        if ((!m_active && m_buffer.empty()) || m_token.stop_requested()) {
-            break;
+            if ((!m_active && !m_buffer.Size()) || m_token.stop_requested()) {
+                break;
+            }
         }
 
-        size = std::min<s64>(size, m_buffer.size());
-        std::memcpy(buf, m_buffer.data(), size);
-        m_buffer.erase(m_buffer.begin(), m_buffer.begin() + size);
-        *bytes_read = size;
+        // only this thread reads, so the data is copied without the lock.
+        *bytes_read = m_buffer.Read(buf, size);
+
+        SCOPED_MUTEX(&m_mutex);
         return condvarWakeOne(&m_can_write);
     }
 
@@ -78,38 +77,48 @@ bool Stream::Push(const void* buf, s64 size) {
         log_write("[Stream::Push] exiting\n");
     );
 
+    // the buffer is a fixed size, so the data may be pushed in several parts.
+    auto data = static_cast<const u8*>(buf);
+
     while (!m_token.stop_requested()) {
         if (INSTALL_STATE == InstallState::Finished) {
             log_write("[Stream::Push] install has finished\n");
             return true;
         }
 
-        SCOPED_MUTEX(&m_mutex);
-        #if USE_CONDI_VAR
-        if (m_active && m_buffer.size() >= MAX_BUFFER_SIZE) {
-            R_TRY(condvarWait(std::addressof(m_can_write), std::addressof(m_mutex)));
-        }
-        #else
-        if (m_active && m_buffer.size() >= MAX_BUFFER_SIZE) {
-            // unlock the mutex and wait for 1s to bring transfer speed down to 1MiB/s.
-            log_write("[Stream::Push] buffer is full, delaying\n");
-            mutexUnlock(&m_mutex);
-            ON_SCOPE_EXIT(mutexLock(&m_mutex));
-
-            svcSleepThread(1e+9);
-        }
-        #endif
+        {
+            SCOPED_MUTEX(&m_mutex);
+            #if USE_CONDI_VAR
+            if (m_active && !m_buffer.Free()) {
+                R_TRY(condvarWait(std::addressof(m_can_write), std::addressof(m_mutex)));
+            }
+            #else
+            if (m_active && !m_buffer.Free()) {
+                // unlock the mutex and wait for 1s to bring transfer speed down to 1MiB/s.
+                log_write("[Stream::Push] buffer is full, delaying\n");
+                mutexUnlock(&m_mutex);
+                ON_SCOPE_EXIT(mutexLock(&m_mutex));
+
+                svcSleepThread(1e+9);
+            }
+            #endif
 
-        if (!m_active) {
-            log_write("[Stream::Push] file not active\n");
-            break;
+            if (!m_active) {
+                log_write("[Stream::Push] file not active\n");
+                break;
+            }
         }
 
-        const auto offset = m_buffer.size();
-        m_buffer.resize(offset + size);
-        std::memcpy(m_buffer.data() + offset, buf, size);
+        // only this thread writes, so the data is copied without the lock.
+        const auto written = m_buffer.Write(data, size);
+        data += written;
+        size -= written;
+
+        SCOPED_MUTEX(&m_mutex);
         condvarWakeOne(&m_can_read);
-        return true;
+        if (!size) {
+            return true;
+        }
     }
 
     log_write("[Stream::Push] failed to push\n");
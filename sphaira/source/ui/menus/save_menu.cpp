@@ -7,6 +7,7 @@
 #include "location.hpp"
 #include "image.hpp"
 #include "threaded_file_transfer.hpp"
+#include "throttle.hpp"
 #include "minizip_helper.hpp"
 #include "dumper.hpp"
 
@@ -1060,13 +1061,13 @@ Result Menu::BackupSaveInternal(ProgressBox* pbox, const dump::DumpLocation& loc
     }
 
     // if we dumped the save to ram, flush the data to file.
-    const auto is_file_based_emummc = App::IsFileBaseEmummc();
     if (!file_download) {
         pbox->NewTransfer("Flushing zip to file");
         R_TRY(fs->CreateFile(temp_path, mz_mem.buf.size(), 0));
 
         fs::File file;
         R_TRY(fs->OpenFile(temp_path, FsOpenMode_Write, &file));
+        throttle::Emummc throttle{};
 
         R_TRY(thread::Transfer(pbox, mz_mem.buf.size(),
             [&](void* data, s64 off, s64 size, u64* bytes_read) -> Result {
@@ -1076,11 +1077,9 @@ Result Menu::BackupSaveInternal(ProgressBox* pbox, const dump::DumpLocation& loc
                 R_SUCCEED();
             },
             [&](const void* data, s64 off, s64 size) -> Result {
-                const auto rc = file.Write(off, data, size, FsWriteOption_None);
-                if (is_file_based_emummc) {
-                    svcSleepThread(2e+6); // 2ms
-                }
-                return rc;
+                return throttle.Run(size, [&]{
+                    return file.Write(off, data, size, FsWriteOption_None);
+                });
             }
         ));
     }
@@ -5,6 +5,7 @@
 #include "defines.hpp"
 #include "log.hpp"
 #include "threaded_file_transfer.hpp"
+#include "throttle.hpp"
 #include "i18n.hpp"
 #include <cstring>
 
@@ -268,9 +269,11 @@ auto ProgressBox::ShouldExitResult() -> Result {
     R_SUCCEED();
 }
 
-auto ProgressBox::CopyFile(fs::Fs* fs_src, fs::Fs* fs_dst, const fs::FsPath& src_path, const fs::FsPath& dst_path, bool single_threaded) -> Result {
-    const auto is_file_based_emummc = App::IsFileBaseEmummc();
+auto ProgressBox::CopyFile(fs::Fs* fs_src, fs::Fs* fs_dst, const fs::FsPath& src_path, const fs::FsPath& dst_path, bool single_threaded, bool verify) -> Result {
     const auto is_both_native = fs_src->IsNative() && fs_dst->IsNative();
+    // reads and writes both feed the shared throttle controller, as they hit the same sd card.
+    throttle::Emummc read_throttle{is_both_native && App::IsFileBaseEmummc()};
+    throttle::Emummc write_throttle{read_throttle.IsEnabled()};
 
     fs::File src_file;
     R_TRY(fs_src->OpenFile(src_path, FsOpenMode_Read, &src_file));
@@ -287,27 +290,32 @@ auto ProgressBox::CopyFile(fs::Fs* fs_src, fs::Fs* fs_dst, const fs::FsPath& src
     R_TRY(fs_dst->OpenFile(dst_path, FsOpenMode_Write, &dst_file));
     R_TRY(dst_file.SetSize(src_size));
 
+    // the source is digested as it's written, so it's only read once.
+    u32 crc32{};
     R_TRY(thread::Transfer(this, src_size,
         [&](void* data, s64 off, s64 size, u64* bytes_read) -> Result {
-            const auto rc = src_file.Read(off, data, size, 0, bytes_read);
-
-            if (is_both_native && is_file_based_emummc) {
-                svcSleepThread(2e+6); // 2ms
-            }
-
-            return rc;
+            return read_throttle.Run(size, [&]{
+                return src_file.Read(off, data, size, 0, bytes_read);
+            });
         },
         [&](const void* data, s64 off, s64 size) -> Result {
-            const auto rc = dst_file.Write(off, data, size, 0);
-
-            if (is_both_native && is_file_based_emummc) {
-                svcSleepThread(2e+6); // 2ms
+            if (verify) {
+                crc32 = crc32CalculateWithSeed(crc32, data, size);
             }
 
-            return rc;
-        }, single_threaded ? thread::Mode::SingleThreaded : thread::Mode::MultiThreaded
+            return write_throttle.Run(size, [&]{
+                return dst_file.Write(off, data, size, 0);
+            });
+        }, tune::Get(fs_src, fs_dst), single_threaded ? thread::Mode::SingleThreaded : thread::Mode::MultiThreaded
     ));
 
+    if (verify) {
+        // commit the file before reading it back.
+        dst_file.Close();
+        NewTransfer("Verifying "_i18n + dst_path.toString());
+        R_TRY(thread::VerifyCrc32(this, fs_dst, dst_path, src_size, crc32, true));
+    }
+
     R_SUCCEED();
 }
 
@@ -23,6 +23,7 @@
 #include "defines.hpp"
 #include "app.hpp"
 #include <ranges>
+#include <algorithm>
 #include <cstring>
 
 namespace sphaira::usb {
@@ -32,6 +33,20 @@ constexpr u64 TRANSFER_ALIGN = 0x1000;
 constexpr u64 TRANSFER_MAX = 1024*1024*16;
 static_assert(!(TRANSFER_MAX % TRANSFER_ALIGN));
 
+// size of each transfer when a large transfer is split.
+constexpr u32 TRANSFER_CHUNK_SIZE = 1024*1024;
+static_assert(!(TRANSFER_CHUNK_SIZE % TRANSFER_ALIGN));
+
+// max time to wait for each report of a cancelled transfer.
+constexpr u64 TRANSFER_CANCEL_TIMEOUT = 1e+9;
+
+// extra space so that a read can be restarted at an aligned offset after a short read.
+constexpr u64 TRANSFER_BUFFER_SIZE = TRANSFER_MAX + TRANSFER_ALIGN;
+
+constexpr auto AlignUp(u64 off) -> u32 {
+    return (off + TRANSFER_ALIGN - 1) & ~(TRANSFER_ALIGN - 1);
+}
+
 } // namespace
 
 Base::Base(u64 transfer_timeout) {
@@ -39,7 +54,7 @@ Base::Base(u64 transfer_timeout) {
 
     m_transfer_timeout = transfer_timeout;
     ueventCreate(GetCancelEvent(), true);
-    m_aligned = std::make_unique<u8*>(new(std::align_val_t{TRANSFER_ALIGN}) u8[TRANSFER_MAX]);
+    m_aligned = std::make_unique<u8*>(new(std::align_val_t{TRANSFER_ALIGN}) u8[TRANSFER_BUFFER_SIZE]);
 }
 
 Base::~Base() {
@@ -78,6 +93,10 @@ Result Base::TransferAll(bool read, void *data, u32 size, u64 timeout) {
     R_UNLESS(!((u64)transfer_buf & 0xFFF), Result_UsbBadBufferAlign);
     R_UNLESS(size <= TRANSFER_MAX, Result_UsbBadTransferSize);
 
+    if (size > TRANSFER_CHUNK_SIZE) {
+        return TransferAllQueued(read, buf, size, timeout);
+    }
+
     while (size) {
         if (!read) {
             std::memcpy(transfer_buf, buf, size);
@@ -99,6 +118,166 @@ Result Base::TransferAll(bool read, void *data, u32 size, u64 timeout) {
     R_SUCCEED();
 }
 
+// waiting for each transfer to complete before posting the next leaves the bus
+// idle for the round trip, so up to m_max_in_flight are posted at once.
+// transfers on an endpoint complete in the order that they were posted.
+Result Base::TransferAllQueued(bool read, u8 *data, u32 size, u64 timeout) {
+    struct Urb {
+        u32 id;
+        // offset in the transfer buffer.
+        u32 off;
+        u32 size;
+        u32 transferred;
+        Result rc;
+        bool done;
+    };
+
+    auto transfer_buf = *m_aligned;
+    const auto ep = read ? UsbSessionEndpoint_Out : UsbSessionEndpoint_In;
+
+    R_TRY(IsUsbConnected(timeout));
+
+    if (!read) {
+        std::memcpy(transfer_buf, data, size);
+    }
+
+    Urb urbs[TRANSFER_MAX_IN_FLIGHT]{};
+    u32 head{};
+    u32 in_flight{};
+    // bytes completed, for reads these are at the start of the buffer.
+    u32 done{};
+    // bytes requested, including those completed.
+    u32 posted{};
+    u32 next_off{};
+
+    // on failure the transfers that are still pending write into the transfer buffer,
+    // and their reports would be picked up by the next transfer.
+    ON_SCOPE_EXIT(
+        u32 xfer_ids[TRANSFER_MAX_IN_FLIGHT];
+        u32 pending{};
+        for (u32 i = 0; i < in_flight; i++) {
+            const auto& urb = urbs[(head + i) % TRANSFER_MAX_IN_FLIGHT];
+            if (!urb.done) {
+                xfer_ids[pending++] = urb.id;
+            }
+        }
+
+        if (pending) {
+            log_write("[USB] cancelling %u pending transfers\n", pending);
+            CancelTransfers(ep, std::span{xfer_ids, pending});
+        }
+    );
+
+    while (done < size) {
+        while (in_flight < m_max_in_flight && posted < size) {
+            // every read is posted to an aligned offset, including the reads posted
+            // after a short read whilst others are still in flight.
+            // writes are posted from the data, which is aligned as every write
+            // other than the last is a full chunk.
+            if (read) {
+                next_off = AlignUp(in_flight ? next_off : done);
+            } else {
+                next_off = posted;
+            }
+
+            const auto chunk = std::min<u64>({TRANSFER_CHUNK_SIZE, size - posted, TRANSFER_BUFFER_SIZE - next_off});
+            if (!chunk) {
+                break;
+            }
+
+            // the last write may enable zlt, which must not apply to the writes before it.
+            if (!read && posted + chunk == size && in_flight) {
+                break;
+            }
+
+            auto& urb = urbs[(head + in_flight) % TRANSFER_MAX_IN_FLIGHT];
+            urb = Urb{ .off = next_off, .size = u32(chunk) };
+            R_TRY(TransferAsync(ep, transfer_buf + next_off, size - posted, chunk, std::addressof(urb.id)));
+
+            posted += chunk;
+            next_off += chunk;
+            in_flight++;
+        }
+
+        R_TRY(WaitTransferCompletion(ep, timeout));
+
+        TransferReport reports[8];
+        u32 count;
+        R_TRY(GetTransferReports(ep, reports, std::addressof(count)));
+
+        for (u32 i = 0; i < count; i++) {
+            for (u32 j = 0; j < in_flight; j++) {
+                auto& urb = urbs[(head + j) % TRANSFER_MAX_IN_FLIGHT];
+                if (!urb.done && urb.id == reports[i].id) {
+                    urb.done = true;
+                    urb.rc = reports[i].rc;
+                    urb.transferred = reports[i].transferred_size;
+                }
+            }
+        }
+
+        while (in_flight && urbs[head].done) {
+            const auto& urb = urbs[head];
+            R_TRY(urb.rc);
+            R_UNLESS(urb.transferred > 0, Result_UsbEmptyTransferSize);
+            R_UNLESS(urb.transferred <= urb.size, Result_UsbOverflowTransferSize);
+
+            if (read) {
+                // after a short read, the data of the following reads is moved down
+                // and the missing bytes are requested again.
+                if (urb.off != done) {
+                    std::memmove(transfer_buf + done, transfer_buf + urb.off, urb.transferred);
+                }
+                posted -= urb.size - urb.transferred;
+            } else {
+                // the writes after this one have already been posted.
+                R_UNLESS(urb.transferred == urb.size, Result_UsbShortTransfer);
+            }
+
+            done += urb.transferred;
+            head = (head + 1) % TRANSFER_MAX_IN_FLIGHT;
+            in_flight--;
+        }
+    }
+
+    if (read) {
+        std::memcpy(data, transfer_buf, size);
+    }
+
+    R_SUCCEED();
+}
+
+void Base::DrainTransfers(UsbSessionEndpoint ep, std::span<const u32> xfer_ids) {
+    bool reported[TRANSFER_MAX_IN_FLIGHT]{};
+    auto remaining = std::min<u32>(xfer_ids.size(), TRANSFER_MAX_IN_FLIGHT);
+
+    // the completion event may have been cleared by the failed wait, so the
+    // reports are checked before waiting, else this would wait for the timeout
+    // even though every transfer has already been reported.
+    while (remaining) {
+        TransferReport reports[8];
+        u32 count;
+        if (R_FAILED(GetTransferReports(ep, reports, std::addressof(count)))) {
+            break;
+        }
+
+        for (u32 i = 0; i < count; i++) {
+            for (u32 j = 0; j < std::size(reported); j++) {
+                if (j < xfer_ids.size() && !reported[j] && xfer_ids[j] == reports[i].id) {
+                    reported[j] = true;
+                    remaining--;
+                }
+            }
+        }
+
+        // only wait for the transfers that have not been reported.
+        if (remaining && R_FAILED(eventWait(GetCompletionEvent(ep), TRANSFER_CANCEL_TIMEOUT))) {
+            log_write("[USB] timed out waiting for %u cancelled transfers\n", remaining);
+            break;
+        }
+    }
+}
+
 } // namespace sphaira::usb
 
 #endif
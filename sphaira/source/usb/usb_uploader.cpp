@@ -3,8 +3,12 @@
 
 #include "usb/usb_uploader.hpp"
 #include "usb/tinfoil.hpp"
+#include "pipeline.hpp"
 #include "log.hpp"
 #include "defines.hpp"
+#include <atomic>
+#include <algorithm>
+#include <cstring>
 
 namespace sphaira::usb::upload {
 namespace {
@@ -36,14 +40,129 @@ const UsbHsInterfaceFilter FILTER{
 
 constexpr u8 INDEX = 0;
 
+// ranges are sent in chunks, so the memory used is capped regardless of the range size.
+constexpr s64 CHUNK_SIZE = 1024*1024*2;
+
+// fast level, as the chunk is compressed whilst the previous chunk is sent.
+constexpr int ZSTD_LEVEL = 1;
+
+// compressed chunks are sent after their header.
+constexpr s64 CHUNK_HEADER_SIZE = sizeof(tinfoil::ZstdChunkHeader);
+
+// reads the chunk into buf after prefix bytes, the space reserved for the chunk header.
+Result ReadChunk(Usb* usb, const std::string& path, s64 off, s64 size, s64 prefix, std::vector<u8>& buf) {
+    buf.resize(prefix + size);
+
+    for (s64 pos = 0; pos < size;) {
+        u64 bytes_read;
+        R_TRY(usb->Read(path, buf.data() + prefix + pos, off + pos, size - pos, &bytes_read));
+        R_UNLESS(bytes_read, Result_UsbUploadBadTransferSize);
+        pos += bytes_read;
+    }
+
+    R_SUCCEED();
+}
+
+// sets the chunk header, the chunk is replaced with the compressed data if smaller.
+// encrypted data doesn't compress, so most chunks of an nca are sent as-is.
+void CompressChunk(ZSTD_CCtx* cctx, std::vector<u8>& buf, std::vector<u8>& temp) {
+    const auto src_size = buf.size() - CHUNK_HEADER_SIZE;
+    tinfoil::ZstdChunkHeader header{
+        .size = u32(src_size),
+        .decompressed_size = u32(src_size),
+    };
+
+    if (cctx) {
+        temp.resize(CHUNK_HEADER_SIZE + ZSTD_compressBound(src_size));
+        const auto rc = ZSTD_compressCCtx(cctx, temp.data() + CHUNK_HEADER_SIZE, temp.size() - CHUNK_HEADER_SIZE, buf.data() + CHUNK_HEADER_SIZE, src_size, ZSTD_LEVEL);
+        if (!ZSTD_isError(rc) && rc < src_size) {
+            header.size = rc;
+            temp.resize(CHUNK_HEADER_SIZE + rc);
+            std::swap(buf, temp);
+        }
+    }
+
+    std::memcpy(buf.data(), &header, sizeof(header));
+}
+
+Result SendChunk(usb::UsbHs* usb, std::vector<u8>& buf, bool compress) {
+    if (!compress) {
+        return usb->TransferAll(false, buf.data(), buf.size());
+    }
+
+    // the client reads the header first, so it must be a separate transfer.
+    R_TRY(usb->TransferAll(false, buf.data(), CHUNK_HEADER_SIZE));
+    return usb->TransferAll(false, buf.data() + CHUNK_HEADER_SIZE, buf.size() - CHUNK_HEADER_SIZE);
+}
+
+// reads the range on a second thread, so that the next chunk is read whilst
+// the current chunk is sent.
+struct RangeThreadData {
+    RangeThreadData(Usb* _usb, const std::string& _path, s64 _off, s64 _size, ZSTD_CCtx* _cctx, bool _compress)
+    : usb{_usb}, path{_path}, off{_off}, size{_size}, cctx{_cctx}, compress{_compress} {}
+
+    auto GetResults() volatile -> Result {
+        R_TRY(read_result.load());
+        R_TRY(write_result.load());
+        R_SUCCEED();
+    }
+
+    Result readFuncInternal() {
+        std::vector<u8> buf;
+        std::vector<u8> temp;
+
+        for (s64 done = 0; done < size && R_SUCCEEDED(GetResults());) {
+            const auto chunk_size = std::min(CHUNK_SIZE, size - done);
+            R_TRY(ReadChunk(usb, path, off + done, chunk_size, compress ? CHUNK_HEADER_SIZE : 0, buf));
+            if (compress) {
+                CompressChunk(cctx, buf, temp);
+            }
+
+            R_TRY(queue.Push(buf, done, write_running, [this]{ return GetResults(); }));
+            done += chunk_size;
+        }
+
+        R_SUCCEED();
+    }
+
+    Usb* const usb;
+    const std::string& path;
+    const s64 off;
+    const s64 size;
+    ZSTD_CCtx* const cctx;
+    const bool compress;
+
+    pipeline::Queue<2> queue{};
+
+    std::atomic<Result> read_result{};
+    std::atomic<Result> write_result{};
+
+    std::atomic_bool read_running{true};
+    std::atomic_bool write_running{true};
+};
+
+void rangeReadFunc(void* d) {
+    auto t = static_cast<RangeThreadData*>(d);
+    t->read_result = t->readFuncInternal();
+
+    // an empty buffer tells the writer that there's no more data.
+    std::vector<u8> end;
+    t->queue.Push(end, 0, t->write_running, [t]{ return t->write_result.load(); });
+    t->read_running = false;
+}
+
 } // namespace
 
 Usb::Usb(u64 transfer_timeout) {
     m_usb = std::make_unique<usb::UsbHs>(INDEX, FILTER, transfer_timeout);
     m_usb->Init();
+    m_cctx = ZSTD_createCCtx();
 }
 
 Usb::~Usb() {
+    if (m_cctx) {
+        ZSTD_freeCCtx(m_cctx);
+    }
 }
 
 Result Usb::WaitForConnection(u64 timeout, u8 flags, std::span<const std::string> names) {
@@ -58,6 +177,9 @@ Result Usb::WaitForConnection(u64 timeout, u8 flags, std::span<const std::string
     header.magic = tinfoil::Magic_List0;
     header.nspListSize = names_list.length();
     header.flags = flags;
+    if (m_cctx) {
+        header.flags |= tinfoil::USBFlag_ZSTD;
+    }
 
     R_TRY(m_usb->TransferAll(false, &header, sizeof(header), timeout));
     R_TRY(m_usb->TransferAll(false, names_list.data(), names_list.length(), timeout));
@@ -73,13 +195,15 @@ Result Usb::PollCommands() {
     if (header.cmdId == tinfoil::USBCmdId::EXIT) {
         R_THROW(Result_UsbUploadExit);
     } else if (header.cmdId == tinfoil::USBCmdId::FILE_RANGE) {
-        return FileRangeCmd(header.dataSize);
+        return FileRangeCmd(header.dataSize, false);
+    } else if (header.cmdId == tinfoil::USBCmdId::FILE_RANGE_ZSTD) {
+        return FileRangeCmd(header.dataSize, true);
     } else {
         R_THROW(Result_UsbUploadBadCommand);
     }
 }
 
-Result Usb::FileRangeCmd(u64 data_size) {
+Result Usb::FileRangeCmd(u64 data_size, bool compress) {
     tinfoil::FileRangeCmdHeader header;
     R_TRY(m_usb->TransferAll(true, &header, sizeof(header)));
 
@@ -89,24 +213,49 @@ Result Usb::FileRangeCmd(u64 data_size) {
     // send response header.
     R_TRY(m_usb->TransferAll(false, &header, sizeof(header)));
 
-    s64 curr_off = 0x0;
-    s64 end_off = header.size;
-    s64 read_size = header.size;
+    if (!header.size) {
+        R_SUCCEED();
+    }
+
+    // small ranges aren't worth the thread.
+    if (header.size <= CHUNK_SIZE) {
+        R_TRY(ReadChunk(this, path, header.offset, header.size, compress ? CHUNK_HEADER_SIZE : 0, m_buf));
+        if (compress) {
+            CompressChunk(m_cctx, m_buf, m_zstd_buf);
+        }
+
+        return SendChunk(m_usb.get(), m_buf, compress);
+    }
+
+    RangeThreadData t_data{this, path, s64(header.offset), s64(header.size), m_cctx, compress};
+
+    const auto core_id = svcGetCurrentProcessorNumber();
+    Thread t_read{};
+    R_TRY(threadCreate(&t_read, rangeReadFunc, std::addressof(t_data), nullptr, 1024*256, 0x3B, core_id == 1 ? 2 : 1));
+    ON_SCOPE_EXIT(threadClose(&t_read));
+    R_TRY(threadStart(&t_read));
 
-    m_buf.resize(header.size);
+    t_data.write_result = [&]() -> Result {
+        std::vector<u8> buf;
 
-    while (curr_off < end_off) {
-        if (curr_off + read_size >= end_off) {
-            read_size = end_off - curr_off;
+        for (;;) {
+            s64 dummy_off;
+            R_TRY(t_data.queue.Pop(buf, dummy_off, t_data.read_running, [&]{ return t_data.GetResults(); }));
+            if (buf.empty()) {
+                R_SUCCEED();
+            }
+
+            R_TRY(SendChunk(m_usb.get(), buf, compress));
         }
+    }();
+    t_data.write_running = false;
 
-        u64 bytes_read;
-        R_TRY(Read(path, m_buf.data(), header.offset + curr_off, read_size, &bytes_read));
-        R_TRY(m_usb->TransferAll(false, m_buf.data(), bytes_read));
-        curr_off += bytes_read;
+    // wake the read thread if it's waiting to push.
+    while (R_FAILED(waitSingleHandle(t_read.handle, 1000))) {
+        t_data.queue.WakeAll();
     }
 
-    R_SUCCEED();
+    return t_data.GetResults();
 }
 
 } // namespace sphaira::usb::upload
@@ -4,6 +4,7 @@
 #include "log.hpp"
 #include "defines.hpp"
 #include <ranges>
+#include <algorithm>
 #include <cstring>
 
 Result usbDsGetSpeed(UsbDeviceSpeed *out) {
@@ -333,6 +334,39 @@ Result UsbDs::TransferAsync(UsbSessionEndpoint ep, void *buffer, u32 remaining,
     return usbDsEndpoint_PostBufferAsync(m_endpoints[ep], buffer, size, out_urb_id);
 }
 
+void UsbDs::CancelTransfers(UsbSessionEndpoint ep, std::span<const u32> xfer_ids) {
+    usbDsEndpoint_Cancel(m_endpoints[ep]);
+    DrainTransfers(ep, xfer_ids);
+    eventClear(GetCompletionEvent(ep));
+}
+
+Result UsbDs::GetTransferReports(UsbSessionEndpoint ep, std::span<TransferReport> out, u32 *out_count) {
+    UsbDsReportData report_data;
+
+    R_TRY(eventClear(GetCompletionEvent(ep)));
+    R_TRY(usbDsEndpoint_GetReportData(m_endpoints[ep], std::addressof(report_data)));
+
+    // pending transfers are also reported, only completed (0x3) or failed (0x4) are returned.
+    *out_count = 0;
+    const auto count = std::min<u32>(report_data.report_count, std::size(report_data.report));
+    for (u32 i = 0; i < count && *out_count < out.size(); i++) {
+        const auto& entry = report_data.report[i];
+
+        Result rc;
+        if (entry.urb_status == 0x3) {
+            rc = 0;
+        } else if (entry.urb_status == 0x4) {
+            rc = MAKERESULT(Module_Libnx, LibnxError_IoError);
+        } else {
+            continue;
+        }
+
+        out[(*out_count)++] = TransferReport{entry.id, rc, entry.transferredSize};
+    }
+
+    R_SUCCEED();
+}
+
 Result UsbDs::GetTransferResult(UsbSessionEndpoint ep, u32 urb_id, u32 *out_requested_size, u32 *out_transferred_size) {
     UsbDsReportData report_data;
 
@@ -4,6 +4,7 @@
 #include "log.hpp"
 #include "defines.hpp"
 #include <ranges>
+#include <algorithm>
 #include <cstring>
 
 namespace sphaira::usb {
@@ -133,10 +134,10 @@ Result UsbHs::Connect() {
     }
 
     auto& input_descs = m_s.inf.inf.input_endpoint_descs[0];
-    R_TRY(usbHsIfOpenUsbEp(&m_s, &m_endpoints[UsbSessionEndpoint_Out], 1, input_descs.wMaxPacketSize, &input_descs));
+    R_TRY(usbHsIfOpenUsbEp(&m_s, &m_endpoints[UsbSessionEndpoint_Out], TRANSFER_MAX_IN_FLIGHT, input_descs.wMaxPacketSize, &input_descs));
 
     auto& output_descs = m_s.inf.inf.output_endpoint_descs[0];
-    R_TRY(usbHsIfOpenUsbEp(&m_s, &m_endpoints[UsbSessionEndpoint_In], 1, output_descs.wMaxPacketSize, &output_descs));
+    R_TRY(usbHsIfOpenUsbEp(&m_s, &m_endpoints[UsbSessionEndpoint_In], TRANSFER_MAX_IN_FLIGHT, output_descs.wMaxPacketSize, &output_descs));
 
     m_connected = true;
     R_SUCCEED();
@@ -190,6 +191,27 @@ Result UsbHs::TransferAsync(UsbSessionEndpoint ep, void *buffer, u32 remaining,
     return usbHsEpPostBufferAsync(&m_endpoints[ep], buffer, size, 0, out_xfer_id);
 }
 
+// there's no cancel for a single endpoint, closing the interface aborts its transfers.
+// the interface is acquired again on the next transfer.
+void UsbHs::CancelTransfers(UsbSessionEndpoint ep, std::span<const u32> xfer_ids) {
+    Close();
+}
+
+Result UsbHs::GetTransferReports(UsbSessionEndpoint ep, std::span<TransferReport> out, u32 *out_count) {
+    UsbHsXferReport report_data[8];
+    const auto max = std::min<u32>(std::size(report_data), out.size());
+
+    R_TRY(eventClear(GetCompletionEvent(ep)));
+    R_TRY(usbHsEpGetXferReport(&m_endpoints[ep], report_data, max, out_count));
+
+    *out_count = std::min(*out_count, max);
+    for (u32 i = 0; i < *out_count; i++) {
+        out[i] = TransferReport{report_data[i].xferId, report_data[i].res, report_data[i].transferredSize};
+    }
+
+    R_SUCCEED();
+}
+
 Result UsbHs::GetTransferResult(UsbSessionEndpoint ep, u32 xfer_id, u32 *out_requested_size, u32 *out_transferred_size) {
     u32 count;
     UsbHsXferReport report_data[8];
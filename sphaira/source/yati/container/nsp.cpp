@@ -1,6 +1,7 @@
 #include "yati/container/nsp.hpp"
 #include "defines.hpp"
 #include "log.hpp"
+#include "buf_helper.hpp"
 #include <memory>
 #include <cstring>
 
@@ -23,38 +24,6 @@ struct Pfs0FileTableEntry {
     u32 padding;
 };
 
-// stdio-like wrapper for std::vector
-struct BufHelper {
-    BufHelper() = default;
-    BufHelper(std::span<const u8> data) {
-        write(data);
-    }
-
-    void write(const void* data, u64 size) {
-        if (offset + size >= buf.size()) {
-            buf.resize(offset + size);
-        }
-        std::memcpy(buf.data() + offset, data, size);
-        offset += size;
-    }
-
-    void write(std::span<const u8> data) {
-        write(data.data(), data.size());
-    }
-
-    void seek(u64 where_to) {
-        offset = where_to;
-    }
-
-    [[nodiscard]]
-    auto tell() const {
-        return offset;
-    }
-
-    std::vector<u8> buf;
-    u64 offset{};
-};
-
 } // namespace
 
 Result Nsp::GetCollections(Collections& out) {
@@ -1,6 +1,7 @@
 #include "yati/container/xci.hpp"
 #include "defines.hpp"
 #include "log.hpp"
+#include <cstring>
 
 namespace sphaira::yati::container {
 namespace {
@@ -78,6 +79,8 @@ Result Xci::GetCollections(Collections& out) {
                 entry.name = secure.string_table[i];
                 entry.offset = secure.data_offset + secure.file_table[i].data_offset;
                 entry.size = secure.file_table[i].data_size;
+                entry.header_hash_size = secure.file_table[i].hash_size;
+                std::memcpy(entry.header_hash, secure.file_table[i].hash, sizeof(entry.header_hash));
                 out.emplace_back(entry);
             }
 
@@ -0,0 +1,43 @@
+#include "yati/journal.hpp"
+#include "log.hpp"
+#include <cstring>
+#include <algorithm>
+
+namespace sphaira::yati::journal {
+
+auto Encode(std::span<const Entry> entries) -> std::vector<u8> {
+    const Header header{MAGIC, VERSION, (u32)entries.size()};
+    std::vector<u8> data(sizeof(header) + entries.size() * sizeof(Entry));
+    std::memcpy(data.data(), std::addressof(header), sizeof(header));
+    std::memcpy(data.data() + sizeof(header), entries.data(), entries.size() * sizeof(Entry));
+    return data;
+}
+
+auto Decode(std::span<const u8> data, std::vector<Entry>& out) -> bool {
+    out.clear();
+    if (data.size() < sizeof(Header)) {
+        return false;
+    }
+
+    Header header;
+    std::memcpy(std::addressof(header), data.data(), sizeof(header));
+    if (header.magic != MAGIC || header.version != VERSION || data.size() != sizeof(header) + u64(header.count) * sizeof(Entry)) {
+        return false;
+    }
+
+    out.resize(header.count);
+    std::memcpy(out.data(), data.data() + sizeof(header), header.count * sizeof(Entry));
+
+    // a checkpoint past the end of the nca cannot be resumed from.
+    std::erase_if(out, [](const Entry& e) {
+        if (e.committed <= 0 || e.committed > e.size) {
+            log_write("[JOURNAL] dropping entry with bad checkpoint: %zd / %zd\n", e.committed, e.size);
+            return true;
+        }
+        return false;
+    });
+
+    return true;
+}
+
+} // namespace sphaira::yati::journal
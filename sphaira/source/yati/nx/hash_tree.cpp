@@ -0,0 +1,280 @@
+#include "yati/nx/hash_tree.hpp"
+#include "defines.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <span>
+
+namespace sphaira::nca {
+namespace {
+
+constexpr u32 IVFC_MAGIC = 0x43465649;
+constexpr u32 IVFC_MAX_LEVEL = 6;
+// limits the block size, as a corrupt header could otherwise request huge blocks.
+constexpr u32 MAX_BLOCK_SIZE_LOG2 = 24;
+// size of each decrypt chunk, this avoids allocating the full buffer size.
+constexpr s64 DECRYPT_CHUNK_SIZE = 1024 * 256;
+
+constexpr u8 g_zero_block[0x1000]{};
+
+auto IsZero(std::span<const u8> data) -> bool {
+    return std::ranges::all_of(data, [](auto e){ return e == 0; });
+}
+
+auto GetHashTypeStr(u8 hash_type) -> const char* {
+    switch (hash_type) {
+        case HashType_HierarchicalSha256: return "HierarchicalSha256";
+        case HashType_HierarchicalIntegrity: return "HierarchicalIntegrity";
+    }
+    return "Unknown";
+}
+
+} // namespace
+
+Result HashTreeVerifier::Init(const Header& header, const keys::KeyEntry& key, s64 max_memory) {
+    m_key = key;
+    m_sections.clear();
+
+    for (u8 i = 0; i < NCA_SECTION_TOTAL; i++) {
+        const auto& entry = header.fs_table[i];
+        if (!entry.media_start_offset || entry.media_end_offset <= entry.media_start_offset) {
+            continue;
+        }
+
+        const auto& fs_header = header.fs_header[i];
+        u8 hash[SHA256_HASH_SIZE];
+        sha256CalculateHash(hash, std::addressof(fs_header), sizeof(fs_header));
+        if (std::memcmp(hash, header.fs_header_hash[i].sha256, sizeof(hash))) {
+            log_write("[VERIFY] section: %u fs header hash mismatch\n", i);
+            R_THROW(Result_YatiInvalidNcaHashTree);
+        }
+
+        if (fs_header.encryption_type != EncryptionType_None && fs_header.encryption_type != EncryptionType_AesCtr) {
+            log_write("[VERIFY] section: %u skipping encryption type: %u\n", i, fs_header.encryption_type);
+            continue;
+        }
+
+        if (!IsZero(fs_header.spares_info) || !IsZero(fs_header.compression_info)) {
+            log_write("[VERIFY] section: %u skipping sparse / compressed section\n", i);
+            continue;
+        }
+
+        Section section{};
+        section.index = i;
+        section.hash_type = fs_header.hash_type;
+        section.encryption_type = fs_header.encryption_type;
+        section.ctr = fs_header.section_ctr;
+        section.offset = s64(entry.media_start_offset) * 0x200;
+        section.size = s64(entry.media_end_offset - entry.media_start_offset) * 0x200;
+
+        if (fs_header.hash_type == HashType_HierarchicalSha256) {
+            const auto& data = fs_header.hash_data.hierarchical_sha256_data;
+            if (data.layer_count != 2 || !data.block_size || data.block_size > (1U << MAX_BLOCK_SIZE_LOG2)) {
+                log_write("[VERIFY] section: %u skipping invalid sha256 layers: %u block: %u\n", i, data.layer_count, data.block_size);
+                continue;
+            }
+
+            section.master_hash.assign(data.master_hash, data.master_hash + sizeof(data.master_hash));
+            // the hash table is hashed as a single block.
+            section.levels.emplace_back(Level{ .offset = s64(data.hash_layer.offset), .size = s64(data.hash_layer.size), .block_size = s64(data.hash_layer.size) });
+            section.levels.emplace_back(Level{ .offset = s64(data.pfs0_layer.offset), .size = s64(data.pfs0_layer.size), .block_size = data.block_size });
+        } else if (fs_header.hash_type == HashType_HierarchicalIntegrity) {
+            const auto& info = fs_header.hash_data.integrity_meta_info;
+            const auto level_count = info.info_level_hash.max_layers - 1;
+            if (info.magic != IVFC_MAGIC || info.master_hash_size != sizeof(info.master_hash) || !level_count || level_count > IVFC_MAX_LEVEL) {
+                log_write("[VERIFY] section: %u skipping invalid ivfc header\n", i);
+                continue;
+            }
+
+            section.master_hash.assign(info.master_hash, info.master_hash + sizeof(info.master_hash));
+            for (u32 j = 0; j < level_count; j++) {
+                const auto& level = info.info_level_hash.levels[j];
+                if (level.block_size > MAX_BLOCK_SIZE_LOG2) {
+                    section.levels.clear();
+                    break;
+                }
+
+                section.levels.emplace_back(Level{ .offset = s64(level.logical_offset), .size = s64(level.hash_data_size), .block_size = s64(1) << level.block_size, .pad = true });
+            }
+        } else {
+            log_write("[VERIFY] section: %u skipping hash type: %u\n", i, fs_header.hash_type);
+            continue;
+        }
+
+        // each level must be within the section and come after the level that it's verified by.
+        // only two levels are kept in memory at once, the level being verified and its hash table.
+        s64 peak_memory{};
+        bool valid = !section.levels.empty() && section.levels[0].size <= section.levels[0].block_size;
+        for (u32 j = 0; valid && j < section.levels.size(); j++) {
+            auto& level = section.levels[j];
+            level.keep = j + 1 < section.levels.size();
+            valid = level.size > 0 && level.block_size > 0 && level.offset >= 0 && level.offset + level.size <= section.size;
+
+            if (j) {
+                const auto& prev = section.levels[j - 1];
+                valid &= level.offset >= prev.offset + prev.size;
+                peak_memory = std::max(peak_memory, prev.size + (level.keep ? level.size : 0));
+            }
+        }
+
+        if (!valid) {
+            log_write("[VERIFY] section: %u skipping invalid hash levels\n", i);
+            continue;
+        }
+
+        if (peak_memory > max_memory) {
+            log_write("[VERIFY] section: %u skipping as hash tables are too large: %zd\n", i, peak_memory);
+            continue;
+        }
+
+        for (auto& level : section.levels) {
+            sha256ContextCreate(std::addressof(level.ctx));
+        }
+
+        log_write("[VERIFY] section: %u type: %s levels: %zu offset: %zd size: %zd\n", i, GetHashTypeStr(section.hash_type), section.levels.size(), section.offset, section.size);
+        m_sections.emplace_back(std::move(section));
+    }
+
+    R_SUCCEED();
+}
+
+Result HashTreeVerifier::Update(s64 off, const void* data, s64 size, bool plaintext) {
+    for (auto& section : m_sections) {
+        const auto start = std::max(off, section.offset);
+        const auto end = std::min(off + size, section.offset + section.size);
+        if (start >= end || section.levels.empty()) {
+            continue;
+        }
+
+        const auto tick = armGetSystemTick();
+        const auto ptr = static_cast<const u8*>(data) + (start - off);
+
+        if (plaintext || section.encryption_type == EncryptionType_None) {
+            R_TRY(UpdateSection(section, start - section.offset, ptr, end - start));
+        } else {
+            // the counter is created at the aligned offset and then advanced to the start.
+            const auto aligned = start & ~s64(0xF);
+            const auto ctr_hi = std::byteswap(section.ctr);
+            const auto ctr_lo = std::byteswap(u64(aligned) >> 4);
+            u8 counter[0x10];
+            std::memcpy(counter + 0x0, &ctr_hi, 0x8);
+            std::memcpy(counter + 0x8, &ctr_lo, 0x8);
+
+            Aes128CtrContext ctx;
+            aes128CtrContextCreate(&ctx, m_key.key, counter);
+            if (start != aligned) {
+                u8 skip[0x10];
+                aes128CtrCrypt(&ctx, skip, skip, start - aligned);
+            }
+
+            m_temp.resize(std::min(DECRYPT_CHUNK_SIZE, end - start));
+            for (s64 pos = start; pos < end && !section.levels.empty();) {
+                const auto chunk_size = std::min<s64>(m_temp.size(), end - pos);
+                aes128CtrCrypt(&ctx, m_temp.data(), ptr + (pos - start), chunk_size);
+                R_TRY(UpdateSection(section, pos - section.offset, m_temp.data(), chunk_size));
+                pos += chunk_size;
+            }
+        }
+
+        section.hashed += end - start;
+        section.ticks += armGetSystemTick() - tick;
+    }
+
+    R_SUCCEED();
+}
+
+void HashTreeVerifier::LogStats() const {
+    for (const auto& section : m_sections) {
+        const auto ns = armTicksToNs(section.ticks);
+        const auto speed = ns ? (double(section.hashed) / 1024.0 / 1024.0) / (double(ns) / 1e9) : 0.0;
+        log_write("[VERIFY] section: %u type: %s hashed: %zd / %zd bytes time: %zu ms speed: %.2f MiB/s%s\n",
+            section.index, GetHashTypeStr(section.hash_type), section.hashed, section.size, ns / 1000000, speed,
+            section.levels.empty() ? " (incomplete)" : "");
+    }
+}
+
+Result HashTreeVerifier::UpdateSection(Section& section, s64 off, const u8* data, s64 size) {
+    for (u32 i = 0; i < section.levels.size(); i++) {
+        const auto& level = section.levels[i];
+        const auto start = std::max(off, level.offset);
+        const auto end = std::min(off + size, level.offset + level.size);
+        if (start >= end) {
+            continue;
+        }
+
+        // data must be passed in order, stop verifying the section if it wasn't.
+        if (start != level.offset + level.processed) {
+            log_write("[VERIFY] section: %u level: %u unexpected offset: %zd vs %zd, disabling\n", section.index, i, start, level.offset + level.processed);
+            section.levels.clear();
+            R_SUCCEED();
+        }
+
+        R_TRY(UpdateLevel(section, i, data + (start - off), end - start));
+    }
+
+    R_SUCCEED();
+}
+
+Result HashTreeVerifier::UpdateLevel(Section& section, u32 level_index, const u8* data, s64 size) {
+    auto& level = section.levels[level_index];
+
+    while (size > 0) {
+        const auto chunk_size = std::min(size, level.block_size - level.block_pos);
+        sha256ContextUpdate(std::addressof(level.ctx), data, chunk_size);
+        if (level.keep) {
+            level.data.insert(level.data.end(), data, data + chunk_size);
+        }
+
+        level.block_pos += chunk_size;
+        level.processed += chunk_size;
+        data += chunk_size;
+        size -= chunk_size;
+
+        if (level.block_pos != level.block_size && level.processed != level.size) {
+            continue;
+        }
+
+        // the first level is verified by the master hash.
+        const auto& table = level_index ? section.levels[level_index - 1].data : section.master_hash;
+        const auto table_off = level.block_index * SHA256_HASH_SIZE;
+        R_UNLESS(table_off + SHA256_HASH_SIZE <= s64(table.size()), Result_YatiInvalidNcaHashTree);
+        const auto expected = table.data() + table_off;
+
+        // ivfc pads the last block with zeros, however some tools hash it as-is.
+        u8 hash[SHA256_HASH_SIZE];
+        auto padded_ctx = level.ctx;
+        sha256ContextGetHash(std::addressof(level.ctx), hash);
+        bool match = !std::memcmp(hash, expected, sizeof(hash));
+
+        if (!match && level.pad && level.block_pos != level.block_size) {
+            for (auto pad = level.block_size - level.block_pos; pad > 0;) {
+                const auto pad_size = std::min<s64>(pad, sizeof(g_zero_block));
+                sha256ContextUpdate(std::addressof(padded_ctx), g_zero_block, pad_size);
+                pad -= pad_size;
+            }
+
+            sha256ContextGetHash(std::addressof(padded_ctx), hash);
+            match = !std::memcmp(hash, expected, sizeof(hash));
+        }
+
+        if (!match) {
+            log_write("[VERIFY] section: %u level: %u block: %zd hash mismatch\n", section.index, level_index, level.block_index);
+            R_THROW(Result_YatiInvalidNcaHashTree);
+        }
+
+        sha256ContextCreate(std::addressof(level.ctx));
+        level.block_pos = 0;
+        level.block_index++;
+
+        // once a level is verified, its hash table is no longer needed.
+        if (level.processed == level.size && level_index) {
+            std::vector<u8>().swap(section.levels[level_index - 1].data);
+        }
+    }
+
+    R_SUCCEED();
+}
+
+} // namespace sphaira::nca
@@ -5,12 +5,18 @@
 #include "usb/tinfoil.hpp"
 #include "log.hpp"
 #include <ranges>
+#include <algorithm>
+#include <cstring>
 
 namespace sphaira::yati::source {
 namespace {
 
 namespace tinfoil = usb::tinfoil;
 
+// each file range command is a round trip to the host, so small reads and
+// the reads of the install pipeline are extended to at least this size.
+constexpr s64 READ_AHEAD_SIZE = 1024*1024*8;
+
 } // namespace
 
 Usb::Usb(u64 transfer_timeout) {
@@ -19,6 +25,9 @@ Usb::Usb(u64 transfer_timeout) {
 }
 
 Usb::~Usb() {
+    if (m_dctx) {
+        ZSTD_freeDCtx(m_dctx);
+    }
 }
 
 Result Usb::WaitForConnection(u64 timeout, std::vector<std::string>& out_names) {
@@ -29,6 +38,11 @@ Result Usb::WaitForConnection(u64 timeout, std::vector<std::string>& out_names)
     m_flags = header.flags;
     log_write("[USB] got header, flags: 0x%X\n", m_flags);
 
+    // fallback to uncompressed ranges if the context cannot be created.
+    if ((m_flags & tinfoil::USBFlag_ZSTD) && !m_dctx && !(m_dctx = ZSTD_createDCtx())) {
+        m_flags &= ~tinfoil::USBFlag_ZSTD;
+    }
+
     std::vector<char> names(header.nspListSize);
     R_TRY(m_usb->TransferAll(true, names.data(), names.size(), timeout));
 
@@ -50,6 +64,15 @@ Result Usb::WaitForConnection(u64 timeout, std::vector<std::string>& out_names)
 
 void Usb::SetFileNameForTranfser(const std::string& name) {
     m_transfer_file_name = name;
+    SetReadAheadLimit(0);
+}
+
+// hosts send the range as-is, reading past the end of the file is not possible.
+// so data is only read ahead up to the limit.
+void Usb::SetReadAheadLimit(s64 end) {
+    m_read_ahead_limit = end;
+    m_window_off = 0;
+    m_window.clear();
 }
 
 Result Usb::SendCmdHeader(u32 cmdId, size_t dataSize, u64 timeout) {
@@ -63,14 +86,14 @@ Result Usb::SendCmdHeader(u32 cmdId, size_t dataSize, u64 timeout) {
     return m_usb->TransferAll(false, &header, sizeof(header), timeout);
 }
 
-Result Usb::SendFileRangeCmd(u64 off, u64 size, u64 timeout) {
+Result Usb::SendFileRangeCmd(u32 cmdId, u64 off, u64 size, u64 timeout) {
     tinfoil::FileRangeCmdHeader fRangeHeader;
     fRangeHeader.size = size;
     fRangeHeader.offset = off;
     fRangeHeader.nspNameLen = m_transfer_file_name.size();
     fRangeHeader.padding = 0;
 
-    R_TRY(SendCmdHeader(tinfoil::USBCmdId::FILE_RANGE, sizeof(fRangeHeader) + fRangeHeader.nspNameLen, timeout));
+    R_TRY(SendCmdHeader(cmdId, sizeof(fRangeHeader) + fRangeHeader.nspNameLen, timeout));
     R_TRY(m_usb->TransferAll(false, &fRangeHeader, sizeof(fRangeHeader), timeout));
     R_TRY(m_usb->TransferAll(false, m_transfer_file_name.data(), fRangeHeader.nspNameLen, timeout));
 
@@ -91,12 +114,73 @@ bool Usb::IsStream() const {
 
 Result Usb::Read(void* buf, s64 off, s64 size, u64* bytes_read) {
     R_TRY(GetOpenResult());
-    R_TRY(SendFileRangeCmd(off, size, m_usb->GetTransferTimeout()));
-    R_TRY(m_usb->TransferAll(true, buf, size));
+
+    if (off >= m_window_off && off + size <= m_window_off + s64(m_window.size())) {
+        std::memcpy(buf, m_window.data() + (off - m_window_off), size);
+        *bytes_read = size;
+        R_SUCCEED();
+    }
+
+    // stream installs may expect the exact ranges.
+    const auto window_size = std::min(READ_AHEAD_SIZE, m_read_ahead_limit - off);
+    if (!IsStream() && size < window_size) {
+        m_window.resize(window_size);
+        m_window_off = off;
+
+        Result rc;
+        if (R_FAILED(rc = ReadRange(m_window.data(), off, window_size))) {
+            m_window.clear();
+            R_THROW(rc);
+        }
+
+        std::memcpy(buf, m_window.data(), size);
+    } else {
+        R_TRY(ReadRange(buf, off, size));
+    }
+
     *bytes_read = size;
     R_SUCCEED();
 }
 
+Result Usb::ReadRange(void* buf, s64 off, s64 size) {
+    if (m_flags & tinfoil::USBFlag_ZSTD) {
+        return ReadRangeZstd(buf, off, size);
+    }
+
+    R_TRY(SendFileRangeCmd(tinfoil::USBCmdId::FILE_RANGE, off, size, m_usb->GetTransferTimeout()));
+    return m_usb->TransferAll(true, buf, size);
+}
+
+// each chunk is decompressed directly into buf, incompressible chunks are read as-is.
+Result Usb::ReadRangeZstd(void* buf, s64 off, s64 size) {
+    R_TRY(SendFileRangeCmd(tinfoil::USBCmdId::FILE_RANGE_ZSTD, off, size, m_usb->GetTransferTimeout()));
+
+    auto dst = static_cast<u8*>(buf);
+    for (s64 done = 0; done < size;) {
+        tinfoil::ZstdChunkHeader header;
+        R_TRY(m_usb->TransferAll(true, &header, sizeof(header)));
+        R_UNLESS(header.decompressed_size && header.decompressed_size <= size - done, Result_UsbZstdError);
+        R_UNLESS(header.size && header.size <= header.decompressed_size, Result_UsbZstdError);
+
+        if (header.size == header.decompressed_size) {
+            R_TRY(m_usb->TransferAll(true, dst + done, header.size));
+        } else {
+            m_zstd_buf.resize(header.size);
+            R_TRY(m_usb->TransferAll(true, m_zstd_buf.data(), header.size));
+
+            const auto rc = ZSTD_decompressDCtx(m_dctx, dst + done, header.decompressed_size, m_zstd_buf.data(), header.size);
+            if (ZSTD_isError(rc) || rc != header.decompressed_size) {
+                log_write("[USB] failed to decompress chunk: %s\n", ZSTD_isError(rc) ? ZSTD_getErrorName(rc) : "bad size");
+                R_THROW(Result_UsbZstdError);
+            }
+        }
+
+        done += header.decompressed_size;
+    }
+
+    R_SUCCEED();
+}
+
 } // namespace sphaira::yati::source
 
 #endif
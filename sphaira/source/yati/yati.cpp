@@ -4,6 +4,8 @@
 #include "yati/container/nsp.hpp"
 #include "yati/container/xci.hpp"
 
+#include "yati/scheduler.hpp"
+#include "yati/journal.hpp"
 #include "yati/nx/ncz.hpp"
 #include "yati/nx/nca.hpp"
 #include "yati/nx/ncm.hpp"
@@ -11,16 +13,21 @@
 #include "yati/nx/es.hpp"
 #include "yati/nx/keys.hpp"
 #include "yati/nx/crypto.hpp"
+#include "yati/nx/hash_tree.hpp"
 
 #include "ui/progress_box.hpp"
 #include "app.hpp"
 #include "i18n.hpp"
 #include "log.hpp"
+#include "throttle.hpp"
+#include "buf_helper.hpp"
+#include "pipeline.hpp"
 
 #include <zstd.h>
 #include <minIni.h>
 #include <algorithm>
 #include <atomic>
+#include <memory>
 
 namespace sphaira::yati {
 namespace {
@@ -32,6 +39,9 @@ constexpr NcmStorageId NCM_STORAGE_IDS[]{
 
 constexpr u32 KEYGEN_LIMIT = 0x20;
 
+// max number of nca's that are installed at the same time.
+constexpr u32 NCA_INSTALL_MAX_PARALLEL = 2;
+
 struct NcaCollection : container::CollectionEntry {
     nca::Header header{};
     // NcmContentType
@@ -42,6 +52,9 @@ struct NcaCollection : container::CollectionEntry {
     u8 hash[SHA256_HASH_SIZE]{};
     // set true if nca has been modified.
     bool modified{};
+    // set if the crypto conversion has to wait for the ticket to be read.
+    // the header is patched once the nca has been installed.
+    bool deferred_crypto{};
     // set if the nca was not installed.
     bool skipped{};
 };
@@ -72,74 +85,344 @@ struct TikCollection {
     bool required{};
     // set if ticket has already been patched.
     bool patched{};
+    // set once the ticket data has been read.
+    bool loaded{};
+};
+
+// see journal.hpp.
+constexpr fs::FsPath JOURNAL_PATH{"/config/sphaira/install_journal.bin"};
+
+struct Journal {
+    Journal() {
+        mutexInit(std::addressof(mutex));
+    }
+
+    void Load() {
+        SCOPED_MUTEX(std::addressof(mutex));
+        entries.clear();
+
+        std::vector<u8> data;
+        if (R_FAILED(fs::FsNativeSd().read_entire_file(JOURNAL_PATH, data))) {
+            return;
+        }
+
+        if (!journal::Decode(data, entries)) {
+            log_write("[JOURNAL] ignoring invalid journal\n");
+            return;
+        }
+
+        log_write("[JOURNAL] loaded %zu entries\n", entries.size());
+    }
+
+    auto Find(const NcmContentId& content_id, NcmStorageId storage_id, s64 size, journal::Entry& out) -> bool {
+        SCOPED_MUTEX(std::addressof(mutex));
+        const auto it = std::ranges::find_if(entries, [&](auto& e){
+            return !std::memcmp(std::addressof(e.content_id), std::addressof(content_id), sizeof(content_id)) && e.storage_id == storage_id && e.size == size;
+        });
+
+        if (it == entries.end()) {
+            return false;
+        }
+
+        out = *it;
+        return true;
+    }
+
+    auto Has(const NcmPlaceHolderId& placeholder_id) -> bool {
+        SCOPED_MUTEX(std::addressof(mutex));
+        return FindPlaceHolder(placeholder_id) != entries.end();
+    }
+
+    Result Update(const journal::Entry& entry) {
+        SCOPED_MUTEX(std::addressof(mutex));
+        if (auto it = FindPlaceHolder(entry.placeholder_id); it != entries.end()) {
+            *it = entry;
+        } else {
+            entries.emplace_back(entry);
+        }
+
+        return Save();
+    }
+
+    Result Remove(const NcmPlaceHolderId& placeholder_id) {
+        SCOPED_MUTEX(std::addressof(mutex));
+        if (auto it = FindPlaceHolder(placeholder_id); it != entries.end()) {
+            entries.erase(it);
+            return Save();
+        }
+
+        R_SUCCEED();
+    }
+
+    // removes all entries, returning them so that the placeholders can be deleted.
+    auto Clear() -> std::vector<journal::Entry> {
+        SCOPED_MUTEX(std::addressof(mutex));
+        fs::FsNativeSd().DeleteFile(JOURNAL_PATH);
+        return std::exchange(entries, {});
+    }
+
+private:
+    auto FindPlaceHolder(const NcmPlaceHolderId& placeholder_id) -> std::vector<journal::Entry>::iterator {
+        return std::ranges::find_if(entries, [&](auto& e){
+            return !std::memcmp(std::addressof(e.placeholder_id), std::addressof(placeholder_id), sizeof(placeholder_id));
+        });
+    }
+
+    // must be called with the mutex locked.
+    Result Save() {
+        if (entries.empty()) {
+            fs::FsNativeSd().DeleteFile(JOURNAL_PATH);
+            R_SUCCEED();
+        }
+
+        return fs::FsNativeSd().write_entire_file(JOURNAL_PATH, journal::Encode(entries));
+    }
+
+private:
+    Mutex mutex{};
+    std::vector<journal::Entry> entries{};
 };
 
 struct Yati;
+using NcaScheduler = Scheduler<NcaCollection>;
 
 const u64 INFLATE_BUFFER_MAX = 1024*1024*4;
+constexpr int READ_THREAD_CORE = 1;
+constexpr int DECOMPRESS_THREAD_CORE = 2;
+constexpr int WRITE_THREAD_CORE = 0;
+
+// blocks larger than this are decompressed using the stream api.
+const u64 NCZ_BLOCK_MAX_PARALLEL_SIZE = INFLATE_BUFFER_MAX;
+
+// max memory used to hold the hash tables of a section whilst it's being verified.
+constexpr s64 HASH_TREE_MAX_MEMORY = 1024*1024*64;
+constexpr s64 HASH_TREE_MAX_MEMORY_APPLET = 1024*1024*8;
+
+// buffers are swapped between the pipeline stages rather than copied.
+// these stats are logged once an nca has been installed.
+struct BufferStats {
+    // bytes memcpy'd / not memcpy'd by the decompress stage.
+    u64 copied{};
+    u64 copy_avoided{};
+};
 
-struct ThreadBuffer {
-    ThreadBuffer() {
-        buf.reserve(INFLATE_BUFFER_MAX);
+struct PipelineStats {
+    void Log() const {
+        read.Log("read");
+        decompress.Log("decompress");
+        write.Log("write");
     }
 
-    std::vector<u8> buf;
-    s64 off;
+    pipeline::StageStats read{};
+    pipeline::StageStats decompress{};
+    pipeline::StageStats write{};
 };
 
-template<std::size_t Size>
-struct RingBuf {
-private:
-    ThreadBuffer buf[Size]{};
-    unsigned r_index{};
-    unsigned w_index{};
+// max number of threads used to decompress ncz blocks, including the decompress thread.
+constexpr u32 NCZ_BLOCK_MAX_THREADS = 3;
+
+// each ncz block is a separate zstd frame, which allows for them to be
+// decompressed in parallel.
+// the decompress thread queues up a batch of blocks, which are then decompressed
+// by itself and the worker threads directly into the output buffer, in block order.
+struct NczBlockDecompressor {
+    struct Job {
+        std::vector<u8> in{};
+        // points into the output buffer, set before Run() is called.
+        u8* out{};
+        u64 decompressed_size{};
+        bool compressed{};
+        Result rc{};
+    };
+
+    NczBlockDecompressor() {
+        mutexInit(std::addressof(mutex));
+        condvarInit(std::addressof(can_work));
+        condvarInit(std::addressof(work_done));
+    }
+
+    ~NczBlockDecompressor() {
+        mutexLock(std::addressof(mutex));
+        quit = true;
+        condvarWakeAll(std::addressof(can_work));
+        mutexUnlock(std::addressof(mutex));
+
+        for (u32 i = 0; i < thread_count; i++) {
+            threadWaitForExit(std::addressof(threads[i]));
+            threadClose(std::addressof(threads[i]));
+        }
+
+        for (auto dctx : dctxs) {
+            ZSTD_freeDCtx(dctx);
+        }
+    }
+
+    Result Create() {
+        for (u32 i = 0; i < std::size(dctxs); i++) {
+            dctxs[i] = ZSTD_createDCtx();
+            R_UNLESS(dctxs[i], Result_YatiInvalidNczZstdError);
+        }
+
+        // the worker threads run on the read / write thread cores as those
+        // threads spend most of their time waiting on io.
+        for (u32 i = 0; i < std::size(threads); i++) {
+            auto& args = thread_args[i];
+            args.self = this;
+            args.slot = i + 1;
 
-    static_assert((sizeof(RingBuf::buf) & (sizeof(RingBuf::buf) - 1)) == 0, "Must be power of 2!");
+            const auto core = WORKER_CORES[i % std::size(WORKER_CORES)];
+            R_TRY(threadCreate(std::addressof(threads[i]), WorkerFunc, std::addressof(args), nullptr, 1024*64, PRIO_PREEMPTIVE, core));
 
-public:
-    void ringbuf_reset() {
-        this->r_index = this->w_index;
+            if (const auto rc = threadStart(std::addressof(threads[i])); R_FAILED(rc)) {
+                threadClose(std::addressof(threads[i]));
+                R_THROW(rc);
+            }
+
+            thread_count++;
+        }
+
+        R_SUCCEED();
     }
 
-    unsigned ringbuf_capacity() const {
-        return sizeof(this->buf) / sizeof(this->buf[0]);
+    // the job that is currently being filled by the decompress thread.
+    auto GetPendingJob() -> Job& {
+        return jobs[job_count];
+    }
+
+    void Push() {
+        job_count++;
+    }
+
+    auto IsFull() const -> bool {
+        return job_count == std::size(jobs);
+    }
+
+    auto GetJobs() -> std::span<Job> {
+        return {jobs, job_count};
+    }
+
+    void Clear() {
+        for (u32 i = 0; i < job_count; i++) {
+            jobs[i].in.clear();
+            jobs[i].out = nullptr;
+        }
+        job_count = 0;
+
+        SCOPED_MUTEX(std::addressof(mutex));
+        batch_size = 0;
+        next_job = 0;
+    }
+
+    // decompresses all queued jobs, returns once every job has completed.
+    Result Run() {
+        mutexLock(std::addressof(mutex));
+        batch_size = job_count;
+        next_job = 0;
+        done_count = 0;
+        condvarWakeAll(std::addressof(can_work));
+
+        // help out with the batch.
+        u32 index;
+        while (TakeJob(index)) {
+            mutexUnlock(std::addressof(mutex));
+            RunJob(0, jobs[index]);
+            mutexLock(std::addressof(mutex));
+            done_count++;
+        }
+
+        while (done_count != batch_size) {
+            condvarWait(std::addressof(work_done), std::addressof(mutex));
+        }
+        mutexUnlock(std::addressof(mutex));
+
+        for (u32 i = 0; i < job_count; i++) {
+            R_TRY(jobs[i].rc);
+        }
+
+        R_SUCCEED();
     }
 
-    unsigned ringbuf_size() const {
-        return (this->w_index - this->r_index) % (ringbuf_capacity() * 2U);
+private:
+    static constexpr int WORKER_CORES[]{ READ_THREAD_CORE, WRITE_THREAD_CORE };
+
+    struct ThreadArgs {
+        NczBlockDecompressor* self;
+        u32 slot;
+    };
+
+    static void WorkerFunc(void* d) {
+        auto args = static_cast<ThreadArgs*>(d);
+        args->self->WorkerLoop(args->slot);
     }
 
-    unsigned ringbuf_free() const {
-        return ringbuf_capacity() - ringbuf_size();
+    void WorkerLoop(u32 slot) {
+        mutexLock(std::addressof(mutex));
+        while (!quit) {
+            u32 index;
+            if (TakeJob(index)) {
+                mutexUnlock(std::addressof(mutex));
+                RunJob(slot, jobs[index]);
+                mutexLock(std::addressof(mutex));
+
+                if (++done_count == batch_size) {
+                    condvarWakeAll(std::addressof(work_done));
+                }
+            } else {
+                condvarWait(std::addressof(can_work), std::addressof(mutex));
+            }
+        }
+        mutexUnlock(std::addressof(mutex));
     }
 
-    void ringbuf_push(std::vector<u8>& buf_in, s64 off_in) {
-        auto& value = this->buf[this->w_index % ringbuf_capacity()];
-        value.off = off_in;
-        std::swap(value.buf, buf_in);
+    // must be called with the mutex locked.
+    auto TakeJob(u32& index) -> bool {
+        if (next_job >= batch_size) {
+            return false;
+        }
 
-        this->w_index = (this->w_index + 1U) % (ringbuf_capacity() * 2U);
+        index = next_job++;
+        return true;
     }
 
-    void ringbuf_pop(std::vector<u8>& buf_out, s64& off_out) {
-        auto& value = this->buf[this->r_index % ringbuf_capacity()];
-        off_out = value.off;
-        std::swap(value.buf, buf_out);
+    void RunJob(u32 slot, Job& job) {
+        job.rc = 0;
+
+        if (!job.compressed) {
+            std::memcpy(job.out, job.in.data(), job.in.size());
+            return;
+        }
 
-        this->r_index = (this->r_index + 1U) % (ringbuf_capacity() * 2U);
+        const auto res = ZSTD_decompressDCtx(dctxs[slot], job.out, job.decompressed_size, job.in.data(), job.in.size());
+        if (ZSTD_isError(res) || res != job.decompressed_size) {
+            log_write("[NCZ] ZSTD_decompressDCtx() size: %zu res: %zd msg: %s\n", job.in.size(), res, ZSTD_getErrorName(res));
+            job.rc = Result_YatiInvalidNczZstdError;
+        }
     }
+
+private:
+    Mutex mutex{};
+    CondVar can_work{};
+    CondVar work_done{};
+
+    Thread threads[NCZ_BLOCK_MAX_THREADS - 1]{};
+    ThreadArgs thread_args[NCZ_BLOCK_MAX_THREADS - 1]{};
+    ZSTD_DCtx* dctxs[NCZ_BLOCK_MAX_THREADS]{};
+    u32 thread_count{};
+
+    Job jobs[NCZ_BLOCK_MAX_THREADS]{};
+    // only accessed by the decompress thread.
+    u32 job_count{};
+    // the below are protected by the mutex.
+    u32 batch_size{};
+    u32 next_job{};
+    u32 done_count{};
+    bool quit{};
 };
 
 struct ThreadData {
     ThreadData(Yati* _yati, std::span<TikCollection> _tik, NcaCollection* _nca)
     : yati{_yati}, tik{_tik}, nca{_nca} {
-        mutexInit(std::addressof(read_mutex));
-        mutexInit(std::addressof(write_mutex));
-
-        condvarInit(std::addressof(can_read));
-        condvarInit(std::addressof(can_decompress));
-        condvarInit(std::addressof(can_decompress_write));
-        condvarInit(std::addressof(can_write));
+        mutexInit(std::addressof(checkpoint_mutex));
 
         ueventCreate(&m_uevent_done, false);
         ueventCreate(&m_uevent_progres, true);
@@ -150,19 +433,21 @@ struct ThreadData {
 
         // reduce buffer size to preve
         if (App::IsFileBaseEmummc()) {
-            read_buffer_size = 1024 * 512;
+            read_buffer_size = pipeline::SMALL_BUFFER_SIZE;
         } else {
-            read_buffer_size = 1024*1024*4;
+            read_buffer_size = pipeline::NORMAL_BUFFER_SIZE;
         }
 
         max_buffer_size = std::max(read_buffer_size, INFLATE_BUFFER_MAX);
+        read_queue.Reserve(INFLATE_BUFFER_MAX);
+        write_queue.Reserve(INFLATE_BUFFER_MAX);
     }
 
     auto GetResults() volatile -> Result;
     void WakeAllThreads();
 
     auto IsAnyRunning() volatile const -> bool {
-        return read_running || decompress_result || write_running;
+        return read_running || decompress_running || write_running;
     }
 
     auto GetWriteOffset() volatile const -> s64 {
@@ -204,71 +489,44 @@ struct ThreadData {
 
     Result SetDecompressBuf(std::vector<u8>& buf, s64 off, s64 size) {
         buf.resize(size);
-
-        mutexLock(std::addressof(read_mutex));
-        if (!read_buffers.ringbuf_free()) {
-            if (!write_running) {
-                R_SUCCEED();
-            }
-            R_TRY(condvarWait(std::addressof(can_read), std::addressof(read_mutex)));
-        }
-
-        ON_SCOPE_EXIT(mutexUnlock(std::addressof(read_mutex)));
-        R_TRY(GetResults());
-        read_buffers.ringbuf_push(buf, off);
-        return condvarWakeOne(std::addressof(can_decompress));
+        return read_queue.Push(buf, off, decompress_running, [this]{ return GetResults(); }, std::addressof(stage_stats.read));
     }
 
     Result GetDecompressBuf(std::vector<u8>& buf_out, s64& off_out) {
-        mutexLock(std::addressof(read_mutex));
-        if (!read_buffers.ringbuf_size()) {
-            if (!read_running) {
-                buf_out.resize(0);
-                R_SUCCEED();
-            }
-            R_TRY(condvarWait(std::addressof(can_decompress), std::addressof(read_mutex)));
-        }
-
-        ON_SCOPE_EXIT(mutexUnlock(std::addressof(read_mutex)));
-        R_TRY(GetResults());
-        read_buffers.ringbuf_pop(buf_out, off_out);
-        return condvarWakeOne(std::addressof(can_read));
+        return read_queue.Pop(buf_out, off_out, read_running, [this]{ return GetResults(); }, std::addressof(stage_stats.decompress));
     }
 
     Result SetWriteBuf(std::vector<u8>& buf, s64 size, bool skip_verify) {
         buf.resize(size);
+        stage_stats.decompress.bytes += size;
         if (!skip_verify) {
             sha256ContextUpdate(std::addressof(sha256), buf.data(), buf.size());
         }
 
-        mutexLock(std::addressof(write_mutex));
-        if (!write_buffers.ringbuf_free()) {
-            if (!decompress_running) {
-                R_SUCCEED();
-            }
-            R_TRY(condvarWait(std::addressof(can_decompress_write), std::addressof(write_mutex)));
-        }
-
-        ON_SCOPE_EXIT(mutexUnlock(std::addressof(write_mutex)));
-        R_TRY(GetResults());
-        write_buffers.ringbuf_push(buf, 0);
-        return condvarWakeOne(std::addressof(can_write));
+        return write_queue.Push(buf, 0, write_running, [this]{ return GetResults(); }, std::addressof(stage_stats.decompress));
     }
 
     Result GetWriteBuf(std::vector<u8>& buf_out, s64& off_out) {
-        mutexLock(std::addressof(write_mutex));
-        if (!write_buffers.ringbuf_size()) {
-            if (!decompress_running) {
-                buf_out.resize(0);
-                R_SUCCEED();
-            }
-            R_TRY(condvarWait(std::addressof(can_write), std::addressof(write_mutex)));
+        return write_queue.Pop(buf_out, off_out, decompress_running, [this]{ return GetResults(); }, std::addressof(stage_stats.write));
+    }
+
+    // called by the decompress thread once size bytes have been hashed.
+    void SetCheckpoint(s64 size) {
+        SCOPED_MUTEX(std::addressof(checkpoint_mutex));
+        checkpoint_offset = size;
+        checkpoint_sha256 = sha256;
+    }
+
+    // returns true if the checkpoint has been written by the write thread.
+    auto GetCheckpoint(s64& offset_out, Sha256Context& sha256_out) -> bool {
+        SCOPED_MUTEX(std::addressof(checkpoint_mutex));
+        if (!checkpoint_offset || checkpoint_offset > write_offset) {
+            return false;
         }
 
-        ON_SCOPE_EXIT(mutexUnlock(std::addressof(write_mutex)));
-        R_TRY(GetResults());
-        write_buffers.ringbuf_pop(buf_out, off_out);
-        return condvarWakeOne(std::addressof(can_decompress_write));
+        offset_out = std::exchange(checkpoint_offset, 0);
+        sha256_out = checkpoint_sha256;
+        return true;
     }
 
     // these need to be copied
@@ -277,25 +535,34 @@ struct ThreadData {
     NcaCollection* nca{};
 
     // these need to be created
-    Mutex read_mutex{};
-    Mutex write_mutex{};
-
-    CondVar can_read{};
-    CondVar can_decompress{};
-    CondVar can_decompress_write{};
-    CondVar can_write{};
+    Mutex checkpoint_mutex{};
 
     UEvent m_uevent_done{};
     UEvent m_uevent_progres{};
 
-    RingBuf<4> read_buffers{};
-    RingBuf<4> write_buffers{};
+    pipeline::Queue<4> read_queue{};
+    pipeline::Queue<4> write_queue{};
 
     ncz::BlockHeader ncz_block_header{};
     std::vector<ncz::Section> ncz_sections{};
     std::vector<ncz::BlockInfo> ncz_blocks{};
+    ncz::Index<ncz::Section> ncz_section_index{};
+    ncz::Index<ncz::BlockInfo> ncz_block_index{};
 
     Sha256Context sha256{};
+    BufferStats buffer_stats{};
+    PipelineStats stage_stats{};
+
+    // set if the nca is only verified, nothing is written.
+    bool dry_run{};
+    // set if checkpoints are written to the journal.
+    bool journal{};
+    // set when resuming, the data after the nca header starts from the checkpoint.
+    journal::Tracker resume{};
+    Sha256Context resume_sha256{};
+    // protected by the checkpoint mutex.
+    s64 checkpoint_offset{};
+    Sha256Context checkpoint_sha256{};
 
     u64 read_buffer_size{};
     u64 max_buffer_size{};
@@ -322,12 +589,23 @@ struct Yati {
     Result Setup(const ConfigOverride& override);
     Result InstallNca(std::span<TikCollection> tickets, NcaCollection& nca);
     Result InstallNcaInternal(std::span<TikCollection> tickets, NcaCollection& nca);
+    Result InstallNcas(std::span<TikCollection> tickets, std::span<NcaCollection> ncas);
     Result InstallCnmtNca(std::span<TikCollection> tickets, CnmtCollection& cnmt, const container::Collections& collections);
 
     Result readFuncInternal(ThreadData* t);
     Result decompressFuncInternal(ThreadData* t);
     Result writeFuncInternal(ThreadData* t);
 
+    auto IsDryRun(const NcaCollection& nca) const -> bool;
+    auto ShouldConvertCrypto(const TikCollection* ticket) const -> bool;
+    Result GetTitleKey(const nca::Header& header, const TikCollection* ticket, keys::KeyEntry& out);
+    Result GetSectionKey(const nca::Header& header, const TikCollection* ticket, keys::KeyEntry& out);
+    Result ConvertCrypto(nca::Header& header, TikCollection* ticket);
+    Result ApplyDeferredCrypto(std::span<TikCollection> tickets, NcaCollection& nca);
+
+    void CommitCheckpoint(ThreadData* t);
+    void ClearJournal();
+
     Result ParseTicketsIntoCollection(std::vector<TikCollection>& tickets, const container::Collections& collections, bool read_data);
     Result GetLatestVersion(const CnmtCollection& cnmt, u32& version_out, bool& skip);
     Result ShouldSkip(const CnmtCollection& cnmt, bool& skip);
@@ -352,10 +630,23 @@ struct Yati {
     std::unique_ptr<container::Base> container{};
     Config config{};
     keys::Keys keys{};
+
+    // set whilst multiple nca's are being installed at once.
+    NcaScheduler* scheduler{};
+    // locked when patching / updating tickets, as multiple nca's may
+    // share the same ticket.
+    Mutex ticket_mutex{};
+
+    // only used if the install can be resumed.
+    Journal journal{};
+    bool journal_enabled{};
 };
 
 auto ThreadData::GetResults() volatile -> Result {
     R_TRY(yati->pbox->ShouldExitResult());
+    if (yati->scheduler) {
+        R_TRY(yati->scheduler->GetResult());
+    }
     R_TRY(read_result.load());
     R_TRY(decompress_result.load());
     R_TRY(write_result.load());
@@ -363,13 +654,8 @@ auto ThreadData::GetResults() volatile -> Result {
 }
 
 void ThreadData::WakeAllThreads() {
-    condvarWakeAll(std::addressof(can_read));
-    condvarWakeAll(std::addressof(can_decompress));
-    condvarWakeAll(std::addressof(can_decompress_write));
-    condvarWakeAll(std::addressof(can_write));
-
-    mutexUnlock(std::addressof(read_mutex));
-    mutexUnlock(std::addressof(write_mutex));
+    read_queue.WakeAll();
+    write_queue.WakeAll();
 }
 
 Result ThreadData::Read(void* buf, s64 size, u64* bytes_read) {
@@ -379,6 +665,7 @@ Result ThreadData::Read(void* buf, s64 size, u64* bytes_read) {
 
     R_UNLESS(size == *bytes_read, Result_YatiInvalidNcaReadSize);
     read_offset += *bytes_read;
+    stage_stats.read.bytes += *bytes_read;
     return rc;
 }
 
@@ -435,6 +722,8 @@ Result HasRequiredTicket(const nca::Header& header, std::span<TikCollection> tik
 // parsing ncz headers, sections and reading ncz blocks
 Result Yati::readFuncInternal(ThreadData* t) {
     ON_SCOPE_EXIT( t->read_running = false; );
+    t->stage_stats.read.Start();
+    ON_SCOPE_EXIT( t->stage_stats.read.Stop(); );
 
     // the main buffer which data is read into.
     std::vector<u8> buf;
@@ -456,9 +745,9 @@ Result Yati::readFuncInternal(ThreadData* t) {
 
         s64 buf_offset = 0;
         if (!temp_buf.empty()) {
-            buf = temp_buf;
-            read_size -= temp_buf.size();
-            buf_offset = temp_buf.size();
+            std::swap(buf, temp_buf);
+            read_size -= buf.size();
+            buf_offset = buf.size();
             temp_buf.clear();
         }
 
@@ -484,6 +773,10 @@ Result Yati::readFuncInternal(ThreadData* t) {
                 t->ncz_sections.resize(header.total_sections);
                 R_TRY(t->Read(t->ncz_sections.data(), t->ncz_sections.size() * sizeof(ncz::Section), std::addressof(bytes_read)));
 
+                // sections are looked up by offset, so ensure they're sorted.
+                std::ranges::sort(t->ncz_sections, {}, &ncz::Section::offset);
+                t->ncz_section_index = ncz::Index<ncz::Section>{t->ncz_sections};
+
                 // check for ncz block header.
                 R_TRY(t->Read(std::addressof(t->ncz_block_header), sizeof(t->ncz_block_header), std::addressof(bytes_read)));
                 if (t->ncz_block_header.magic != NCZ_BLOCK_MAGIC) {
@@ -504,15 +797,25 @@ Result Yati::readFuncInternal(ThreadData* t) {
 
                     // calculate offsets for each block.
                     auto block_offset = t->read_offset.load();
+                    t->ncz_blocks.reserve(blocks.size());
                     for (const auto& block : blocks) {
                         t->ncz_blocks.emplace_back(block_offset, block.size);
                         block_offset += block.size;
                     }
+                    t->ncz_block_index = ncz::Index<ncz::BlockInfo>{t->ncz_blocks};
                 }
             }
         }
 
         R_TRY(t->SetDecompressBuf(buf, buffer_offset, buf_size));
+
+        // the nca header is always read, as the decompress thread needs it.
+        // skip the data up to the checkpoint.
+        if (const auto next = t->resume.NextOffset(buffer_offset, t->read_offset - buffer_offset); next != t->read_offset) {
+            R_UNLESS(t->ncz_sections.empty(), Result_YatiInvalidResumeOffset);
+            log_write("[JOURNAL] resuming read from: %zd\n", next);
+            t->read_offset = next;
+        }
     }
 
     log_write("read success\n");
@@ -523,6 +826,8 @@ Result Yati::readFuncInternal(ThreadData* t) {
 // and calculating the running sha256.
 Result Yati::decompressFuncInternal(ThreadData* t) {
     ON_SCOPE_EXIT( t->decompress_running = false; );
+    t->stage_stats.decompress.Start();
+    ON_SCOPE_EXIT( t->stage_stats.decompress.Stop(); );
 
     // only used for ncz files.
     auto dctx = ZSTD_createDCtx();
@@ -536,38 +841,51 @@ Result Yati::decompressFuncInternal(ThreadData* t) {
     Aes128CtrContext ctx{};
     std::vector<u8> inflate_buf{};
     inflate_buf.reserve(t->max_buffer_size);
+    // holds the data left over from a flush, swapped with the inflate buffer
+    // once it has been handed to the write thread.
+    std::vector<u8> spare_buf{};
+    spare_buf.reserve(t->max_buffer_size);
 
     s64 written{};
     s64 block_offset{};
     std::vector<u8> buf{};
     buf.reserve(t->max_buffer_size);
 
+    // only used if the hash tree is verified.
+    nca::HashTreeVerifier verifier{};
+    bool verify_hash_tree{};
+
     // encrypts the nca and passes the buffer to the write thread.
     const auto ncz_flush = [&](s64 size) -> Result {
         if (!inflate_offset) {
             R_SUCCEED();
         }
 
+        // the data is still decrypted at this point.
+        if (verify_hash_tree) {
+            R_TRY(verifier.Update(written, inflate_buf.data(), size, true));
+        }
+
         // if we are not moving the whole vector, then we need to keep
         // the remaining data.
         // rather that copying the entire vector to the write thread,
         // only copy (store) the remaining amount.
-        std::vector<u8> temp_vector{};
+        spare_buf.resize(0);
         if (size < inflate_offset) {
-            temp_vector.resize(inflate_offset - size);
-            std::memcpy(temp_vector.data(), inflate_buf.data() + size, temp_vector.size());
+            spare_buf.resize(inflate_offset - size);
+            std::memcpy(spare_buf.data(), inflate_buf.data() + size, spare_buf.size());
+            t->buffer_stats.copied += spare_buf.size();
         }
 
-        for (s64 off = 0; off < size;) {
-            if (!ncz_section || !ncz_section->InRange(written)) {
-                log_write("[NCZ] looking for new section: %zu\n", written);
-                auto it = std::ranges::find_if(t->ncz_sections, [written](auto& e){
-                    return e.InRange(written);
-                });
+        // the buffer may cross into the next section, each having its own key.
+        s64 off{};
+        for (const auto& section : t->ncz_section_index.FindRange(written, size)) {
+            // a gap between sections.
+            R_UNLESS(section.InRange(written), Result_YatiNczSectionNotFound);
 
-                R_UNLESS(it != t->ncz_sections.cend(), Result_YatiNczSectionNotFound);
-                ncz_section = &(*it);
+            if (ncz_section != std::addressof(section)) {
                 log_write("[NCZ] found new section: %zu\n", written);
+                ncz_section = std::addressof(section);
 
                 if (ncz_section->crypto_type >= nca::EncryptionType_AesCtr) {
                     const auto swp = std::byteswap(u64(written) >> 4);
@@ -589,13 +907,56 @@ Result Yati::decompressFuncInternal(ThreadData* t) {
             off += chunk_size;
         }
 
+        // the end of the buffer isn't covered by any section.
+        R_UNLESS(off == size, Result_YatiNczSectionNotFound);
+
         R_TRY(t->SetWriteBuf(inflate_buf, size, config.skip_nca_hash_verify));
         inflate_offset -= size;
 
-        // restore remaining data to the swapped buffer.
-        if (!temp_vector.empty()) {
-            log_write("[NCZ] storing data size: %zu\n", temp_vector.size());
-            inflate_buf = temp_vector;
+        // restore remaining data, the inflate buffer is now the buffer
+        // that was swapped out of the write ring buffer.
+        if (!spare_buf.empty()) {
+            log_write("[NCZ] storing data size: %zu\n", spare_buf.size());
+            std::swap(inflate_buf, spare_buf);
+            t->buffer_stats.copy_avoided += inflate_buf.size();
+        }
+
+        R_SUCCEED();
+    };
+
+    // only used for ncz files that are split into blocks.
+    std::unique_ptr<NczBlockDecompressor> block_decompressor{};
+    bool block_decompressor_checked{};
+
+    // decompresses the queued blocks directly into the inflate buffer, in order.
+    const auto ncz_flush_blocks = [&]() -> Result {
+        const auto jobs = block_decompressor->GetJobs();
+
+        s64 size{};
+        for (const auto& job : jobs) {
+            size += job.decompressed_size;
+        }
+
+        inflate_buf.resize(inflate_offset + size);
+        for (s64 off = inflate_offset; auto& job : jobs) {
+            job.out = inflate_buf.data() + off;
+            off += job.decompressed_size;
+
+            if (job.compressed) {
+                t->buffer_stats.copy_avoided += job.decompressed_size;
+            } else {
+                t->buffer_stats.copied += job.decompressed_size;
+            }
+        }
+
+        R_TRY(block_decompressor->Run());
+        block_decompressor->Clear();
+
+        t->decompress_offset += size;
+        inflate_offset += size;
+        while (inflate_offset >= INFLATE_BUFFER_MAX) {
+            log_write("[NCZ] flushing block data: %zd vs %zd diff: %zd\n", inflate_offset, INFLATE_BUFFER_MAX, inflate_offset - INFLATE_BUFFER_MAX);
+            R_TRY(ncz_flush(INFLATE_BUFFER_MAX));
         }
 
         R_SUCCEED();
@@ -620,6 +981,14 @@ Result Yati::decompressFuncInternal(ThreadData* t) {
             if (!decompress_buf_off) {
                 log_write("reading nca header\n");
 
+                // xci's store the hash of the start of each nca in the hfs0 partition.
+                if (!config.skip_nca_hash_verify && t->nca->header_hash_size && t->nca->header_hash_size <= buf.size()) {
+                    u8 hash[SHA256_HASH_SIZE];
+                    sha256CalculateHash(hash, buf.data(), t->nca->header_hash_size);
+                    R_UNLESS(!std::memcmp(hash, t->nca->header_hash, sizeof(hash)), Result_YatiInvalidHfs0Hash);
+                    log_write("hfs0 hash is ok!\n");
+                }
+
                 nca::Header header{};
                 crypto::cryptoAes128Xts(buf.data(), std::addressof(header), keys.header_key, 0, 0x200, sizeof(header), false);
                 log_write("verifying nca header magic\n");
@@ -638,8 +1007,10 @@ Result Yati::decompressFuncInternal(ThreadData* t) {
                 }
 
                 t->write_size = header.size;
-                log_write("setting placeholder size: %zu\n", t->write_size.load());
-                R_TRY(ncmContentStorageSetPlaceHolderSize(std::addressof(cs), std::addressof(t->nca->placeholder_id), t->write_size));
+                if (!t->dry_run) {
+                    log_write("setting placeholder size: %zu\n", t->write_size.load());
+                    R_TRY(ncmContentStorageSetPlaceHolderSize(std::addressof(cs), std::addressof(t->nca->placeholder_id), t->write_size));
+                }
 
                 if (!config.ignore_distribution_bit && header.distribution_type == nca::DistributionType_GameCard) {
                     header.distribution_type = nca::DistributionType_System;
@@ -647,44 +1018,31 @@ Result Yati::decompressFuncInternal(ThreadData* t) {
                 }
 
                 // try and get the ticket, if the nca requires it.
+                SCOPED_MUTEX(std::addressof(ticket_mutex));
                 auto ticket = GetTicketCollection(header, t->tik);
                 R_TRY(HasRequiredTicket(header, ticket));
 
-                if ((config.convert_to_standard_crypto && ticket) || config.lower_master_key) {
-                    t->nca->modified = true;
-                    u8 keak_generation;
-
-                    if (ticket) {
-                        const auto key_gen = header.key_gen;
-                        log_write("converting to standard crypto: 0x%X 0x%X\n", key_gen, header.key_gen);
-
-                        // fetch ticket data block.
-                        es::TicketData ticket_data;
-                        R_TRY(es::GetTicketData(ticket->ticket, std::addressof(ticket_data)));
-
-                        // validate that this indeed the correct ticket.
-                        R_UNLESS(!std::memcmp(std::addressof(header.rights_id), std::addressof(ticket_data.rights_id), sizeof(header.rights_id)), Result_YatiInvalidTicketBadRightsId);
-
-                        // decrypt title key.
-                        keys::KeyEntry title_key;
-                        R_TRY(es::GetTitleKey(title_key, ticket_data, keys));
-                        R_TRY(es::DecryptTitleKey(title_key, key_gen, keys));
-
-                        std::memset(header.key_area, 0, sizeof(header.key_area));
-                        std::memcpy(&header.key_area[0x2], &title_key, sizeof(title_key));
-
-                        keak_generation = key_gen;
-                        ticket->required = false;
-                    } else if (config.lower_master_key) {
-                        R_TRY(nca::DecryptKeak(keys, header));
+                if (ShouldConvertCrypto(ticket)) {
+                    if (ticket && !ticket->loaded) {
+                        // streamed installs may send the ticket after the nca.
+                        // install the nca as-is and patch the header once the ticket has been read.
+                        log_write("deferring crypto conversion until the ticket is read\n");
+                        t->nca->deferred_crypto = true;
+                    } else {
+                        t->nca->modified = true;
+                        R_TRY(ConvertCrypto(header, ticket));
                     }
+                }
 
-                    if (config.lower_master_key) {
-                        keak_generation = 0;
+                // the data is skipped when resuming, so the hash tree cannot be verified.
+                if (config.verify_hash_tree && !t->resume.GetResumeOffset()) {
+                    keys::KeyEntry key{};
+                    if (const auto rc = GetSectionKey(t->nca->header, ticket, key); R_FAILED(rc)) {
+                        log_write("[VERIFY] skipping hash tree, failed to get key: 0x%X\n", rc);
+                    } else {
+                        R_TRY(verifier.Init(t->nca->header, key, App::IsApplet() ? HASH_TREE_MAX_MEMORY_APPLET : HASH_TREE_MAX_MEMORY));
+                        verify_hash_tree = !verifier.IsEmpty();
                     }
-
-                    R_TRY(nca::EncryptKeak(keys, header, keak_generation));
-                    std::memset(&header.rights_id, 0, sizeof(header.rights_id));
                 }
 
                 if (t->nca->modified) {
@@ -692,35 +1050,65 @@ Result Yati::decompressFuncInternal(ThreadData* t) {
                 }
             }
 
+            if (verify_hash_tree) {
+                R_TRY(verifier.Update(decompress_buf_off, buf.data(), buf.size(), false));
+            }
+
             written += buf.size();
             t->decompress_offset += buf.size();
             R_TRY(t->SetWriteBuf(buf, buf.size(), config.skip_nca_hash_verify));
+
+            if (!is_ncz && t->journal) {
+                const auto action = t->resume.Update(decompress_buf_off, written);
+                if (action == journal::Action::Resume) {
+                    // restore the hash state after the header has been processed.
+                    log_write("[JOURNAL] resuming decompress from: %zd\n", t->resume.GetResumeOffset());
+                    t->sha256 = t->resume_sha256;
+                    written = t->resume.GetResumeOffset();
+                    t->decompress_offset = written;
+                } else if (action == journal::Action::Checkpoint) {
+                    t->SetCheckpoint(written);
+                }
+            }
         } else if (is_ncz) {
+            // blocks are only known once the ncz header has been parsed.
+            if (!block_decompressor_checked) {
+                block_decompressor_checked = true;
+
+                const auto block_size = u64(1) << t->ncz_block_header.block_size_exponent;
+                if (t->ncz_blocks.size() > 1 && block_size <= NCZ_BLOCK_MAX_PARALLEL_SIZE && !App::IsApplet()) {
+                    block_decompressor = std::make_unique<NczBlockDecompressor>();
+                    if (const auto rc = block_decompressor->Create(); R_FAILED(rc)) {
+                        log_write("[NCZ] failed to create block decompressor: 0x%X\n", rc);
+                        block_decompressor.reset();
+                    }
+                }
+            }
+
             u64 buf_off{};
             while (buf_off < buf.size()) {
                 std::span<const u8> buffer{buf.data() + buf_off, buf.size() - buf_off};
                 bool compressed = true;
+                u64 decompressedBlockSize{};
 
                 // todo: blocks need to use read offset, as the offset + size is compressed range.
                 if (t->ncz_blocks.size()) {
                     if (!ncz_block || !ncz_block->InRange(decompress_buf_off)) {
                         block_offset = 0;
                         log_write("[NCZ] looking for new block: %zu\n", decompress_buf_off);
-                        auto it = std::ranges::find_if(t->ncz_blocks, [decompress_buf_off](auto& e){
-                            return e.InRange(decompress_buf_off);
-                        });
-
-                        R_UNLESS(it != t->ncz_blocks.cend(), Result_YatiNczBlockNotFound);
-                        log_write("[NCZ] found new block: %zu off: %zd size: %zd\n", decompress_buf_off, it->offset, it->size);
-                        ncz_block = &(*it);
+                        ncz_block = t->ncz_block_index.Find(decompress_buf_off);
+                        R_UNLESS(ncz_block, Result_YatiNczBlockNotFound);
+                        log_write("[NCZ] found new block: %zu off: %zd size: %zd\n", decompress_buf_off, ncz_block->offset, ncz_block->size);
                     }
 
                     // https://github.com/nicoboss/nsz/issues/79
-                    auto decompressedBlockSize = 1 << t->ncz_block_header.block_size_exponent;
+                    decompressedBlockSize = u64(1) << t->ncz_block_header.block_size_exponent;
                     // special handling for the last block to check it's actually compressed
-                    if (ncz_block->offset == t->ncz_blocks.back().offset) {
+                    if (t->ncz_block_index.IsLast(ncz_block)) {
                         log_write("[NCZ] last block special handling\n");
-                        decompressedBlockSize = t->ncz_block_header.decompressed_size % decompressedBlockSize;
+                        if (const auto remainder = t->ncz_block_header.decompressed_size % decompressedBlockSize) {
+                            decompressedBlockSize = remainder;
+                        }
                     }
 
                     // check if this block is compressed.
@@ -731,7 +1119,21 @@ Result Yati::decompressFuncInternal(ThreadData* t) {
                     buffer = buffer.subspan(0, size);
                 }
 
-                if (compressed) {
+                if (block_decompressor) {
+                    // queue the block, it is decompressed once the batch is full.
+                    auto& job = block_decompressor->GetPendingJob();
+                    job.in.insert(job.in.end(), buffer.begin(), buffer.end());
+
+                    if (block_offset + buffer.size() == ncz_block->size) {
+                        job.compressed = compressed;
+                        job.decompressed_size = compressed ? decompressedBlockSize : job.in.size();
+                        block_decompressor->Push();
+
+                        if (block_decompressor->IsFull() || t->ncz_block_index.IsLast(ncz_block)) {
+                            R_TRY(ncz_flush_blocks());
+                        }
+                    }
+                } else if (compressed) {
                     log_write("[NCZ] COMPRESSED block\n");
                     ZSTD_inBuffer input = { buffer.data(), buffer.size(), 0 };
                     while (input.pos < input.size) {
@@ -755,6 +1157,7 @@ Result Yati::decompressFuncInternal(ThreadData* t) {
                 } else {
                     inflate_buf.resize(inflate_offset + buffer.size());
                     std::memcpy(inflate_buf.data() + inflate_offset, buffer.data(), buffer.size());
+                    t->buffer_stats.copied += buffer.size();
 
                     t->decompress_offset += buffer.size();
                     inflate_offset += buffer.size();
@@ -771,6 +1174,11 @@ Result Yati::decompressFuncInternal(ThreadData* t) {
         }
     }
 
+    // decompress any blocks left in the batch.
+    if (block_decompressor && !block_decompressor->GetJobs().empty()) {
+        R_TRY(ncz_flush_blocks());
+    }
+
     // flush remaining data.
     if (is_ncz && inflate_offset) {
         log_write("flushing remaining\n");
@@ -778,6 +1186,14 @@ Result Yati::decompressFuncInternal(ThreadData* t) {
     }
 
     log_write("decompress thread done!\n");
+    if (verify_hash_tree) {
+        verifier.LogStats();
+    }
+
+    // checkpoint the complete nca, so it isn't installed again if a later nca fails.
+    if (!is_ncz && t->journal && written == t->write_size) {
+        t->SetCheckpoint(written);
+    }
 
     // get final hash output.
     sha256ContextGetHash(std::addressof(t->sha256), t->nca->hash);
@@ -788,10 +1204,12 @@ Result Yati::decompressFuncInternal(ThreadData* t) {
 // write thread writes data to the nca placeholder.
 Result Yati::writeFuncInternal(ThreadData* t) {
     ON_SCOPE_EXIT( t->write_running = false; );
+    t->stage_stats.write.Start();
+    ON_SCOPE_EXIT( t->stage_stats.write.Stop(); );
 
     std::vector<u8> buf;
     buf.reserve(t->max_buffer_size);
-    const auto is_file_based_emummc = App::IsFileBaseEmummc();
+    throttle::Emummc throttle{};
 
     while (t->write_offset < t->write_size && R_SUCCEEDED(t->GetResults())) {
         s64 dummy_off;
@@ -800,21 +1218,28 @@ Result Yati::writeFuncInternal(ThreadData* t) {
             break;
         }
 
+        const s64 buf_offset = t->write_offset;
+
         s64 off{};
         while (off < buf.size() && t->write_offset < t->write_size && R_SUCCEEDED(t->GetResults())) {
             const auto wsize = std::min<s64>(t->read_buffer_size, buf.size() - off);
-            R_TRY(ncmContentStorageWritePlaceHolder(std::addressof(cs), std::addressof(t->nca->placeholder_id), t->write_offset, buf.data() + off, wsize));
+            if (!t->dry_run) {
+                R_TRY(throttle.Run(wsize, [&]{
+                    return ncmContentStorageWritePlaceHolder(std::addressof(cs), std::addressof(t->nca->placeholder_id), t->write_offset, buf.data() + off, wsize);
+                }));
+            }
 
             off += wsize;
             t->write_offset += wsize;
+            t->stage_stats.write.bytes += wsize;
             ueventSignal(t->GetProgressEvent());
+        }
 
-            // todo: check how much time elapsed and sleep the diff
-            // rather than always sleeping a fixed amount.
-            // ie, writing a small buffer (nca header) should not sleep the full 2 ms.
-            if (is_file_based_emummc) {
-                svcSleepThread(2e+6); // 2ms
-            }
+        // the nca header is always written, skip to the checkpoint.
+        t->write_offset = t->resume.NextOffset(buf_offset, t->write_offset - buf_offset);
+
+        if (t->journal) {
+            CommitCheckpoint(t);
         }
     }
 
@@ -822,6 +1247,137 @@ Result Yati::writeFuncInternal(ThreadData* t) {
     R_SUCCEED();
 }
 
+// the cnmt is always installed, as it's needed to find the nca's to verify.
+auto Yati::IsDryRun(const NcaCollection& nca) const -> bool {
+    return config.verify_only && !nca.name.ends_with(".cnmt.nca") && !nca.name.ends_with(".cnmt.ncz");
+}
+
+auto Yati::ShouldConvertCrypto(const TikCollection* ticket) const -> bool {
+    return (config.convert_to_standard_crypto && ticket) || config.lower_master_key;
+}
+
+// decrypts the title key from the ticket, the ticket must be locked by the caller.
+Result Yati::GetTitleKey(const nca::Header& header, const TikCollection* ticket, keys::KeyEntry& out) {
+    // fetch ticket data block.
+    es::TicketData ticket_data;
+    R_TRY(es::GetTicketData(ticket->ticket, std::addressof(ticket_data)));
+
+    // validate that this indeed the correct ticket.
+    R_UNLESS(!std::memcmp(std::addressof(header.rights_id), std::addressof(ticket_data.rights_id), sizeof(header.rights_id)), Result_YatiInvalidTicketBadRightsId);
+
+    // decrypt title key.
+    R_TRY(es::GetTitleKey(out, ticket_data, keys));
+    R_TRY(es::DecryptTitleKey(out, header.key_gen, keys));
+    R_SUCCEED();
+}
+
+// gets the aes-ctr key used by the nca sections, the ticket must be locked by the caller.
+Result Yati::GetSectionKey(const nca::Header& header, const TikCollection* ticket, keys::KeyEntry& out) {
+    if (isRightsIdValid(header.rights_id)) {
+        R_UNLESS(ticket && ticket->loaded, Result_YatiTicketNotFound);
+        return GetTitleKey(header, ticket, out);
+    }
+
+    auto temp = header;
+    R_TRY(nca::DecryptKeak(keys, temp));
+    std::memcpy(out.key, temp.key_area[0x2].area, sizeof(out.key));
+    R_SUCCEED();
+}
+
+// converts the header to standard crypto and / or lowers the master key.
+// the ticket must be locked by the caller.
+Result Yati::ConvertCrypto(nca::Header& header, TikCollection* ticket) {
+    u8 keak_generation{};
+
+    if (ticket) {
+        const auto key_gen = header.key_gen;
+        log_write("converting to standard crypto: 0x%X 0x%X\n", key_gen, header.key_gen);
+
+        keys::KeyEntry title_key;
+        R_TRY(GetTitleKey(header, ticket, title_key));
+
+        std::memset(header.key_area, 0, sizeof(header.key_area));
+        std::memcpy(&header.key_area[0x2], &title_key, sizeof(title_key));
+
+        keak_generation = key_gen;
+        ticket->required = false;
+    } else if (config.lower_master_key) {
+        R_TRY(nca::DecryptKeak(keys, header));
+    }
+
+    if (config.lower_master_key) {
+        keak_generation = 0;
+    }
+
+    R_TRY(nca::EncryptKeak(keys, header, keak_generation));
+    std::memset(&header.rights_id, 0, sizeof(header.rights_id));
+    R_SUCCEED();
+}
+
+// patches the header of an nca whose conversion was deferred, see NcaCollection.
+// as the nca was installed unmodified, the sha256 was verified against the original data.
+Result Yati::ApplyDeferredCrypto(std::span<TikCollection> tickets, NcaCollection& nca) {
+    if (!nca.deferred_crypto) {
+        R_SUCCEED();
+    }
+
+    auto header = nca.header;
+    if (!config.ignore_distribution_bit && header.distribution_type == nca::DistributionType_GameCard) {
+        header.distribution_type = nca::DistributionType_System;
+    }
+
+    SCOPED_MUTEX(std::addressof(ticket_mutex));
+    auto ticket = GetTicketCollection(header, tickets);
+    R_TRY(HasRequiredTicket(header, ticket));
+    R_UNLESS(!ticket || ticket->loaded, Result_YatiTicketNotFound);
+
+    log_write("applying deferred crypto conversion: %s\n", nca.name.c_str());
+    R_TRY(ConvertCrypto(header, ticket));
+
+    std::vector<u8> buf(sizeof(header));
+    crypto::cryptoAes128Xts(std::addressof(header), buf.data(), keys.header_key, 0, 0x200, sizeof(header), true);
+    R_TRY(ncmContentStorageWritePlaceHolder(std::addressof(cs), std::addressof(nca.placeholder_id), 0, buf.data(), buf.size()));
+    R_TRY(ncmContentStorageFlushPlaceHolder(std::addressof(cs)));
+
+    nca.modified = true;
+    nca.deferred_crypto = false;
+    R_SUCCEED();
+}
+
+void Yati::CommitCheckpoint(ThreadData* t) {
+    journal::Entry entry{};
+    if (!t->GetCheckpoint(entry.committed, entry.sha256)) {
+        return;
+    }
+
+    // ensure the data is on the sd card before recording it.
+    if (const auto rc = ncmContentStorageFlushPlaceHolder(std::addressof(cs)); R_FAILED(rc)) {
+        log_write("[JOURNAL] failed to flush placeholder: 0x%X\n", rc);
+        return;
+    }
+
+    entry.content_id = t->nca->content_id;
+    entry.placeholder_id = t->nca->placeholder_id;
+    entry.size = t->nca->size;
+    entry.storage_id = storage_id;
+
+    if (const auto rc = journal.Update(entry); R_FAILED(rc)) {
+        log_write("[JOURNAL] failed to update journal: 0x%X\n", rc);
+    } else {
+        log_write("[JOURNAL] checkpoint: %s %zd / %zd\n", t->nca->name.c_str(), entry.committed, entry.size);
+    }
+}
+
+void Yati::ClearJournal() {
+    for (const auto& entry : journal.Clear()) {
+        for (size_t i = 0; i < std::size(NCM_STORAGE_IDS); i++) {
+            if (NCM_STORAGE_IDS[i] == entry.storage_id) {
+                ncmContentStorageDeletePlaceHolder(std::addressof(ncm_cs[i]), std::addressof(entry.placeholder_id));
+            }
+        }
+    }
+}
+
 void readFunc(void* d) {
     auto t = static_cast<ThreadData*>(d);
     t->SetReadResult(t->yati->readFuncInternal(t));
@@ -841,40 +1397,9 @@ void writeFunc(void* d) {
     log_write("write thread returned now\n");
 }
 
-// stdio-like wrapper for std::vector
-struct BufHelper {
-    BufHelper() = default;
-    BufHelper(std::span<const u8> data) {
-        write(data);
-    }
-
-    void write(const void* data, u64 size) {
-        if (offset + size >= buf.size()) {
-            buf.resize(offset + size);
-        }
-        std::memcpy(buf.data() + offset, data, size);
-        offset += size;
-    }
-
-    void write(std::span<const u8> data) {
-        write(data.data(), data.size());
-    }
-
-    void seek(u64 where_to) {
-        offset = where_to;
-    }
-
-    [[nodiscard]]
-    auto tell() const {
-        return offset;
-    }
-
-    std::vector<u8> buf{};
-    u64 offset{};
-};
-
 Yati::Yati(ui::ProgressBox* _pbox, source::Base* _source) : pbox{_pbox}, source{_source} {
     App::SetAutoSleepDisabled(true);
+    mutexInit(std::addressof(ticket_mutex));
 }
 
 Yati::~Yati() {
@@ -909,9 +1434,32 @@ Result Yati::Setup(const ConfigOverride& override) {
     config.convert_to_standard_crypto = override.convert_to_standard_crypto.value_or(App::GetApp()->m_convert_to_standard_crypto.Get());
     config.lower_master_key = override.lower_master_key.value_or(App::GetApp()->m_lower_master_key.Get());
     config.lower_system_version = override.lower_system_version.value_or(App::GetApp()->m_lower_system_version.Get());
+    config.resume_install = App::GetApp()->m_resume_install.Get();
+    config.verify_hash_tree = override.verify_hash_tree.value_or(App::GetApp()->m_verify_hash_tree.Get());
+    config.verify_only = override.verify_only.value_or(false);
+
+    // verify every hash and skip anything that would modify the nca's.
+    if (config.verify_only) {
+        config.verify_hash_tree = true;
+        config.skip_nca_hash_verify = false;
+        config.skip_if_already_installed = false;
+        config.ticket_only = false;
+        config.ignore_distribution_bit = true;
+        config.convert_to_standard_crypto = false;
+        config.lower_master_key = false;
+        config.resume_install = false;
+    }
+
     storage_id = config.sd_card_install ? NcmStorageId_SdCard : NcmStorageId_BuiltInUser;
 
     R_TRY(source->GetOpenResult());
+
+    // resuming requires seeking to the checkpoint.
+    journal_enabled = config.resume_install && !source->IsStream();
+    if (journal_enabled) {
+        journal.Load();
+    }
+
     R_TRY(splCryptoInitialize());
     R_TRY(nsInitialize());
     R_TRY(nsGetApplicationManagerInterface(std::addressof(ns_app)));
@@ -942,20 +1490,40 @@ Result Yati::InstallNcaInternal(std::span<TikCollection> tickets, NcaCollection&
         }
     }
 
-    log_write("generateing placeholder\n");
-    R_TRY(ncmContentStorageGeneratePlaceHolderId(std::addressof(cs), std::addressof(nca.placeholder_id)));
-    log_write("creating placeholder\n");
-    R_TRY(ncmContentStorageCreatePlaceHolder(std::addressof(cs), std::addressof(nca.content_id), std::addressof(nca.placeholder_id), nca.size));
+    // ncz's cannot be resumed, see Journal.
+    const auto dry_run = IsDryRun(nca);
+    const auto use_journal = journal_enabled && !dry_run && !nca.name.ends_with(".ncz");
+    journal::Entry resume{};
+    bool resumed{};
+
+    if (use_journal && journal.Find(nca.content_id, storage_id, nca.size, resume)) {
+        bool has_placeholder{};
+        if (R_SUCCEEDED(ncmContentStorageHasPlaceHolder(std::addressof(cs), std::addressof(has_placeholder), std::addressof(resume.placeholder_id))) && has_placeholder) {
+            log_write("[JOURNAL] resuming %s from: %zd\n", nca.name.c_str(), resume.committed);
+            nca.placeholder_id = resume.placeholder_id;
+            resumed = true;
+        } else {
+            journal.Remove(resume.placeholder_id);
+        }
+    }
+
+    if (dry_run) {
+        log_write("verifying nca without installing\n");
+    } else if (!resumed) {
+        log_write("generateing placeholder\n");
+        R_TRY(ncmContentStorageGeneratePlaceHolderId(std::addressof(cs), std::addressof(nca.placeholder_id)));
+        log_write("creating placeholder\n");
+        R_TRY(ncmContentStorageCreatePlaceHolder(std::addressof(cs), std::addressof(nca.content_id), std::addressof(nca.placeholder_id), nca.size));
+    }
 
     log_write("opening thread\n");
     ThreadData t_data{this, tickets, std::addressof(nca)};
-
-    #define READ_THREAD_CORE 1
-    #define DECOMPRESS_THREAD_CORE 2
-    #define WRITE_THREAD_CORE 0
-    // #define READ_THREAD_CORE 2
-    // #define DECOMPRESS_THREAD_CORE 2
-    // #define WRITE_THREAD_CORE 2
+    t_data.dry_run = dry_run;
+    t_data.journal = use_journal;
+    if (resumed) {
+        t_data.resume = journal::Tracker{resume.committed};
+        t_data.resume_sha256 = resume.sha256;
+    }
 
     Thread t_read{};
     R_TRY(threadCreate(&t_read, readFunc, std::addressof(t_data), nullptr, 1024*64, PRIO_PREEMPTIVE, READ_THREAD_CORE));
@@ -990,7 +1558,11 @@ Result Yati::InstallNcaInternal(std::span<TikCollection> tickets, NcaCollection&
         }
 
         if (!idx) {
-            pbox->UpdateTransfer(t_data.GetWriteOffset(), t_data.GetWriteSize());
+            if (scheduler) {
+                scheduler->UpdateProgress(nca, t_data.GetWriteOffset(), t_data.GetWriteSize());
+            } else {
+                pbox->UpdateTransfer(t_data.GetWriteOffset(), t_data.GetWriteSize());
+            }
         } else {
             break;
         }
@@ -1012,6 +1584,11 @@ Result Yati::InstallNcaInternal(std::span<TikCollection> tickets, NcaCollection&
         break;
     }
     log_write("threads closed\n");
+    log_write("[YATI] buffers read peak: %u/%u write peak: %u/%u copied: %zu avoided: %zu\n",
+        t_data.read_queue.GetPeak(), t_data.read_queue.GetCapacity(),
+        t_data.write_queue.GetPeak(), t_data.write_queue.GetCapacity(),
+        t_data.buffer_stats.copied, t_data.buffer_stats.copy_avoided);
+    t_data.stage_stats.Log();
 
     // if any of the threads failed, wake up all threads so they can exit.
     if (R_FAILED(t_data.GetResults())) {
@@ -1021,6 +1598,10 @@ Result Yati::InstallNcaInternal(std::span<TikCollection> tickets, NcaCollection&
     }
     R_TRY(t_data.GetResults());
 
+    if (use_journal) {
+        CommitCheckpoint(std::addressof(t_data));
+    }
+
     NcmContentId content_id{};
     std::memcpy(std::addressof(content_id), nca.hash, sizeof(content_id));
 
@@ -1028,6 +1609,8 @@ Result Yati::InstallNcaInternal(std::span<TikCollection> tickets, NcaCollection&
     if (!config.skip_nca_hash_verify && !nca.modified) {
         if (std::memcmp(&nca.content_id, nca.hash, sizeof(nca.content_id))) {
             log_write("nca hash is invalid!!!!\n");
+            // don't resume from bad data.
+            journal.Remove(nca.placeholder_id);
             R_UNLESS(!std::memcmp(&nca.content_id, nca.hash, sizeof(nca.content_id)), Result_YatiInvalidNcaSha256);
         } else {
             log_write("nca hash is valid!\n");
@@ -1041,11 +1624,18 @@ Result Yati::InstallNcaInternal(std::span<TikCollection> tickets, NcaCollection&
 
 Result Yati::InstallNca(std::span<TikCollection> tickets, NcaCollection& nca) {
     log_write("in install nca\n");
-    pbox->NewTransfer(nca.name);
+    if (!scheduler) {
+        pbox->NewTransfer(nca.name);
+    }
     keys::parse_hex_key(std::addressof(nca.content_id), nca.name.c_str());
 
     R_TRY(InstallNcaInternal(tickets, nca));
 
+    // nothing was written, so there's nothing to parse.
+    if (IsDryRun(nca)) {
+        R_SUCCEED();
+    }
+
     fs::FsPath path;
     if (nca.skipped) {
         R_TRY(ncmContentStorageGetPath(std::addressof(cs), path, sizeof(path), std::addressof(nca.content_id)));
@@ -1068,6 +1658,33 @@ Result Yati::InstallNca(std::span<TikCollection> tickets, NcaCollection& nca) {
     R_SUCCEED();
 }
 
+Result Yati::InstallNcas(std::span<TikCollection> tickets, std::span<NcaCollection> ncas) {
+    // parallel installs require the source to be readable from multiple threads.
+    // each nca pipeline allocates ~50MiB of buffers, so limit this to application mode.
+    // each pipeline also throttles its own writes, which isn't enough for file based emummc.
+    if (ncas.size() <= 1 || !source->IsThreadSafe() || App::IsApplet() || App::IsFileBaseEmummc()) {
+        for (auto& nca : ncas) {
+            R_TRY(InstallNca(tickets, nca));
+        }
+        R_SUCCEED();
+    }
+
+    NcaScheduler t_data{ncas,
+        [this, tickets](NcaCollection& nca) {
+            return InstallNca(tickets, nca);
+        },
+        [this](s64 offset, s64 size) {
+            pbox->UpdateTransfer(offset, size);
+        }
+    };
+
+    scheduler = std::addressof(t_data);
+    ON_SCOPE_EXIT(scheduler = nullptr);
+
+    pbox->NewTransfer("Installing NCAs"_i18n);
+    return t_data.Run(NCA_INSTALL_MAX_PARALLEL, PRIO_PREEMPTIVE, pbox->GetCpuId());
+}
+
 Result Yati::InstallCnmtNca(std::span<TikCollection> tickets, CnmtCollection& cnmt, const container::Collections& collections) {
     R_TRY(InstallNca(tickets, cnmt));
 
@@ -1160,6 +1777,7 @@ Result Yati::ParseTicketsIntoCollection(std::vector<TikCollection>& tickets, con
                 u64 bytes_read;
                 R_TRY(source->Read(entry.ticket.data(), collection.offset, entry.ticket.size(), &bytes_read));
                 R_TRY(source->Read(entry.cert.data(), cert->offset, entry.cert.size(), &bytes_read));
+                entry.loaded = true;
             }
 
             tickets.emplace_back(entry);
@@ -1402,15 +2020,33 @@ Result InstallInternal(ui::ProgressBox* pbox, source::Base* source, const contai
     }
 
     for (auto& cnmt : cnmts) {
+        // placeholders in the journal are kept so that the install can be resumed,
+        // unless the user cancelled the install.
+        const auto delete_placeholder = [&yati, pbox](const NcmPlaceHolderId& placeholder_id) {
+            if (pbox->ShouldExit()) {
+                yati->journal.Remove(placeholder_id);
+            } else if (yati->journal.Has(placeholder_id)) {
+                return;
+            }
+
+            ncmContentStorageDeletePlaceHolder(std::addressof(yati->cs), std::addressof(placeholder_id));
+        };
+
         ON_SCOPE_EXIT(
-            ncmContentStorageDeletePlaceHolder(std::addressof(yati->cs), std::addressof(cnmt.placeholder_id));
+            delete_placeholder(cnmt.placeholder_id);
             for (auto& nca : cnmt.ncas) {
-                ncmContentStorageDeletePlaceHolder(std::addressof(yati->cs), std::addressof(nca.placeholder_id));
+                delete_placeholder(nca.placeholder_id);
             }
         );
 
         R_TRY(yati->InstallCnmtNca(tickets, cnmt, collections));
 
+        if (yati->config.verify_only) {
+            log_write("verifying nca's\n");
+            R_TRY(yati->InstallNcas(tickets, cnmt.ncas));
+            continue;
+        }
+
         u32 latest_version_num;
         bool skip = false;
         R_TRY(yati->GetLatestVersion(cnmt, latest_version_num, skip));
@@ -1422,28 +2058,48 @@ Result InstallInternal(ui::ProgressBox* pbox, source::Base* source, const contai
         }
 
         log_write("installing nca's\n");
-        for (auto& nca : cnmt.ncas) {
-            R_TRY(yati->InstallNca(tickets, nca));
-        }
+        R_TRY(yati->InstallNcas(tickets, cnmt.ncas));
 
         R_TRY(yati->ImportTickets(tickets));
         R_TRY(yati->RemoveInstalledNcas(cnmt));
         R_TRY(yati->RegisterNcasAndPushRecord(cnmt, latest_version_num));
+
+        // the placeholders are now registered, so they no longer need resuming.
+        yati->journal.Remove(cnmt.placeholder_id);
+        for (auto& nca : cnmt.ncas) {
+            yati->journal.Remove(nca.placeholder_id);
+        }
+    }
+
+    // only the most recent install can be resumed, remove anything left
+    // over from a previous failed install.
+    if (yati->journal_enabled) {
+        yati->ClearJournal();
     }
 
     log_write("success!\n");
     R_SUCCEED();
 }
 
+Result ClearInstallJournal() {
+    Journal journal{};
+    journal.Load();
+
+    for (const auto& entry : journal.Clear()) {
+        NcmContentStorage cs;
+        if (R_SUCCEEDED(ncmOpenContentStorage(std::addressof(cs), NcmStorageId(entry.storage_id)))) {
+            ncmContentStorageDeletePlaceHolder(std::addressof(cs), std::addressof(entry.placeholder_id));
+            ncmContentStorageClose(std::addressof(cs));
+        }
+    }
+
+    R_SUCCEED();
+}
+
 Result InstallInternalStream(ui::ProgressBox* pbox, source::Base* source, container::Collections collections, const ConfigOverride& override) {
     auto yati = std::make_unique<Yati>(pbox, source);
     R_TRY(yati->Setup(override));
 
-    // not supported with stream installs (yet).
-    yati->config.skip_if_already_installed = false;
-    yati->config.convert_to_standard_crypto = false;
-    yati->config.lower_master_key = false;
-
     std::vector<NcaCollection> ncas{};
     std::vector<CnmtCollection> cnmts{};
     std::vector<TikCollection> tickets{};
@@ -1493,6 +2149,8 @@ Result InstallInternalStream(ui::ProgressBox* pbox, source::Base* source, contai
             u64 bytes_read;
             if (collection.name.ends_with(".tik")) {
                 R_TRY(source->Read(entry->ticket.data(), collection.offset, entry->ticket.size(), &bytes_read));
+                SCOPED_MUTEX(std::addressof(yati->ticket_mutex));
+                entry->loaded = true;
             } else {
                 R_TRY(source->Read(entry->cert.data(), collection.offset, entry->cert.size(), &bytes_read));
             }
@@ -1512,6 +2170,11 @@ Result InstallInternalStream(ui::ProgressBox* pbox, source::Base* source, contai
             cnmt_nca.type = type;
         }
 
+        // every nca has been verified whilst streaming.
+        if (yati->config.verify_only) {
+            continue;
+        }
+
         u32 latest_version_num;
         bool skip = false;
         R_TRY(yati->GetLatestVersion(cnmt, latest_version_num, skip));
@@ -1522,6 +2185,11 @@ Result InstallInternalStream(ui::ProgressBox* pbox, source::Base* source, contai
             continue;
         }
 
+        // all tickets have been read by now.
+        for (auto& nca : cnmt.ncas) {
+            R_TRY(yati->ApplyDeferredCrypto(tickets, nca));
+        }
+
         R_TRY(yati->ImportTickets(tickets));
         R_TRY(yati->RemoveInstalledNcas(cnmt));
         R_TRY(yati->RegisterNcasAndPushRecord(cnmt, latest_version_num));
@@ -1557,6 +2225,14 @@ Result InstallFromSource(ui::ProgressBox* pbox, source::Base* source, const fs::
 Result InstallFromContainer(ui::ProgressBox* pbox, container::Base* container, const ConfigOverride& override) {
     container::Collections collections;
     R_TRY(container->GetCollections(collections));
+
+    // every read from here on is within the collections.
+    s64 end{};
+    for (const auto& collection : collections) {
+        end = std::max(end, collection.offset + collection.size);
+    }
+    container->GetSource()->SetReadAheadLimit(end);
+
     return InstallFromCollections(pbox, container->GetSource(), collections, override);
 }
 
@@ -0,0 +1,547 @@
+// replays synthetic nsp / nsz / xci / xcz files through a read -> decompress -> write
+// pipeline built from the same parts as yati, reporting the speed and stalls of each stage.
+//
+// bench_install [--size MiB] [--count ncas] [--write-speed MiB/s] [--format nsp|nsz|xci|xcz]
+
+#include "test.hpp"
+#include "shim.hpp"
+#include "pipeline.hpp"
+#include "buf_helper.hpp"
+#include "yati/container/nsp.hpp"
+#include "yati/container/xci.hpp"
+#include "yati/nx/ncz.hpp"
+#include <cstring>
+#include <string>
+#include <thread>
+
+#if HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+using namespace sphaira;
+
+namespace {
+
+constexpr s64 NCZ_BLOCK_EXPONENT = 20;
+constexpr s64 NCZ_BLOCK_SIZE = 1LL << NCZ_BLOCK_EXPONENT;
+constexpr s64 NCA_HEADER_SIZE = 0x4000;
+
+struct Hfs0Header {
+    u32 magic;
+    u32 total_files;
+    u32 string_table_size;
+    u32 padding;
+};
+
+struct Hfs0FileTableEntry {
+    u64 data_offset;
+    u64 data_size;
+    u32 name_offset;
+    u32 hash_size;
+    u64 padding;
+    u8 hash[0x20];
+};
+
+struct MemorySource final : yati::source::Base {
+    explicit MemorySource(std::vector<u8>&& data) : m_data{std::move(data)} {}
+
+    Result Read(void* buf, s64 off, s64 size, u64* bytes_read) override {
+        size = std::clamp<s64>(size, 0, s64(m_data.size()) - off);
+        std::memcpy(buf, m_data.data() + off, size);
+        *bytes_read = size;
+        R_SUCCEED();
+    }
+
+    bool IsThreadSafe() const override {
+        return true;
+    }
+
+private:
+    std::vector<u8> m_data;
+};
+
+struct Nca {
+    std::vector<u8> data{};
+    u8 hash[SHA256_HASH_SIZE]{};
+};
+
+// random words between runs of zeros, so that it compresses to about a quarter.
+auto MakeNca(s64 size, u32 seed) -> Nca {
+    Nca nca{};
+    nca.data.resize(size);
+
+    u32 x = seed * 2654435761U + 1;
+    for (s64 i = 0; i < size; i += 8) {
+        if ((i / 4096) % 2) {
+            continue;
+        }
+        x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+        std::memcpy(nca.data.data() + i, &x, std::min<s64>(sizeof(x), size - i));
+    }
+
+    sha256CalculateHash(nca.hash, nca.data.data(), nca.data.size());
+    return nca;
+}
+
+#if HAVE_ZSTD
+// header, a single section covering the rest of the nca, then 1MiB zstd blocks.
+auto MakeNcz(const Nca& nca) -> std::vector<u8> {
+    BufHelper buf;
+    buf.write(nca.data.data(), NCA_HEADER_SIZE);
+
+    const auto body_size = s64(nca.data.size()) - NCA_HEADER_SIZE;
+    const ncz::Header header{ NCZ_SECTION_MAGIC, 1 };
+    const ncz::Section section{ .offset = NCA_HEADER_SIZE, .size = u64(body_size), .crypto_type = 1 };
+    buf.write(&header, sizeof(header));
+    buf.write(&section, sizeof(section));
+
+    const auto total_blocks = (body_size + NCZ_BLOCK_SIZE - 1) / NCZ_BLOCK_SIZE;
+    const ncz::BlockHeader block_header{
+        .magic = NCZ_BLOCK_MAGIC,
+        .version = 2,
+        .type = 1,
+        .block_size_exponent = NCZ_BLOCK_EXPONENT,
+        .total_blocks = u32(total_blocks),
+        .decompressed_size = u64(body_size),
+    };
+    buf.write(&block_header, sizeof(block_header));
+
+    const auto sizes_off = buf.tell();
+    std::vector<ncz::Block> sizes(total_blocks);
+    buf.write(sizes.data(), sizes.size() * sizeof(ncz::Block));
+
+    std::vector<u8> temp(ZSTD_compressBound(NCZ_BLOCK_SIZE));
+    for (s64 i = 0; i < total_blocks; i++) {
+        const auto src = nca.data.data() + NCA_HEADER_SIZE + i * NCZ_BLOCK_SIZE;
+        const auto src_size = std::min(NCZ_BLOCK_SIZE, body_size - i * NCZ_BLOCK_SIZE);
+        const auto rc = ZSTD_compress(temp.data(), temp.size(), src, src_size, 1);
+        TEST_CHECK(!ZSTD_isError(rc));
+
+        // blocks that don't compress are stored as-is.
+        if (rc < u64(src_size)) {
+            sizes[i].size = rc;
+            buf.write(temp.data(), rc);
+        } else {
+            sizes[i].size = src_size;
+            buf.write(src, src_size);
+        }
+    }
+
+    const auto end = buf.tell();
+    buf.seek(sizes_off);
+    buf.write(sizes.data(), sizes.size() * sizeof(ncz::Block));
+    buf.seek(end);
+    return buf.buf;
+}
+#endif
+
+auto BuildNsp(std::vector<std::pair<std::string, std::vector<u8>>>& files) -> std::vector<u8> {
+    std::vector<yati::container::CollectionEntry> entries;
+    for (auto& [name, data] : files) {
+        entries.emplace_back(yati::container::CollectionEntry{ .name = name, .size = s64(data.size()) });
+    }
+
+    s64 size;
+    auto out = yati::container::Nsp::Build(entries, size);
+    out.reserve(size);
+    for (auto& [name, data] : files) {
+        out.insert(out.end(), data.begin(), data.end());
+        std::vector<u8>{}.swap(data);
+    }
+
+    return out;
+}
+
+auto BuildHfs0(const std::vector<std::string>& names, const std::vector<u64>& sizes) -> std::vector<u8> {
+    std::vector<Hfs0FileTableEntry> table(names.size());
+    std::string strings;
+    u64 data_off{};
+
+    for (size_t i = 0; i < names.size(); i++) {
+        table[i].data_offset = data_off;
+        table[i].data_size = sizes[i];
+        table[i].name_offset = strings.size();
+        strings += names[i] + '\0';
+        data_off += sizes[i];
+    }
+
+    strings.resize((strings.size() + 0x1F) & ~0x1F);
+    const Hfs0Header header{ 0x30534648, u32(names.size()), u32(strings.size()) };
+
+    BufHelper buf;
+    buf.write(&header, sizeof(header));
+    buf.write(table.data(), table.size() * sizeof(Hfs0FileTableEntry));
+    buf.write(strings.data(), strings.size());
+    return buf.buf;
+}
+
+// root partition at 0xF000 containing only the secure partition.
+auto BuildXci(std::vector<std::pair<std::string, std::vector<u8>>>& files) -> std::vector<u8> {
+    std::vector<std::string> names;
+    std::vector<u64> sizes;
+    u64 secure_size{};
+    for (auto& [name, data] : files) {
+        names.emplace_back(name);
+        sizes.emplace_back(data.size());
+        secure_size += data.size();
+    }
+
+    auto secure = BuildHfs0(names, sizes);
+    secure_size += secure.size();
+
+    std::vector<u8> out(0xF000);
+    const auto root = BuildHfs0({ "secure" }, { secure_size });
+    out.insert(out.end(), root.begin(), root.end());
+    out.insert(out.end(), secure.begin(), secure.end());
+    for (auto& [name, data] : files) {
+        out.insert(out.end(), data.begin(), data.end());
+        std::vector<u8>{}.swap(data);
+    }
+
+    return out;
+}
+
+struct Options {
+    s64 nca_size{64};
+    u32 count{4};
+    u64 write_speed{};
+    std::string format{};
+};
+
+struct Stages {
+    pipeline::StageStats read{};
+    pipeline::StageStats decompress{};
+    pipeline::StageStats write{};
+    unsigned read_peak{};
+    unsigned write_peak{};
+};
+
+// installs a single nca / ncz into a placeholder, read and write are on their own threads.
+struct Install {
+    yati::source::Base* source;
+    const yati::container::CollectionEntry& entry;
+    // the expected output.
+    const Nca& nca;
+    NcmPlaceHolderId placeholder_id;
+    Stages& stages;
+
+    pipeline::Queue<4> read_queue{};
+    pipeline::Queue<4> write_queue{};
+    std::atomic_bool read_running{true};
+    std::atomic_bool decompress_running{true};
+    std::atomic_bool write_running{true};
+    std::atomic<Result> read_result{};
+    std::atomic<Result> decompress_result{};
+    std::atomic<Result> write_result{};
+
+    Result GetResults() {
+        R_TRY(read_result.load());
+        R_TRY(decompress_result.load());
+        R_TRY(write_result.load());
+        R_SUCCEED();
+    }
+
+    void WakeAll() {
+        read_queue.WakeAll();
+        write_queue.WakeAll();
+    }
+
+    Result Read() {
+        stages.read.Start();
+        ON_SCOPE_EXIT(stages.read.Stop());
+
+        for (s64 off = 0; off < entry.size && R_SUCCEEDED(GetResults());) {
+            std::vector<u8> buf(std::min<s64>(pipeline::NORMAL_BUFFER_SIZE, entry.size - off));
+            u64 bytes_read;
+            R_TRY(source->Read(buf.data(), entry.offset + off, buf.size(), &bytes_read));
+            stages.read.bytes += bytes_read;
+            R_TRY(read_queue.Push(buf, off, decompress_running, [this]{ return GetResults(); }, &stages.read));
+            off += bytes_read;
+        }
+
+        R_SUCCEED();
+    }
+
+    // passes nca data through, decompresses ncz blocks.
+    Result Decompress() {
+        stages.decompress.Start();
+        ON_SCOPE_EXIT(stages.decompress.Stop());
+
+        const auto is_ncz = entry.name.ends_with(".ncz");
+        std::vector<u8> pending;
+        std::vector<ncz::BlockInfo> blocks;
+        ncz::Index<ncz::BlockInfo> block_index;
+        u64 compressed_off{};
+        s64 write_off{};
+        Sha256Context sha256;
+        sha256ContextCreate(&sha256);
+
+#if HAVE_ZSTD
+        auto dctx = ZSTD_createDCtx();
+        ON_SCOPE_EXIT(ZSTD_freeDCtx(dctx));
+#endif
+
+        const auto push = [&](std::vector<u8>& out) -> Result {
+            sha256ContextUpdate(&sha256, out.data(), out.size());
+            const auto size = out.size();
+            stages.decompress.bytes += size;
+            R_TRY(write_queue.Push(out, write_off, write_running, [this]{ return GetResults(); }, &stages.decompress));
+            write_off += size;
+            R_SUCCEED();
+        };
+
+        for (;;) {
+            std::vector<u8> buf;
+            s64 off;
+            R_TRY(read_queue.Pop(buf, off, read_running, [this]{ return GetResults(); }, &stages.decompress));
+            if (buf.empty()) {
+                break;
+            }
+
+            if (!is_ncz) {
+                R_TRY(push(buf));
+                continue;
+            }
+
+            pending.insert(pending.end(), buf.begin(), buf.end());
+            u64 pos{};
+
+            // header, section table and block table.
+            if (blocks.empty()) {
+                const auto sections_off = NCA_HEADER_SIZE + sizeof(ncz::Header);
+                if (pending.size() < sections_off) {
+                    continue;
+                }
+
+                ncz::Header header;
+                std::memcpy(&header, pending.data() + NCA_HEADER_SIZE, sizeof(header));
+                const auto block_header_off = sections_off + header.total_sections * sizeof(ncz::Section);
+                if (pending.size() < block_header_off + sizeof(ncz::BlockHeader)) {
+                    continue;
+                }
+
+                ncz::BlockHeader block_header;
+                std::memcpy(&block_header, pending.data() + block_header_off, sizeof(block_header));
+                const auto data_off = block_header_off + sizeof(block_header) + block_header.total_blocks * sizeof(ncz::Block);
+                if (pending.size() < data_off) {
+                    continue;
+                }
+
+                for (u32 i = 0; i < block_header.total_blocks; i++) {
+                    ncz::Block block;
+                    std::memcpy(&block, pending.data() + block_header_off + sizeof(block_header) + i * sizeof(block), sizeof(block));
+                    blocks.emplace_back(ncz::BlockInfo{ compressed_off, block.size });
+                    compressed_off += block.size;
+                }
+                block_index = ncz::Index<ncz::BlockInfo>{blocks};
+                compressed_off = 0;
+
+                std::vector<u8> out(pending.begin(), pending.begin() + NCA_HEADER_SIZE);
+                R_TRY(push(out));
+                pos = data_off;
+            }
+
+            // whole blocks only, the rest waits for the next buffer.
+            while (auto block = block_index.Find(compressed_off)) {
+                if (pending.size() - pos < block->size) {
+                    break;
+                }
+
+                const auto decompressed_size = std::min<s64>(NCZ_BLOCK_SIZE, nca.data.size() - write_off);
+                std::vector<u8> out(decompressed_size);
+                if (block->size == u64(decompressed_size)) {
+                    std::memcpy(out.data(), pending.data() + pos, block->size);
+                } else {
+#if HAVE_ZSTD
+                    const auto rc = ZSTD_decompressDCtx(dctx, out.data(), out.size(), pending.data() + pos, block->size);
+                    R_UNLESS(!ZSTD_isError(rc) && rc == out.size(), Result_UsbZstdError);
+#else
+                    R_THROW(Result_UsbZstdError);
+#endif
+                }
+
+                pos += block->size;
+                compressed_off += block->size;
+                R_TRY(push(out));
+            }
+
+            pending.erase(pending.begin(), pending.begin() + pos);
+        }
+
+        u8 hash[SHA256_HASH_SIZE];
+        sha256ContextGetHash(&sha256, hash);
+        R_UNLESS(!std::memcmp(hash, nca.hash, sizeof(hash)), Result_YatiInvalidNcaSha256);
+        R_SUCCEED();
+    }
+
+    Result Write() {
+        stages.write.Start();
+        ON_SCOPE_EXIT(stages.write.Stop());
+
+        NcmContentStorage cs;
+        R_TRY(ncmOpenContentStorage(&cs, NcmStorageId_SdCard));
+        ON_SCOPE_EXIT(ncmContentStorageClose(&cs));
+
+        for (;;) {
+            std::vector<u8> buf;
+            s64 off;
+            R_TRY(write_queue.Pop(buf, off, decompress_running, [this]{ return GetResults(); }, &stages.write));
+            if (buf.empty()) {
+                break;
+            }
+
+            R_TRY(ncmContentStorageWritePlaceHolder(&cs, &placeholder_id, off, buf.data(), buf.size()));
+            stages.write.bytes += buf.size();
+        }
+
+        R_SUCCEED();
+    }
+
+    Result Run() {
+        std::thread read_thread([this]{
+            read_result = Read();
+            read_running = false;
+            WakeAll();
+        });
+
+        std::thread write_thread([this]{
+            write_result = Write();
+            write_running = false;
+            WakeAll();
+        });
+
+        decompress_result = Decompress();
+        decompress_running = false;
+        WakeAll();
+
+        read_thread.join();
+        write_thread.join();
+
+        stages.read_peak = std::max(stages.read_peak, read_queue.GetPeak());
+        stages.write_peak = std::max(stages.write_peak, write_queue.GetPeak());
+        return GetResults();
+    }
+};
+
+// sums the stats of each nca, start_tick is left at 0 so that the wall time is the sum.
+void Accumulate(pipeline::StageStats& total, const pipeline::StageStats& s) {
+    total.stop_tick += s.stop_tick - s.start_tick;
+    total.stall_in += s.stall_in;
+    total.stall_out += s.stall_out;
+    total.bytes += s.bytes;
+}
+
+bool RunFormat(const Options& options, const std::string& format) {
+    const auto compressed = format == "nsz" || format == "xcz";
+#if !HAVE_ZSTD
+    if (compressed) {
+        std::printf("%s: skipped, built without zstd\n", format.c_str());
+        return true;
+    }
+#endif
+
+    std::vector<Nca> ncas;
+    std::vector<std::pair<std::string, std::vector<u8>>> files;
+    for (u32 i = 0; i < options.count; i++) {
+        ncas.emplace_back(MakeNca(options.nca_size * 1024 * 1024, i));
+        const auto name = std::to_string(i) + (compressed ? ".ncz" : ".nca");
+#if HAVE_ZSTD
+        files.emplace_back(name, compressed ? MakeNcz(ncas.back()) : ncas.back().data);
+#else
+        files.emplace_back(name, ncas.back().data);
+#endif
+    }
+
+    s64 file_size{};
+    for (auto& [name, data] : files) {
+        file_size += data.size();
+    }
+
+    const auto is_xci = format.starts_with("xc");
+    MemorySource source{is_xci ? BuildXci(files) : BuildNsp(files)};
+
+    yati::container::Collections collections;
+    Result rc;
+    if (is_xci) {
+        rc = yati::container::Xci{&source}.GetCollections(collections);
+    } else {
+        rc = yati::container::Nsp{&source}.GetCollections(collections);
+    }
+    TEST_CHECK(R_SUCCEEDED(rc));
+    TEST_CHECK(collections.size() == ncas.size());
+
+    pipeline::StageStats read{}, decompress{}, write{};
+    unsigned read_peak{}, write_peak{};
+    const auto start = armGetSystemTick();
+
+    for (size_t i = 0; i < collections.size(); i++) {
+        NcmContentStorage cs;
+        ncmOpenContentStorage(&cs, NcmStorageId_SdCard);
+        NcmPlaceHolderId placeholder_id;
+        ncmContentStorageGeneratePlaceHolderId(&cs, &placeholder_id);
+        ncmContentStorageCreatePlaceHolder(&cs, nullptr, &placeholder_id, ncas[i].data.size());
+
+        Stages stages{};
+        Install install{&source, collections[i], ncas[i], placeholder_id, stages};
+        if (const auto rc = install.Run(); R_FAILED(rc)) {
+            std::printf("%s: install failed 0x%X\n", format.c_str(), rc);
+            return false;
+        }
+
+        std::vector<u8> out;
+        TEST_CHECK(shim::GetPlaceHolder(placeholder_id, out));
+        TEST_CHECK(out == ncas[i].data);
+        ncmContentStorageDeletePlaceHolder(&cs, &placeholder_id);
+
+        Accumulate(read, stages.read);
+        Accumulate(decompress, stages.decompress);
+        Accumulate(write, stages.write);
+        read_peak = std::max(read_peak, stages.read_peak);
+        write_peak = std::max(write_peak, stages.write_peak);
+    }
+
+    const auto wall_ns = armTicksToNs(armGetSystemTick() - start);
+    const auto mib = double(file_size) / 1024.0 / 1024.0;
+    std::printf("%s: %.1f MiB in %.1f ms, %.2f MiB/s, queue peak read: %u write: %u\n",
+        format.c_str(), mib, wall_ns / 1e6, mib / (wall_ns / 1e9), read_peak, write_peak);
+
+    read.Log("read");
+    decompress.Log("decompress");
+    write.Log("write");
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options{};
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const std::string arg = argv[i];
+        if (arg == "--size") {
+            options.nca_size = std::stoll(argv[i + 1]);
+        } else if (arg == "--count") {
+            options.count = std::stoul(argv[i + 1]);
+        } else if (arg == "--write-speed") {
+            options.write_speed = std::stoull(argv[i + 1]);
+        } else if (arg == "--format") {
+            options.format = argv[i + 1];
+        } else {
+            std::fprintf(stderr, "unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    shim::SetLogEnabled(true);
+    if (options.write_speed) {
+        shim::SetWriteLatency(0, 1e+9 / options.write_speed);
+    }
+
+    bool ok = true;
+    for (const auto& format : { "nsp", "nsz", "xci", "xcz" }) {
+        if (options.format.empty() || options.format == format) {
+            ok &= RunFormat(options, format);
+        }
+    }
+
+    return ok ? 0 : 1;
+}
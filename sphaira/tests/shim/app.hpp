@@ -0,0 +1,20 @@
+#pragma once
+
+// stand-in for the app, which pulls in the whole ui.
+// only the static helpers used by the host built sources are provided.
+
+#include <switch.h>
+
+namespace sphaira {
+
+struct App {
+    static auto IsFileBaseEmummc() -> bool {
+        return false;
+    }
+
+    static void SetAutoSleepDisabled(bool enable) {
+
+    }
+};
+
+} // namespace sphaira
@@ -0,0 +1,399 @@
+#include "shim.hpp"
+#include "log.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <algorithm>
+
+namespace {
+
+std::atomic_bool g_log_enabled{};
+
+std::mutex g_event_mutex;
+std::condition_variable g_event_cv;
+
+std::mutex g_ncm_mutex;
+std::map<std::vector<u8>, std::vector<u8>> g_placeholders;
+u64 g_placeholder_counter{};
+
+std::atomic<u64> g_write_fixed_ns{};
+std::atomic<u64> g_write_ns_per_mib{};
+std::atomic<u32> g_fail_after{};
+std::atomic<Result> g_fail_rc{};
+std::atomic<u32> g_writers{};
+std::atomic<u32> g_peak_writers{};
+
+auto Key(const NcmPlaceHolderId& id) {
+    return std::vector<u8>(id.uuid, id.uuid + sizeof(id.uuid));
+}
+
+constexpr u32 K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+constexpr u32 Rotr(u32 x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+void Sha256Block(Sha256Context* ctx, const u8* block) {
+    u32 w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = u32(block[i * 4]) << 24 | u32(block[i * 4 + 1]) << 16 | u32(block[i * 4 + 2]) << 8 | u32(block[i * 4 + 3]);
+    }
+    for (int i = 16; i < 64; i++) {
+        const auto s0 = Rotr(w[i - 15], 7) ^ Rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        const auto s1 = Rotr(w[i - 2], 17) ^ Rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    auto h = ctx->intermediate_hash;
+    u32 a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], hh = h[7];
+    for (int i = 0; i < 64; i++) {
+        const auto t1 = hh + (Rotr(e, 6) ^ Rotr(e, 11) ^ Rotr(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+        const auto t2 = (Rotr(a, 2) ^ Rotr(a, 13) ^ Rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        hh = g; g = f; f = e; e = d + t1; d = c; c = b; b = a; a = t1 + t2;
+    }
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e; h[5] += f; h[6] += g; h[7] += hh;
+}
+
+} // namespace
+
+extern "C" {
+
+void log_write(const char* s, ...) {
+    if (!g_log_enabled) {
+        return;
+    }
+
+    std::va_list v;
+    va_start(v, s);
+    std::vfprintf(stdout, s, v);
+    va_end(v);
+}
+
+void log_write_arg(const char* s, va_list* v) {
+    if (g_log_enabled) {
+        std::vfprintf(stdout, s, *v);
+    }
+}
+
+} // extern "C"
+
+u64 armGetSystemTick() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void svcSleepThread(s64 nano) {
+    if (nano <= 0) {
+        std::this_thread::yield();
+    } else {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(nano));
+    }
+}
+
+u32 svcGetCurrentProcessorNumber() {
+    return 0;
+}
+
+Result condvarWaitTimeout(CondVar* c, Mutex* m, u64 timeout) {
+    if (c->cv.wait_for(m->m, std::chrono::nanoseconds(timeout)) == std::cv_status::timeout) {
+        return KERNELRESULT(TimedOut);
+    }
+    return 0;
+}
+
+Result threadCreate(Thread* t, ThreadFunc entry, void* arg, void*, size_t, int, int) {
+    static std::atomic<Handle> handle{1};
+    t->handle = handle++;
+    t->entry = entry;
+    t->arg = arg;
+    return 0;
+}
+
+Result threadStart(Thread* t) {
+    t->t = std::thread(t->entry, t->arg);
+    return 0;
+}
+
+Result threadWaitForExit(Thread* t) {
+    if (t->t.joinable()) {
+        t->t.join();
+    }
+    return 0;
+}
+
+Result threadClose(Thread* t) {
+    return threadWaitForExit(t);
+}
+
+Result eventCreate(Event* t, bool autoclear) {
+    std::scoped_lock lock{g_event_mutex};
+    t->signaled = false;
+    t->autoclear = autoclear;
+    return 0;
+}
+
+Result eventWait(Event* t, u64 timeout) {
+    s32 idx;
+    return shim::WaitAny(&idx, {t}, timeout);
+}
+
+Result eventFire(Event* t) {
+    std::scoped_lock lock{g_event_mutex};
+    t->signaled = true;
+    g_event_cv.notify_all();
+    return 0;
+}
+
+Result eventClear(Event* t) {
+    std::scoped_lock lock{g_event_mutex};
+    t->signaled = false;
+    return 0;
+}
+
+void ueventCreate(UEvent* uevent, bool autoclear) {
+    std::scoped_lock lock{g_event_mutex};
+    uevent->signaled = false;
+    uevent->autoclear = autoclear;
+}
+
+void ueventSignal(UEvent* uevent) {
+    std::scoped_lock lock{g_event_mutex};
+    uevent->signaled = true;
+    g_event_cv.notify_all();
+}
+
+void ueventClear(UEvent* uevent) {
+    std::scoped_lock lock{g_event_mutex};
+    uevent->signaled = false;
+}
+
+void sha256ContextCreate(Sha256Context* out) {
+    static constexpr u32 H[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+
+    std::memset(out, 0, sizeof(*out));
+    std::memcpy(out->intermediate_hash, H, sizeof(H));
+}
+
+void sha256ContextUpdate(Sha256Context* ctx, const void* src, size_t size) {
+    auto p = static_cast<const u8*>(src);
+    ctx->bits_consumed += u64(size) * 8;
+
+    while (size) {
+        const auto n = std::min(size, sizeof(ctx->buffer) - ctx->num_buffered);
+        std::memcpy(ctx->buffer + ctx->num_buffered, p, n);
+        ctx->num_buffered += n;
+        p += n;
+        size -= n;
+
+        if (ctx->num_buffered == sizeof(ctx->buffer)) {
+            Sha256Block(ctx, ctx->buffer);
+            ctx->num_buffered = 0;
+        }
+    }
+}
+
+void sha256ContextGetHash(Sha256Context* ctx, void* dst) {
+    if (!ctx->finalized) {
+        const auto bits = ctx->bits_consumed;
+        const u8 pad = 0x80;
+        const u8 zero = 0;
+        sha256ContextUpdate(ctx, &pad, 1);
+        while (ctx->num_buffered != 56) {
+            sha256ContextUpdate(ctx, &zero, 1);
+        }
+
+        u8 len[8];
+        for (int i = 0; i < 8; i++) {
+            len[i] = u8(bits >> (56 - i * 8));
+        }
+        sha256ContextUpdate(ctx, len, sizeof(len));
+        ctx->finalized = true;
+    }
+
+    auto out = static_cast<u8*>(dst);
+    for (int i = 0; i < 8; i++) {
+        const auto v = ctx->intermediate_hash[i];
+        out[i * 4 + 0] = u8(v >> 24);
+        out[i * 4 + 1] = u8(v >> 16);
+        out[i * 4 + 2] = u8(v >> 8);
+        out[i * 4 + 3] = u8(v);
+    }
+}
+
+void sha256CalculateHash(void* dst, const void* src, size_t size) {
+    Sha256Context ctx;
+    sha256ContextCreate(&ctx);
+    sha256ContextUpdate(&ctx, src, size);
+    sha256ContextGetHash(&ctx, dst);
+}
+
+Result ncmOpenContentStorage(NcmContentStorage* out, NcmStorageId storage_id) {
+    out->storage_id = storage_id;
+    return 0;
+}
+
+void ncmContentStorageClose(NcmContentStorage*) {
+}
+
+Result ncmContentStorageGeneratePlaceHolderId(NcmContentStorage*, NcmPlaceHolderId* out_id) {
+    std::scoped_lock lock{g_ncm_mutex};
+    std::memset(out_id, 0, sizeof(*out_id));
+    const auto id = ++g_placeholder_counter;
+    std::memcpy(out_id->uuid, &id, sizeof(id));
+    return 0;
+}
+
+Result ncmContentStorageCreatePlaceHolder(NcmContentStorage*, const NcmContentId*, const NcmPlaceHolderId* placeholder_id, s64 size) {
+    std::scoped_lock lock{g_ncm_mutex};
+    g_placeholders[Key(*placeholder_id)].assign(size, 0);
+    return 0;
+}
+
+Result ncmContentStorageDeletePlaceHolder(NcmContentStorage*, const NcmPlaceHolderId* placeholder_id) {
+    std::scoped_lock lock{g_ncm_mutex};
+    if (!g_placeholders.erase(Key(*placeholder_id))) {
+        return MAKERESULT(Module_Libnx, LibnxError_NotFound);
+    }
+    return 0;
+}
+
+Result ncmContentStorageHasPlaceHolder(NcmContentStorage*, bool* out, const NcmPlaceHolderId* placeholder_id) {
+    std::scoped_lock lock{g_ncm_mutex};
+    *out = g_placeholders.contains(Key(*placeholder_id));
+    return 0;
+}
+
+Result ncmContentStorageWritePlaceHolder(NcmContentStorage*, const NcmPlaceHolderId* placeholder_id, u64 offset, const void* data, size_t data_size) {
+    const auto writers = ++g_writers;
+    auto peak = g_peak_writers.load();
+    while (writers > peak && !g_peak_writers.compare_exchange_weak(peak, writers)) {
+    }
+
+    // the delay is outside of the lock, as writes to different placeholders run in parallel.
+    const auto latency = g_write_fixed_ns + g_write_ns_per_mib * data_size / (1024 * 1024);
+    if (latency) {
+        svcSleepThread(latency);
+    }
+
+    auto n = g_fail_after.load();
+    while (n && !g_fail_after.compare_exchange_weak(n, n - 1)) {
+    }
+
+    Result rc = 0;
+    if (n == 1) {
+        rc = g_fail_rc;
+    } else {
+        std::scoped_lock lock{g_ncm_mutex};
+        auto it = g_placeholders.find(Key(*placeholder_id));
+        if (it == g_placeholders.end()) {
+            rc = MAKERESULT(Module_Libnx, LibnxError_NotFound);
+        } else {
+            auto& buf = it->second;
+            if (offset + data_size > buf.size()) {
+                buf.resize(offset + data_size);
+            }
+            std::memcpy(buf.data() + offset, data, data_size);
+        }
+    }
+
+    g_writers--;
+    return rc;
+}
+
+Result ncmContentStorageSetPlaceHolderSize(NcmContentStorage*, const NcmPlaceHolderId* placeholder_id, s64 size) {
+    std::scoped_lock lock{g_ncm_mutex};
+    auto it = g_placeholders.find(Key(*placeholder_id));
+    if (it == g_placeholders.end()) {
+        return MAKERESULT(Module_Libnx, LibnxError_NotFound);
+    }
+    it->second.resize(size);
+    return 0;
+}
+
+Result ncmContentStorageFlushPlaceHolder(NcmContentStorage*) {
+    return 0;
+}
+
+namespace shim {
+
+void SetLogEnabled(bool enable) {
+    g_log_enabled = enable;
+}
+
+void SetWriteLatency(u64 fixed_ns, u64 ns_per_mib) {
+    g_write_fixed_ns = fixed_ns;
+    g_write_ns_per_mib = ns_per_mib;
+}
+
+void FailWriteAfter(u32 count, Result rc) {
+    g_fail_rc = rc;
+    g_fail_after = count;
+}
+
+auto GetPeakWriters() -> u32 {
+    return g_peak_writers;
+}
+
+void ResetPeakWriters() {
+    g_peak_writers = 0;
+}
+
+Result WaitAny(s32* idx, std::initializer_list<ShimEvent*> events, u64 timeout) {
+    std::unique_lock lock{g_event_mutex};
+    const auto signaled = [&] {
+        *idx = 0;
+        for (auto e : events) {
+            if (e->signaled) {
+                if (e->autoclear) {
+                    e->signaled = false;
+                }
+                return true;
+            }
+            (*idx)++;
+        }
+        return false;
+    };
+
+    // UINT64_MAX waits forever, as it does on the switch.
+    if (timeout == UINT64_MAX) {
+        g_event_cv.wait(lock, signaled);
+    } else if (!g_event_cv.wait_for(lock, std::chrono::nanoseconds(timeout), signaled)) {
+        return KERNELRESULT(TimedOut);
+    }
+    return 0;
+}
+
+auto GetPlaceHolder(const NcmPlaceHolderId& id, std::vector<u8>& out) -> bool {
+    std::scoped_lock lock{g_ncm_mutex};
+    auto it = g_placeholders.find(Key(id));
+    if (it == g_placeholders.end()) {
+        return false;
+    }
+    out = it->second;
+    return true;
+}
+
+auto GetPlaceHolderCount() -> size_t {
+    std::scoped_lock lock{g_ncm_mutex};
+    return g_placeholders.size();
+}
+
+void ClearPlaceHolders() {
+    std::scoped_lock lock{g_ncm_mutex};
+    g_placeholders.clear();
+}
+
+} // namespace shim
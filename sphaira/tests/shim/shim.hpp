@@ -0,0 +1,32 @@
+#pragma once
+
+// test controls for the host shim.
+
+#include <switch.h>
+#include <vector>
+#include <initializer_list>
+
+namespace shim {
+
+// log_write() output is dropped unless enabled.
+void SetLogEnabled(bool enable);
+
+// delay added to every placeholder write, to model the speed of the storage.
+void SetWriteLatency(u64 fixed_ns, u64 ns_per_mib);
+
+// fails the nth placeholder write from now (1 being the next), 0 to disable.
+void FailWriteAfter(u32 count, Result rc);
+
+// the most placeholder writes that were in flight at once.
+auto GetPeakWriters() -> u32;
+void ResetPeakWriters();
+
+// waits for any of the events, idx being the one that was signalled.
+Result WaitAny(s32* idx, std::initializer_list<ShimEvent*> events, u64 timeout);
+
+// returns false if the placeholder doesn't exist.
+auto GetPlaceHolder(const NcmPlaceHolderId& id, std::vector<u8>& out) -> bool;
+auto GetPlaceHolderCount() -> size_t;
+void ClearPlaceHolders();
+
+} // namespace shim
@@ -0,0 +1,162 @@
+#pragma once
+
+// minimal stand-in for libnx, so that the parts of sphaira which only use
+// the threading / crypto / ncm primitives can be built and tested on the host.
+// only what those parts use is provided.
+
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+typedef u32 Result;
+typedef u32 Handle;
+
+#define BIT(n) (1U<<(n))
+#define NX_PACKED __attribute__((packed))
+
+#define R_SUCCEEDED(res) ((res) == 0)
+#define R_FAILED(res) ((res) != 0)
+#define R_MODULE(res) ((res) & 0x1FF)
+#define R_DESCRIPTION(res) (((res) >> 9) & 0x1FFF)
+#define R_VALUE(res) ((res) & 0x3FFFFF)
+#define MAKERESULT(module, description) ((((module) & 0x1FF)) | ((description) & 0x1FFF) << 9)
+
+enum {
+    Module_Kernel = 1,
+    Module_Libnx = 345,
+};
+
+enum {
+    KernelError_TimedOut = 117,
+    KernelError_Cancelled = 118,
+};
+
+enum {
+    LibnxError_BadInput = 4,
+    LibnxError_OutOfMemory = 2,
+    LibnxError_NotFound = 13,
+};
+
+#define KERNELRESULT(desc) MAKERESULT(Module_Kernel, KernelError_##desc)
+
+// ticks are ns on the host.
+u64 armGetSystemTick();
+static inline u64 armGetSystemTickFreq() { return 1000000000; }
+static inline u64 armTicksToNs(u64 tick) { return tick; }
+static inline u64 armNsToTicks(u64 ns) { return ns; }
+
+void svcSleepThread(s64 nano);
+u32 svcGetCurrentProcessorNumber();
+
+// mutex / condvar.
+struct Mutex {
+    std::mutex m;
+};
+
+struct CondVar {
+    std::condition_variable_any cv;
+};
+
+static inline void mutexInit(Mutex*) {}
+static inline void mutexLock(Mutex* m) { m->m.lock(); }
+static inline void mutexUnlock(Mutex* m) { m->m.unlock(); }
+static inline bool mutexTryLock(Mutex* m) { return m->m.try_lock(); }
+
+static inline void condvarInit(CondVar*) {}
+Result condvarWaitTimeout(CondVar* c, Mutex* m, u64 timeout);
+static inline Result condvarWait(CondVar* c, Mutex* m) { c->cv.wait(m->m); return 0; }
+static inline Result condvarWakeOne(CondVar* c) { c->cv.notify_one(); return 0; }
+static inline Result condvarWakeAll(CondVar* c) { c->cv.notify_all(); return 0; }
+
+// threads, started on threadStart() and joined on threadWaitForExit() / threadClose().
+typedef void (*ThreadFunc)(void*);
+
+struct Thread {
+    Handle handle;
+    ThreadFunc entry;
+    void* arg;
+    std::thread t;
+};
+
+Result threadCreate(Thread* t, ThreadFunc entry, void* arg, void* stack_mem, size_t stack_sz, int prio, int cpuid);
+Result threadStart(Thread* t);
+Result threadWaitForExit(Thread* t);
+Result threadClose(Thread* t);
+
+// events, all events share a single lock so that shim::WaitAny() can wait on several.
+struct ShimEvent {
+    bool signaled;
+    bool autoclear;
+};
+
+struct Event : ShimEvent {};
+struct UEvent : ShimEvent {};
+
+Result eventCreate(Event* t, bool autoclear);
+Result eventWait(Event* t, u64 timeout);
+Result eventFire(Event* t);
+Result eventClear(Event* t);
+static inline void eventClose(Event*) {}
+
+void ueventCreate(UEvent* uevent, bool autoclear);
+void ueventSignal(UEvent* uevent);
+void ueventClear(UEvent* uevent);
+
+// sha256.
+#define SHA256_HASH_SIZE 0x20
+
+struct Sha256Context {
+    u32 intermediate_hash[8];
+    u8 buffer[0x40];
+    u64 bits_consumed;
+    size_t num_buffered;
+    bool finalized;
+};
+
+void sha256ContextCreate(Sha256Context* out);
+void sha256ContextUpdate(Sha256Context* ctx, const void* src, size_t size);
+void sha256ContextGetHash(Sha256Context* ctx, void* dst);
+void sha256CalculateHash(void* dst, const void* src, size_t size);
+
+// ncm, placeholders are kept in memory, see shim.hpp for inspecting them.
+typedef enum {
+    NcmStorageId_None = 0,
+    NcmStorageId_Host = 1,
+    NcmStorageId_GameCard = 2,
+    NcmStorageId_BuiltInSystem = 3,
+    NcmStorageId_BuiltInUser = 4,
+    NcmStorageId_SdCard = 5,
+    NcmStorageId_Any = 6,
+} NcmStorageId;
+
+typedef struct {
+    u8 c[0x10];
+} NcmContentId;
+
+typedef struct {
+    u8 uuid[0x10];
+} NcmPlaceHolderId;
+
+typedef struct {
+    NcmStorageId storage_id;
+} NcmContentStorage;
+
+Result ncmOpenContentStorage(NcmContentStorage* out, NcmStorageId storage_id);
+void ncmContentStorageClose(NcmContentStorage* cs);
+Result ncmContentStorageGeneratePlaceHolderId(NcmContentStorage* cs, NcmPlaceHolderId* out_id);
+Result ncmContentStorageCreatePlaceHolder(NcmContentStorage* cs, const NcmContentId* content_id, const NcmPlaceHolderId* placeholder_id, s64 size);
+Result ncmContentStorageDeletePlaceHolder(NcmContentStorage* cs, const NcmPlaceHolderId* placeholder_id);
+Result ncmContentStorageHasPlaceHolder(NcmContentStorage* cs, bool* out, const NcmPlaceHolderId* placeholder_id);
+Result ncmContentStorageWritePlaceHolder(NcmContentStorage* cs, const NcmPlaceHolderId* placeholder_id, u64 offset, const void* data, size_t data_size);
+Result ncmContentStorageSetPlaceHolderSize(NcmContentStorage* cs, const NcmPlaceHolderId* placeholder_id, s64 size);
+Result ncmContentStorageFlushPlaceHolder(NcmContentStorage* cs);
@@ -0,0 +1,19 @@
+#pragma once
+
+// tiny assert based test helper, each test is its own executable and ctest
+// treats a non-zero exit as a failure.
+
+#include <cstdio>
+#include <cstdlib>
+
+#define TEST_CHECK(expr) do { \
+    if (!(expr)) { \
+        std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #expr); \
+        std::exit(1); \
+    } \
+} while (0)
+
+#define TEST_RUN(func) do { \
+    std::printf("%s\n", #func); \
+    func(); \
+} while (0)
@@ -0,0 +1,269 @@
+#include "test.hpp"
+#include "shim.hpp"
+#include "defines.hpp"
+#include "yati/journal.hpp"
+#include "yati/source/base.hpp"
+#include <cstring>
+#include <optional>
+
+using namespace sphaira;
+using namespace sphaira::yati;
+
+namespace {
+
+constexpr s64 HEADER_SIZE = 0x4000;
+constexpr s64 BUFFER_SIZE = 1024*16;
+constexpr s64 INTERVAL = 1024*64;
+constexpr s64 NCA_SIZE = 1024*1024;
+constexpr Result RESULT_TRUNCATED = MAKERESULT(Module_Libnx, 3);
+
+// fails any read past limit, as a usb cable being pulled would.
+struct TruncatingSource final : source::Base {
+    TruncatingSource(const std::vector<u8>& data, s64 limit) : m_data{data}, m_limit{limit} {}
+
+    Result Read(void* buf, s64 off, s64 size, u64* bytes_read) override {
+        R_UNLESS(off < m_limit, RESULT_TRUNCATED);
+        size = std::min(size, m_limit - off);
+        std::memcpy(buf, m_data.data() + off, size);
+        *bytes_read = size;
+        m_total += size;
+        R_SUCCEED();
+    }
+
+    auto GetTotalRead() const -> s64 {
+        return m_total;
+    }
+
+private:
+    const std::vector<u8>& m_data;
+    const s64 m_limit;
+    s64 m_total{};
+};
+
+// the read, decompress and write steps of yati for a single nca, run in order on
+// a single thread, using the same resume decisions.
+// the journal file is kept in memory.
+struct Installer {
+    Installer(source::Base* source, std::vector<u8>& journal_file) : m_source{source}, m_journal_file{journal_file} {
+        ncmOpenContentStorage(&m_cs, NcmStorageId_SdCard);
+    }
+
+    // starts from the journal if it has an entry for the placeholder, else creates it.
+    void Start(const NcmContentId& content_id) {
+        std::vector<journal::Entry> entries;
+        if (journal::Decode(m_journal_file, entries) && !entries.empty()) {
+            const auto& e = entries.front();
+            bool has_placeholder{};
+            if (!std::memcmp(&e.content_id, &content_id, sizeof(content_id)) && R_SUCCEEDED(ncmContentStorageHasPlaceHolder(&m_cs, &has_placeholder, &e.placeholder_id)) && has_placeholder) {
+                m_entry = e;
+                m_tracker = journal::Tracker{e.committed, INTERVAL};
+                return;
+            }
+        }
+
+        m_entry.content_id = content_id;
+        m_entry.size = NCA_SIZE;
+        ncmContentStorageGeneratePlaceHolderId(&m_cs, &m_entry.placeholder_id);
+        ncmContentStorageCreatePlaceHolder(&m_cs, &content_id, &m_entry.placeholder_id, NCA_SIZE);
+        m_tracker = journal::Tracker{0, INTERVAL};
+    }
+
+    Result Run(u8* hash_out) {
+        Sha256Context sha256;
+        sha256ContextCreate(&sha256);
+        std::optional<journal::Entry> checkpoint;
+        std::vector<u8> buf;
+        s64 off{};
+        s64 written{};
+
+        while (off < NCA_SIZE) {
+            // read.
+            buf.resize(std::min(off ? BUFFER_SIZE : HEADER_SIZE, NCA_SIZE - off));
+            u64 bytes_read;
+            R_TRY(m_source->Read(buf.data(), off, buf.size(), &bytes_read));
+            buf.resize(bytes_read);
+
+            // decompress.
+            sha256ContextUpdate(&sha256, buf.data(), buf.size());
+            written += buf.size();
+            const auto action = m_tracker.Update(off, written);
+            if (action == journal::Action::Resume) {
+                sha256 = m_entry.sha256;
+                written = m_tracker.GetResumeOffset();
+            } else if (action == journal::Action::Checkpoint) {
+                checkpoint = m_entry;
+                checkpoint->committed = written;
+                checkpoint->sha256 = sha256;
+            }
+
+            // write.
+            R_TRY(ncmContentStorageWritePlaceHolder(&m_cs, &m_entry.placeholder_id, off, buf.data(), buf.size()));
+            off = m_tracker.NextOffset(off, buf.size());
+
+            // commit once the checkpoint has been written.
+            if (checkpoint && checkpoint->committed <= off) {
+                m_journal_file = journal::Encode({ &*checkpoint, 1 });
+                checkpoint.reset();
+            }
+        }
+
+        sha256ContextGetHash(&sha256, hash_out);
+        R_SUCCEED();
+    }
+
+    auto GetEntry() const -> const journal::Entry& {
+        return m_entry;
+    }
+
+private:
+    source::Base* const m_source;
+    std::vector<u8>& m_journal_file;
+    NcmContentStorage m_cs{};
+    journal::Entry m_entry{};
+    journal::Tracker m_tracker{};
+};
+
+auto MakeData(s64 size) -> std::vector<u8> {
+    std::vector<u8> data(size);
+    u32 x = 1;
+    for (auto& e : data) {
+        x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+        e = x;
+    }
+    return data;
+}
+
+auto MakeEntry(s64 committed, s64 size) -> journal::Entry {
+    journal::Entry e{};
+    e.content_id.c[0] = committed;
+    e.committed = committed;
+    e.size = size;
+    sha256ContextCreate(&e.sha256);
+    return e;
+}
+
+void TestEncodeDecode() {
+    const journal::Entry entries[] = { MakeEntry(10, 20), MakeEntry(20, 20) };
+    auto data = journal::Encode(entries);
+
+    std::vector<journal::Entry> out;
+    TEST_CHECK(journal::Decode(data, out));
+    TEST_CHECK(out.size() == 2);
+    TEST_CHECK(!std::memcmp(out.data(), entries, sizeof(entries)));
+
+    // empty.
+    TEST_CHECK(journal::Decode(journal::Encode({}), out));
+    TEST_CHECK(out.empty());
+
+    // truncated.
+    TEST_CHECK(!journal::Decode({ data.data(), data.size() - 1 }, out));
+    TEST_CHECK(!journal::Decode({ data.data(), 3 }, out));
+    TEST_CHECK(out.empty());
+
+    // bad magic and version.
+    auto bad = data;
+    bad[0] ^= 1;
+    TEST_CHECK(!journal::Decode(bad, out));
+    bad = data;
+    bad[4] ^= 1;
+    TEST_CHECK(!journal::Decode(bad, out));
+}
+
+// entries that cannot be resumed from are dropped, the rest are kept.
+void TestDecodeBadCheckpoint() {
+    const journal::Entry entries[] = { MakeEntry(30, 20), MakeEntry(0, 20), MakeEntry(5, 20) };
+    std::vector<journal::Entry> out;
+    TEST_CHECK(journal::Decode(journal::Encode(entries), out));
+    TEST_CHECK(out.size() == 1);
+    TEST_CHECK(out[0].committed == 5);
+}
+
+void TestTracker() {
+    // not resuming, every buffer follows the last.
+    journal::Tracker none{0, 100};
+    TEST_CHECK(none.NextOffset(0, 10) == 10);
+    TEST_CHECK(none.Update(0, 10) == journal::Action::None);
+    TEST_CHECK(none.Update(10, 99) == journal::Action::None);
+    TEST_CHECK(none.Update(99, 100) == journal::Action::Checkpoint);
+    TEST_CHECK(none.Update(100, 150) == journal::Action::None);
+    TEST_CHECK(none.Update(150, 200) == journal::Action::Checkpoint);
+
+    // resuming, the header is processed then skips to the checkpoint.
+    journal::Tracker resume{500, 100};
+    TEST_CHECK(resume.NextOffset(0, 10) == 500);
+    TEST_CHECK(resume.NextOffset(500, 10) == 510);
+    TEST_CHECK(resume.Update(0, 10) == journal::Action::Resume);
+    TEST_CHECK(resume.Update(500, 590) == journal::Action::None);
+    TEST_CHECK(resume.Update(590, 600) == journal::Action::Checkpoint);
+}
+
+// an install cut short is resumed from the last checkpoint, producing the same data and hash.
+void TestResume() {
+    shim::ClearPlaceHolders();
+    const auto data = MakeData(NCA_SIZE);
+    u8 expected[SHA256_HASH_SIZE];
+    sha256CalculateHash(expected, data.data(), data.size());
+
+    NcmContentId content_id{};
+    content_id.c[0] = 0xAB;
+    std::vector<u8> journal_file;
+
+    // cut off part way through a buffer.
+    constexpr s64 LIMIT = 600 * 1024 + 100;
+    TruncatingSource truncated{data, LIMIT};
+    Installer first{&truncated, journal_file};
+    first.Start(content_id);
+    u8 hash[SHA256_HASH_SIZE];
+    TEST_CHECK(first.Run(hash) == RESULT_TRUNCATED);
+
+    std::vector<journal::Entry> entries;
+    TEST_CHECK(journal::Decode(journal_file, entries));
+    TEST_CHECK(entries.size() == 1);
+    TEST_CHECK(entries[0].committed == LIMIT / INTERVAL * INTERVAL);
+
+    TruncatingSource full{data, NCA_SIZE};
+    Installer second{&full, journal_file};
+    second.Start(content_id);
+    TEST_CHECK(!std::memcmp(&second.GetEntry().placeholder_id, &first.GetEntry().placeholder_id, sizeof(NcmPlaceHolderId)));
+    TEST_CHECK(R_SUCCEEDED(second.Run(hash)));
+
+    // only the header and the data after the checkpoint are read again.
+    TEST_CHECK(full.GetTotalRead() == HEADER_SIZE + NCA_SIZE - entries[0].committed);
+    TEST_CHECK(!std::memcmp(hash, expected, sizeof(hash)));
+
+    std::vector<u8> out;
+    TEST_CHECK(shim::GetPlaceHolder(second.GetEntry().placeholder_id, out));
+    TEST_CHECK(out == data);
+}
+
+// the placeholder was deleted, so the install starts again.
+void TestResumeMissingPlaceHolder() {
+    shim::ClearPlaceHolders();
+    const auto data = MakeData(NCA_SIZE);
+    NcmContentId content_id{};
+    std::vector<u8> journal_file;
+
+    TruncatingSource truncated{data, NCA_SIZE / 2};
+    Installer first{&truncated, journal_file};
+    first.Start(content_id);
+    u8 hash[SHA256_HASH_SIZE];
+    TEST_CHECK(first.Run(hash) == RESULT_TRUNCATED);
+    TEST_CHECK(!journal_file.empty());
+
+    shim::ClearPlaceHolders();
+    TruncatingSource full{data, NCA_SIZE};
+    Installer second{&full, journal_file};
+    second.Start(content_id);
+    TEST_CHECK(R_SUCCEEDED(second.Run(hash)));
+    TEST_CHECK(full.GetTotalRead() == NCA_SIZE);
+}
+
+} // namespace
+
+int main() {
+    TEST_RUN(TestEncodeDecode);
+    TEST_RUN(TestDecodeBadCheckpoint);
+    TEST_RUN(TestTracker);
+    TEST_RUN(TestResume);
+    TEST_RUN(TestResumeMissingPlaceHolder);
+}
@@ -0,0 +1,118 @@
+#include "test.hpp"
+#include "yati/nx/ncz.hpp"
+#include <vector>
+
+using namespace sphaira;
+
+namespace {
+
+const ncz::BlockInfo BLOCKS[] = {
+    { 0, 10 }, { 10, 5 }, { 15, 1 }, { 20, 10 },
+};
+
+void TestFind() {
+    ncz::Index<ncz::BlockInfo> index{BLOCKS};
+    TEST_CHECK(index.Find(0) == &BLOCKS[0]);
+    TEST_CHECK(index.Find(9) == &BLOCKS[0]);
+    TEST_CHECK(index.Find(10) == &BLOCKS[1]);
+    TEST_CHECK(index.Find(15) == &BLOCKS[2]);
+    // gap between blocks.
+    TEST_CHECK(index.Find(17) == nullptr);
+    TEST_CHECK(index.Find(29) == &BLOCKS[3]);
+    TEST_CHECK(index.IsLast(index.Find(29)));
+    TEST_CHECK(index.Find(30) == nullptr);
+    // backwards, which skips the cached entry.
+    TEST_CHECK(index.Find(3) == &BLOCKS[0]);
+}
+
+void TestFindRange() {
+    const ncz::Index<ncz::BlockInfo> index{BLOCKS};
+    const auto check = [&](u64 off, u64 size, size_t first, size_t count) {
+        const auto range = index.FindRange(off, size);
+        return range.size() == count && (!count || range.data() == &BLOCKS[first]);
+    };
+
+    // within a single entry.
+    TEST_CHECK(check(2, 3, 0, 1));
+    // ends exactly on the boundary.
+    TEST_CHECK(check(0, 10, 0, 1));
+    // crosses a boundary.
+    TEST_CHECK(check(8, 4, 0, 2));
+    // spans every entry, including the gap.
+    TEST_CHECK(check(0, 30, 0, 4));
+    // starts in the gap.
+    TEST_CHECK(check(17, 5, 3, 1));
+    // only the gap.
+    TEST_CHECK(check(16, 4, 0, 0));
+    // past the end.
+    TEST_CHECK(check(30, 10, 0, 0));
+    TEST_CHECK(check(100, 1, 0, 0));
+}
+
+// same layout as an ncz split into 16 sections, each flush of 4MiB crossing at most one boundary.
+void TestFindRangeSections() {
+    std::vector<ncz::Section> sections(16);
+    for (size_t i = 0; i < sections.size(); i++) {
+        sections[i].offset = 0x4000 + i * 0x300000;
+        sections[i].size = 0x300000;
+    }
+
+    const ncz::Index<ncz::Section> index{sections};
+    for (u64 off = 0x4000; off < sections.back().offset + sections.back().size; off += 0x400000) {
+        const auto range = index.FindRange(off, 0x400000);
+        TEST_CHECK(!range.empty() && range.size() <= 3);
+        TEST_CHECK(range.front().InRange(off));
+        // every range is contiguous, so the whole flush is covered.
+        for (size_t i = 1; i < range.size(); i++) {
+            TEST_CHECK(range[i].offset == range[i - 1].offset + range[i - 1].size);
+        }
+    }
+}
+
+// lookup cost against the number of blocks, sequential being the install pattern.
+void BenchLookup() {
+    for (u32 count : { 16, 256, 4096, 65536, 1048576 }) {
+        std::vector<ncz::BlockInfo> blocks(count);
+        for (u32 i = 0; i < count; i++) {
+            blocks[i] = { u64(i) * 0x10000, 0x10000 };
+        }
+
+        constexpr u32 LOOKUPS = 1000000;
+        const auto end = u64(count) * 0x10000;
+        u64 found{};
+
+        ncz::Index<ncz::BlockInfo> index{blocks};
+        auto tick = armGetSystemTick();
+        for (u32 i = 0; i < LOOKUPS; i++) {
+            found += index.Find(u64(i) * 0x1000 % end) != nullptr;
+        }
+        const auto seq_ns = armTicksToNs(armGetSystemTick() - tick);
+
+        u32 x = 1;
+        tick = armGetSystemTick();
+        for (u32 i = 0; i < LOOKUPS; i++) {
+            x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+            found += index.Find(u64(x) * 0x1000 % end) != nullptr;
+        }
+        const auto rand_ns = armTicksToNs(armGetSystemTick() - tick);
+
+        tick = armGetSystemTick();
+        for (u32 i = 0; i < LOOKUPS; i++) {
+            found += index.FindRange(u64(i) * 0x1000 % end, 0x400000).size();
+        }
+        const auto range_ns = armTicksToNs(armGetSystemTick() - tick);
+
+        TEST_CHECK(found);
+        std::printf("\t%7u blocks: Find sequential %.1f ns random %.1f ns, FindRange %.1f ns\n",
+            count, double(seq_ns) / LOOKUPS, double(rand_ns) / LOOKUPS, double(range_ns) / LOOKUPS);
+    }
+}
+
+} // namespace
+
+int main() {
+    TEST_RUN(TestFind);
+    TEST_RUN(TestFindRange);
+    TEST_RUN(TestFindRangeSections);
+    TEST_RUN(BenchLookup);
+}
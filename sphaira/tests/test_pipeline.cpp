@@ -0,0 +1,112 @@
+#include "test.hpp"
+#include "pipeline.hpp"
+#include <thread>
+#include <numeric>
+
+using namespace sphaira;
+
+namespace {
+
+constexpr Result RESULT_CANCELLED = MAKERESULT(Module_Libnx, 1);
+
+// every buffer arrives once and in order.
+void TestQueueOrder() {
+    constexpr int COUNT = 1000;
+    pipeline::Queue<4> queue{};
+    queue.SetDepth(2);
+
+    std::atomic_bool producer_running{true};
+    std::atomic_bool consumer_running{true};
+    auto check = []() -> Result { R_SUCCEED(); };
+
+    std::thread producer([&]{
+        for (int i = 0; i < COUNT; i++) {
+            std::vector<u8> buf(i % 7 + 1, u8(i));
+            TEST_CHECK(R_SUCCEEDED(queue.Push(buf, i, consumer_running, check)));
+        }
+        producer_running = false;
+        queue.WakeAll();
+    });
+
+    int expected = 0;
+    for (;;) {
+        std::vector<u8> buf;
+        s64 off{};
+        TEST_CHECK(R_SUCCEEDED(queue.Pop(buf, off, producer_running, check)));
+        if (buf.empty()) {
+            break;
+        }
+
+        TEST_CHECK(off == expected);
+        TEST_CHECK(buf.size() == size_t(expected % 7 + 1));
+        TEST_CHECK(buf[0] == u8(expected));
+        expected++;
+    }
+
+    consumer_running = false;
+    producer.join();
+
+    TEST_CHECK(expected == COUNT);
+    TEST_CHECK(queue.GetPeak() <= 2);
+}
+
+// a failure in the consumer stops a producer waiting on a full queue.
+void TestQueueCancel() {
+    pipeline::Queue<2> queue{};
+    std::atomic_bool consumer_running{true};
+    std::atomic<Result> consumer_result{};
+    auto check = [&]() -> Result { return consumer_result.load(); };
+
+    std::thread producer([&]{
+        Result rc{};
+        for (int i = 0; R_SUCCEEDED(rc); i++) {
+            std::vector<u8> buf(1);
+            rc = queue.Push(buf, i, consumer_running, check);
+        }
+        TEST_CHECK(rc == RESULT_CANCELLED);
+    });
+
+    // give the producer time to fill the queue and wait, the result is the
+    // same if it hasn't yet.
+    svcSleepThread(1e+7);
+
+    consumer_result = RESULT_CANCELLED;
+    queue.WakeAll();
+    producer.join();
+}
+
+// the ring wraps and keeps the data in order.
+void TestByteRing() {
+    pipeline::ByteRing ring{100};
+    std::vector<u8> in(1000);
+    std::iota(in.begin(), in.end(), 0);
+    std::vector<u8> out;
+
+    for (u64 off = 0; off < in.size();) {
+        off += ring.Write(in.data() + off, std::min<u64>(37, in.size() - off));
+
+        u8 buf[29];
+        const auto n = ring.Read(buf, sizeof(buf));
+        out.insert(out.end(), buf, buf + n);
+    }
+
+    for (;;) {
+        u8 buf[64];
+        const auto n = ring.Read(buf, sizeof(buf));
+        if (!n) {
+            break;
+        }
+        out.insert(out.end(), buf, buf + n);
+    }
+
+    TEST_CHECK(out == in);
+    TEST_CHECK(ring.Size() == 0);
+}
+
+} // namespace
+
+int main() {
+    TEST_RUN(TestQueueOrder);
+    TEST_RUN(TestQueueCancel);
+    TEST_RUN(TestByteRing);
+}
@@ -0,0 +1,147 @@
+#include "test.hpp"
+#include "shim.hpp"
+#include "yati/scheduler.hpp"
+#include <cstring>
+
+using namespace sphaira;
+
+namespace {
+
+constexpr s64 CHUNK_SIZE = 1024*64;
+constexpr Result RESULT_WRITE_FAILED = MAKERESULT(Module_Libnx, 2);
+
+struct Job {
+    s64 size{};
+    NcmPlaceHolderId placeholder_id{};
+    std::vector<u8> data{};
+    std::atomic_bool started{};
+};
+
+auto MakeJobs(NcmContentStorage& cs, u32 count) -> std::vector<Job> {
+    std::vector<Job> jobs(count);
+    for (u32 i = 0; i < count; i++) {
+        auto& job = jobs[i];
+        job.size = CHUNK_SIZE * (4 + i);
+        job.data.resize(job.size);
+        for (s64 j = 0; j < job.size; j++) {
+            job.data[j] = u8(i * 31 + j * 7);
+        }
+
+        ncmContentStorageGeneratePlaceHolderId(&cs, &job.placeholder_id);
+        ncmContentStorageCreatePlaceHolder(&cs, nullptr, &job.placeholder_id, job.size);
+    }
+
+    return jobs;
+}
+
+// writes the job into its placeholder in chunks, the mock sink of an nca install.
+Result WriteJob(NcmContentStorage& cs, yati::Scheduler<Job>& scheduler, Job& job) {
+    job.started = true;
+    for (s64 off = 0; off < job.size; off += CHUNK_SIZE) {
+        R_TRY(scheduler.GetResult());
+        R_TRY(ncmContentStorageWritePlaceHolder(&cs, &job.placeholder_id, off, job.data.data() + off, CHUNK_SIZE));
+        scheduler.UpdateProgress(job, off + CHUNK_SIZE, job.size);
+    }
+    R_SUCCEED();
+}
+
+struct Harness {
+    explicit Harness(u32 count) {
+        ncmOpenContentStorage(&cs, NcmStorageId_SdCard);
+        shim::ClearPlaceHolders();
+        shim::ResetPeakWriters();
+        jobs = MakeJobs(cs, count);
+        for (const auto& job : jobs) {
+            total_size += job.size;
+        }
+    }
+
+    Result Run(u32 max_threads) {
+        yati::Scheduler<Job>* s{};
+        yati::Scheduler<Job> scheduler{jobs,
+            [&](Job& job) {
+                return WriteJob(cs, *s, job);
+            },
+            [this](s64 offset, s64 size) {
+                last_offset = offset;
+                last_size = size;
+            }
+        };
+
+        s = &scheduler;
+        return scheduler.Run(max_threads, 0, 0);
+    }
+
+    auto Verify() -> bool {
+        for (const auto& job : jobs) {
+            std::vector<u8> out;
+            if (!shim::GetPlaceHolder(job.placeholder_id, out) || out != job.data) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    NcmContentStorage cs{};
+    std::vector<Job> jobs{};
+    s64 total_size{};
+    std::atomic<s64> last_offset{};
+    std::atomic<s64> last_size{};
+};
+
+// every job is written once and the progress adds up to the total.
+void TestSerial() {
+    Harness h{3};
+    TEST_CHECK(R_SUCCEEDED(h.Run(1)));
+    TEST_CHECK(h.Verify());
+    TEST_CHECK(shim::GetPeakWriters() == 1);
+    TEST_CHECK(h.last_offset == h.total_size);
+    TEST_CHECK(h.last_size == h.total_size);
+}
+
+// writes of different jobs overlap, the slow storage being the reason for it.
+void TestParallel() {
+    shim::SetWriteLatency(1000000, 0);
+    ON_SCOPE_EXIT(shim::SetWriteLatency(0, 0));
+
+    Harness h{5};
+    TEST_CHECK(R_SUCCEEDED(h.Run(2)));
+    TEST_CHECK(h.Verify());
+    TEST_CHECK(shim::GetPeakWriters() == 2);
+    TEST_CHECK(h.last_offset == h.total_size);
+    TEST_CHECK(h.last_size == h.total_size);
+}
+
+// no more threads than jobs, and a single job runs on the calling thread.
+void TestSingleJob() {
+    Harness h{1};
+    TEST_CHECK(R_SUCCEEDED(h.Run(4)));
+    TEST_CHECK(h.Verify());
+    TEST_CHECK(shim::GetPeakWriters() == 1);
+}
+
+// the first error is returned, and stops the other thread and any jobs not yet started.
+void TestFirstError() {
+    shim::SetWriteLatency(1000000, 0);
+    ON_SCOPE_EXIT(shim::SetWriteLatency(0, 0));
+    shim::FailWriteAfter(3, RESULT_WRITE_FAILED);
+    ON_SCOPE_EXIT(shim::FailWriteAfter(0, 0));
+
+    Harness h{8};
+    TEST_CHECK(h.Run(2) == RESULT_WRITE_FAILED);
+
+    u32 started{};
+    for (const auto& job : h.jobs) {
+        started += job.started;
+    }
+    TEST_CHECK(started == 2);
+}
+
+} // namespace
+
+int main() {
+    TEST_RUN(TestSerial);
+    TEST_RUN(TestParallel);
+    TEST_RUN(TestSingleJob);
+    TEST_RUN(TestFirstError);
+}
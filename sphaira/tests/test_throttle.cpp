@@ -0,0 +1,120 @@
+#include "test.hpp"
+#include "throttle.hpp"
+#include <thread>
+#include <vector>
+
+using namespace sphaira;
+
+namespace {
+
+constexpr u64 DELAY_MAX = 16e+6;
+
+// simulated sd card: a fixed cost per call plus a per byte cost, the latency
+// being multiplied whilst the card is contended. jitter is up to +30%.
+struct Device {
+    u64 fixed_ns{1000000};
+    u64 bytes_per_s{50 * 1024 * 1024};
+    u64 contention{1};
+    u32 seed{1};
+
+    auto Latency(s64 size) -> u64 {
+        seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5;
+        const auto ns = fixed_ns + u64(size) * 1000000000 / bytes_per_s;
+        return ns * contention * (100 + seed % 31) / 100;
+    }
+};
+
+constexpr s64 SIZES[] = {
+    4 * 1024, 16 * 1024, 128 * 1024, 512 * 1024, 1024 * 1024 * 4, 7 * 1024, 300 * 1024,
+};
+
+void Feed(throttle::Controller& controller, Device& device, u32 count) {
+    for (u32 i = 0; i < count; i++) {
+        const auto size = SIZES[(i * 7 + device.seed) % std::size(SIZES)];
+        controller.Update(device.Latency(size), size);
+    }
+}
+
+// small io is slower per byte, which must not be mistaken for contention.
+void TestMixedSizes() {
+    throttle::Controller controller{};
+    Device device{};
+
+    Feed(controller, device, 1000);
+    TEST_CHECK(controller.GetDelay() == 0);
+}
+
+// the delay backs off whilst the card is contended, and recovers after.
+void TestContention() {
+    throttle::Controller controller{};
+    Device device{};
+
+    Feed(controller, device, 1000);
+    TEST_CHECK(controller.GetDelay() == 0);
+
+    device.contention = 4;
+    Feed(controller, device, 8);
+    TEST_CHECK(controller.GetDelay() > 0);
+    Feed(controller, device, 64);
+    TEST_CHECK(controller.GetDelay() == DELAY_MAX);
+
+    device.contention = 1;
+    Feed(controller, device, 1000);
+    TEST_CHECK(controller.GetDelay() == 0);
+}
+
+// every handle shares the controller, disabled handles do nothing.
+void TestShared() {
+    throttle::Controller controller{};
+    throttle::Emummc read{true, controller};
+    throttle::Emummc write{true, controller};
+    throttle::Emummc disabled{false, controller};
+
+    TEST_CHECK(read.IsEnabled());
+    TEST_CHECK(!disabled.IsEnabled());
+    TEST_CHECK(read.GetDelay() == write.GetDelay());
+    TEST_CHECK(disabled.GetDelay() == 0);
+
+    Device device{};
+    for (u32 i = 0; i < 1000; i++) {
+        read.Update(device.Latency(1024 * 512), 1024 * 512);
+    }
+    TEST_CHECK(write.GetDelay() == 0);
+
+    device.contention = 4;
+    write.Update(device.Latency(1024 * 512), 1024 * 512);
+    TEST_CHECK(read.GetDelay() > 0);
+    TEST_CHECK(read.GetDelay() == write.GetDelay());
+
+    bool called{};
+    disabled.Run(1024, [&]{ called = true; return 0; });
+    TEST_CHECK(called);
+}
+
+// updates from several threads, as the read and write threads do.
+void TestThreads() {
+    throttle::Controller controller{};
+    std::vector<std::thread> threads;
+
+    for (u32 i = 0; i < 4; i++) {
+        threads.emplace_back([&controller, i]{
+            Device device{.seed = i + 1};
+            Feed(controller, device, 10000);
+        });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    TEST_CHECK(controller.GetDelay() <= DELAY_MAX);
+}
+
+} // namespace
+
+int main() {
+    TEST_RUN(TestMixedSizes);
+    TEST_RUN(TestContention);
+    TEST_RUN(TestShared);
+    TEST_RUN(TestThreads);
+}
@@ -0,0 +1,353 @@
+#include "test.hpp"
+#include "shim.hpp"
+#include "defines.hpp"
+#include "usb/base.hpp"
+#include <deque>
+#include <cstring>
+#include <cstdio>
+
+using namespace sphaira;
+
+namespace {
+
+constexpr u32 MiB = 1024 * 1024;
+constexpr Result RESULT_IO_ERROR = MAKERESULT(Module_Libnx, 3);
+
+// loopback usb device, the other end being a host that reads from / writes to
+// a byte stream.
+// a transfer completes once the round trip latency has passed since it was posted,
+// and after the transfer before it has completed plus the time to move its data
+// over the bus, so that posting several at once hides the latency.
+struct MockUsb final : usb::Base {
+    struct Config {
+        u64 latency_ns{};
+        u64 bytes_per_s{1024ULL * MiB};
+        // every nth read is short, 0 to disable.
+        u32 short_every{};
+        // the nth transfer fails, 0 to disable.
+        u32 fail_at{};
+    };
+
+    MockUsb(const Config& config) : usb::Base{UINT64_MAX}, m_config{config} {
+        for (auto& ep : m_endpoints) {
+            eventCreate(&ep.completion, false);
+            ep.thread = std::thread(&MockUsb::EndpointThread, this, std::ref(ep));
+        }
+    }
+
+    ~MockUsb() {
+        {
+            std::scoped_lock lock{m_mutex};
+            m_quit = true;
+        }
+        m_cv.notify_all();
+
+        for (auto& ep : m_endpoints) {
+            ep.thread.join();
+        }
+    }
+
+    Result Init() override {
+        R_SUCCEED();
+    }
+
+    Result IsUsbConnected(u64 timeout) override {
+        R_SUCCEED();
+    }
+
+    // data that the host sends for reads.
+    static auto StreamByte(u64 off) -> u8 {
+        return u8(off * 7 + (off >> 12));
+    }
+
+    // data that the host received from writes.
+    auto GetReceived() const -> const std::vector<u8>& {
+        return m_received;
+    }
+
+    auto GetPending() -> u32 {
+        std::scoped_lock lock{m_mutex};
+        return m_endpoints[0].queue.size() + m_endpoints[1].queue.size();
+    }
+
+    auto GetPeakInFlight() const -> u32 {
+        return m_peak_in_flight;
+    }
+
+    auto GetTransferCount() const -> u32 {
+        return m_transfer_count;
+    }
+
+    auto GetMisaligned() const -> u32 {
+        return m_misaligned;
+    }
+
+protected:
+    struct Urb {
+        u32 id;
+        u8* buf;
+        u32 size;
+        u64 post_tick;
+    };
+
+    struct Endpoint {
+        Event completion;
+        std::deque<Urb> queue;
+        std::vector<TransferReport> reports;
+        std::thread thread;
+    };
+
+    Event *GetCompletionEvent(UsbSessionEndpoint ep) override {
+        return &m_endpoints[ep].completion;
+    }
+
+    // same as usbds, the endpoint is cancelled and its event cleared on failure.
+    Result WaitTransferCompletion(UsbSessionEndpoint ep, u64 timeout) override {
+        s32 idx;
+        auto rc = shim::WaitAny(&idx, {GetCompletionEvent(ep), GetCancelEvent()}, timeout);
+        if (R_SUCCEEDED(rc) && idx == 1) {
+            rc = Result_UsbCancelled;
+        }
+
+        if (R_FAILED(rc)) {
+            CancelEndpoint(ep);
+            eventClear(GetCompletionEvent(ep));
+        }
+
+        return rc;
+    }
+
+    Result TransferAsync(UsbSessionEndpoint ep, void *buffer, u32 remaining, u32 size, u32 *out_xfer_id) override {
+        if ((u64)buffer & 0xFFF) {
+            m_misaligned++;
+        }
+
+        std::scoped_lock lock{m_mutex};
+        auto& e = m_endpoints[ep];
+        *out_xfer_id = ++m_next_id;
+        e.queue.emplace_back(Urb{*out_xfer_id, (u8*)buffer, size, armGetSystemTick()});
+        m_peak_in_flight = std::max<u32>(m_peak_in_flight, e.queue.size());
+        m_cv.notify_all();
+        R_SUCCEED();
+    }
+
+    Result GetTransferResult(UsbSessionEndpoint ep, u32 xfer_id, u32 *out_requested_size, u32 *out_transferred_size) override {
+        std::scoped_lock lock{m_mutex};
+        auto& reports = m_endpoints[ep].reports;
+        eventClear(GetCompletionEvent(ep));
+
+        for (auto it = reports.begin(); it != reports.end(); it++) {
+            if (it->id == xfer_id) {
+                const auto report = *it;
+                reports.erase(it);
+                R_TRY(report.rc);
+                *out_transferred_size = report.transferred_size;
+                R_SUCCEED();
+            }
+        }
+
+        R_THROW(RESULT_IO_ERROR);
+    }
+
+    Result GetTransferReports(UsbSessionEndpoint ep, std::span<TransferReport> out, u32 *out_count) override {
+        std::scoped_lock lock{m_mutex};
+        auto& reports = m_endpoints[ep].reports;
+        eventClear(GetCompletionEvent(ep));
+
+        *out_count = std::min<u32>(reports.size(), out.size());
+        std::copy_n(reports.begin(), *out_count, out.begin());
+        reports.erase(reports.begin(), reports.begin() + *out_count);
+
+        // the rest are returned on the next call.
+        if (!reports.empty()) {
+            eventFire(GetCompletionEvent(ep));
+        }
+
+        R_SUCCEED();
+    }
+
+    // same as usbds.
+    void CancelTransfers(UsbSessionEndpoint ep, std::span<const u32> xfer_ids) override {
+        CancelEndpoint(ep);
+        DrainTransfers(ep, xfer_ids);
+        eventClear(GetCompletionEvent(ep));
+    }
+
+private:
+    void CancelEndpoint(UsbSessionEndpoint ep) {
+        std::scoped_lock lock{m_mutex};
+        auto& e = m_endpoints[ep];
+        if (e.queue.empty()) {
+            return;
+        }
+
+        for (const auto& urb : e.queue) {
+            e.reports.emplace_back(TransferReport{urb.id, KERNELRESULT(Cancelled), 0});
+        }
+        e.queue.clear();
+        eventFire(GetCompletionEvent(ep));
+    }
+
+    void EndpointThread(Endpoint& e) {
+        const bool read = &e == &m_endpoints[UsbSessionEndpoint_Out];
+        u64 bus_free_tick{};
+
+        std::unique_lock lock{m_mutex};
+        while (true) {
+            m_cv.wait(lock, [&]{ return m_quit || !e.queue.empty(); });
+            if (m_quit) {
+                return;
+            }
+
+            const auto urb = e.queue.front();
+            const auto bus_ns = u64(urb.size) * 1000000000 / m_config.bytes_per_s;
+            const auto start = std::max(urb.post_tick + m_config.latency_ns, std::max(bus_free_tick, armGetSystemTick()));
+            const auto end = start + bus_ns;
+
+            lock.unlock();
+            const auto now = armGetSystemTick();
+            if (end > now) {
+                svcSleepThread(end - now);
+            }
+            bus_free_tick = armGetSystemTick();
+            lock.lock();
+
+            // cancelled whilst the data was being moved.
+            if (e.queue.empty() || e.queue.front().id != urb.id) {
+                continue;
+            }
+            e.queue.pop_front();
+
+            const auto count = ++m_transfer_count;
+            TransferReport report{urb.id, 0, urb.size};
+            if (m_config.fail_at && count == m_config.fail_at) {
+                report.rc = RESULT_IO_ERROR;
+                report.transferred_size = 0;
+            } else if (read) {
+                if (m_config.short_every && !(count % m_config.short_every)) {
+                    report.transferred_size = urb.size / 2 - 100;
+                }
+                for (u32 i = 0; i < report.transferred_size; i++) {
+                    urb.buf[i] = StreamByte(m_read_off + i);
+                }
+                m_read_off += report.transferred_size;
+            } else {
+                m_received.insert(m_received.end(), urb.buf, urb.buf + urb.size);
+            }
+
+            e.reports.emplace_back(report);
+            eventFire(&e.completion);
+        }
+    }
+
+private:
+    const Config m_config;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    Endpoint m_endpoints[2];
+    bool m_quit{};
+    u32 m_next_id{};
+    u64 m_read_off{};
+    std::vector<u8> m_received;
+    u32 m_peak_in_flight{};
+    u32 m_transfer_count{};
+    std::atomic<u32> m_misaligned{};
+};
+
+auto MakeData(u32 size) -> std::vector<u8> {
+    std::vector<u8> data(size);
+    for (u32 i = 0; i < size; i++) {
+        data[i] = MockUsb::StreamByte(i);
+    }
+    return data;
+}
+
+void TestRead() {
+    MockUsb usb{{}};
+    std::vector<u8> buf(MiB * 16);
+    TEST_CHECK(R_SUCCEEDED(usb.TransferAll(true, buf.data(), buf.size())));
+    TEST_CHECK(buf == MakeData(buf.size()));
+    TEST_CHECK(usb.GetPeakInFlight() == 4);
+
+    // small transfers are not queued.
+    TEST_CHECK(R_SUCCEEDED(usb.TransferAll(true, buf.data(), 1000)));
+    TEST_CHECK(usb.GetMisaligned() == 0);
+}
+
+// the missing data of short reads is requested again, always at an aligned offset.
+void TestShortRead() {
+    MockUsb usb{{ .short_every = 3 }};
+    std::vector<u8> buf(MiB * 16 - 123);
+    TEST_CHECK(R_SUCCEEDED(usb.TransferAll(true, buf.data(), buf.size())));
+    TEST_CHECK(buf == MakeData(buf.size()));
+    TEST_CHECK(usb.GetMisaligned() == 0);
+    TEST_CHECK(usb.GetPending() == 0);
+}
+
+void TestWrite() {
+    MockUsb usb{{}};
+    const auto data = MakeData(MiB * 16 - 123);
+    TEST_CHECK(R_SUCCEEDED(usb.TransferAll(false, (void*)data.data(), data.size())));
+    TEST_CHECK(usb.GetReceived() == data);
+    TEST_CHECK(usb.GetMisaligned() == 0);
+}
+
+// a failed transfer cancels the rest, without waiting for the cancel timeout.
+void TestFail() {
+    MockUsb usb{{ .latency_ns = 1000000, .fail_at = 2 }};
+    std::vector<u8> buf(MiB * 16);
+
+    const auto start = armGetSystemTick();
+    TEST_CHECK(usb.TransferAll(true, buf.data(), buf.size()) == RESULT_IO_ERROR);
+    TEST_CHECK(armTicksToNs(armGetSystemTick() - start) < 500000000);
+    TEST_CHECK(usb.GetPending() == 0);
+}
+
+// the events of the failed wait are cleared, the reports of the cancelled
+// transfers must still be picked up without waiting for the timeout.
+void TestCancel() {
+    MockUsb usb{{ .latency_ns = 50000000 }};
+    std::vector<u8> buf(MiB * 16);
+
+    usb.Cancel();
+    const auto start = armGetSystemTick();
+    TEST_CHECK(usb.TransferAll(true, buf.data(), buf.size()) == Result_UsbCancelled);
+    TEST_CHECK(armTicksToNs(armGetSystemTick() - start) < 500000000);
+    TEST_CHECK(usb.GetPending() == 0);
+}
+
+// with latency, posting several transfers at once keeps the bus busy.
+void TestQueueDepth() {
+    constexpr u32 SIZE = MiB * 16;
+    constexpr u32 LOOPS = 4;
+    std::vector<u8> buf(SIZE);
+    double speed[5]{};
+
+    for (u32 depth = 1; depth <= 4; depth++) {
+        MockUsb usb{{ .latency_ns = 4000000, .bytes_per_s = 1024ULL * MiB }};
+        usb.SetMaxInFlight(depth);
+
+        const auto start = armGetSystemTick();
+        for (u32 i = 0; i < LOOPS; i++) {
+            TEST_CHECK(R_SUCCEEDED(usb.TransferAll(i & 1, buf.data(), buf.size())));
+        }
+        const auto ns = armTicksToNs(armGetSystemTick() - start);
+
+        TEST_CHECK(usb.GetPeakInFlight() == depth);
+        speed[depth] = double(SIZE) * LOOPS / MiB / (double(ns) / 1e+9);
+        std::printf("\tdepth: %u %.2f MiB/s\n", depth, speed[depth]);
+    }
+
+    TEST_CHECK(speed[4] > speed[1] * 1.5);
+}
+
+} // namespace
+
+int main() {
+    TEST_RUN(TestRead);
+    TEST_RUN(TestShortRead);
+    TEST_RUN(TestWrite);
+    TEST_RUN(TestFail);
+    TEST_RUN(TestCancel);
+    TEST_RUN(TestQueueDepth);
+}